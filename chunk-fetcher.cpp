@@ -0,0 +1,177 @@
+/*
+  Fetch of an object version as a recipe of chunks.
+
+  @author Waldo Jordaan
+*/
+
+#include "chunk-fetcher.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/segment-fetcher.hpp>
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <set>
+
+NDN_LOG_INIT(PSync.ChunkFetcher);
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const ndn::time::milliseconds CHUNK_LIFETIME(2000);
+const int CHUNK_TRIES = 3;
+// Same bounds as the manifest fetch: a node without a recipe should not hold up the fallback
+const ndn::time::milliseconds RECIPE_LIFETIME(1000);
+const ndn::time::milliseconds RECIPE_TIMEOUT(2000);
+
+} // namespace
+
+void
+ChunkFetcher::start(ndn::Face& face, ndn::security::Validator& validator, ChunkStore& store,
+                    const ndn::Name& recipeName, const std::string& outPath,
+                    size_t window, Offload offload, Callback cb)
+{
+  std::shared_ptr<ChunkFetcher> self(new ChunkFetcher(face, store, outPath, window, std::move(offload),
+                                                      std::move(cb)));
+  self->fetchRecipe(validator, recipeName);
+}
+
+ChunkFetcher::ChunkFetcher(ndn::Face& face, ChunkStore& store, const std::string& outPath,
+                           size_t window, Offload offload, Callback cb)
+  : m_face(face)
+  , m_store(store)
+  , m_outPath(outPath)
+  , m_window(std::max<size_t>(1, window))
+  , m_offload(std::move(offload))
+  , m_cb(std::move(cb))
+{
+}
+
+void
+ChunkFetcher::fetchRecipe(ndn::security::Validator& validator, const ndn::Name& recipeName)
+{
+  ndn::SegmentFetcher::Options opts;
+  opts.interestLifetime = RECIPE_LIFETIME;
+  opts.maxTimeout = RECIPE_TIMEOUT;
+  auto fetcher = ndn::SegmentFetcher::start(m_face, ndn::Interest(recipeName), validator, opts);
+
+  fetcher->onComplete.connect([self = shared_from_this()] (ndn::ConstBufferPtr wire) {
+    self->onRecipe(*wire);
+  });
+
+  fetcher->onError.connect([self = shared_from_this(), recipeName] (uint32_t code, const std::string& msg) {
+    NDN_LOG_DEBUG("No recipe " << recipeName << " (" << code << "): " << msg);
+    self->finish(false, "no-recipe");
+  });
+}
+
+void
+ChunkFetcher::onRecipe(ndn::span<const uint8_t> wire)
+{
+  m_result.recipe = ChunkStore::Recipe::decode(wire);
+  if (!m_result.recipe) {
+    finish(false, "bad-recipe");
+    return;
+  }
+  m_result.total = m_result.recipe->chunks.size();
+
+  // A chunk repeated within the file, or already held for another name or version, is fetched at most once
+  std::set<ChunkStore::Digest> seen;
+  for (const auto& entry : m_result.recipe->chunks) {
+    if (seen.insert(entry.digest).second && !m_store.has(entry.digest))
+      m_missing.push_back(entry.digest);
+  }
+
+  fill();
+}
+
+void
+ChunkFetcher::fill()
+{
+  if (m_finished)
+    return;
+
+  if (m_next == m_missing.size() && m_inFlight == 0) {
+    m_offload([self = shared_from_this()] {
+      bool ok = self->m_store.assemble(*self->m_result.recipe, self->m_outPath);
+      boost::asio::post(self->m_face.getIoContext(), [self, ok] {
+        self->finish(ok, ok ? "" : "assemble-error");
+      });
+    });
+    return;
+  }
+
+  while (m_inFlight < m_window && m_next < m_missing.size()) {
+    ++m_inFlight;
+    expressChunk(m_missing[m_next++], CHUNK_TRIES);
+  }
+}
+
+void
+ChunkFetcher::expressChunk(const ChunkStore::Digest& digest, int triesLeft)
+{
+  ndn::Interest interest(ChunkStore::chunkName(digest));
+  interest.setCanBePrefix(false);
+  interest.setInterestLifetime(CHUNK_LIFETIME);
+
+  m_face.expressInterest(interest,
+    [self = shared_from_this(), digest] (const ndn::Interest&, const ndn::Data& data) {
+      self->onChunk(digest, data);
+    },
+    [self = shared_from_this()] (const ndn::Interest&, const ndn::lp::Nack&) {
+      self->finish(false, "nack");
+    },
+    [self = shared_from_this(), digest, triesLeft] (const ndn::Interest&) {
+      if (self->m_finished)
+        return;
+      if (triesLeft <= 1) {
+        self->finish(false, "timeout");
+        return;
+      }
+      self->expressChunk(digest, triesLeft - 1);
+    });
+}
+
+void
+ChunkFetcher::onChunk(const ChunkStore::Digest& digest, const ndn::Data& data)
+{
+  if (m_finished)
+    return;
+
+  // The name is the content's digest, so the chunk verifies itself. The Block shares the packet's buffer.
+  m_offload([self = shared_from_this(), digest, content = data.getContent()] {
+    bool ok = Manifest::computeDigest(content.value_bytes()) == digest;
+    if (ok)
+      self->m_store.put(content.value_bytes());
+    boost::asio::post(self->m_face.getIoContext(), [self, ok, size = content.value_size()] {
+      if (!ok) {
+        self->finish(false, "digest-mismatch");
+        return;
+      }
+      ++self->m_result.fetched;
+      self->m_result.bytes += size;
+      --self->m_inFlight;
+      self->fill();
+    });
+  });
+}
+
+void
+ChunkFetcher::finish(bool ok, const std::string& reason)
+{
+  if (m_finished)
+    return;
+  m_finished = true;
+
+  if (!ok) {
+    std::error_code ec;
+    fs::remove(m_outPath, ec);
+  }
+
+  m_result.ok = ok;
+  m_result.reason = reason;
+  m_cb(m_result);
+}
@@ -0,0 +1,83 @@
+/*
+  Fetch of an object version as a recipe of chunks.
+
+  Fetches the recipe /32=recipe/<name>/t=<ts>, requests every chunk it lists
+  that the local ChunkStore does not hold yet, checks each against its digest
+  and adds it to the store, then assembles the file from the store into the
+  output path. The caller renames the output into place and falls back to a
+  segment fetch when ok == false. Digesting and storing chunks and assembling
+  the file run through offload, off the io thread.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CHUNK_FETCHER_HPP
+#define V2V_CHUNK_FETCHER_HPP
+
+#include "chunk-store.hpp"
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/validator.hpp>
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class ChunkFetcher : public std::enable_shared_from_this<ChunkFetcher>
+{
+public:
+  struct Result
+  {
+    bool ok = false;
+    uint64_t fetched = 0;               // chunks fetched
+    uint64_t bytes = 0;                 // content bytes fetched
+    uint64_t total = 0;                 // chunks in the recipe
+    std::string reason;                 // why the chunk fetch failed
+    std::optional<ChunkStore::Recipe> recipe;
+  };
+
+  // Called on the Face's io thread, exactly once
+  using Callback = std::function<void(const Result&)>;
+
+  // Runs a task on a worker thread, in the order given; results are posted back to the io thread
+  using Offload = std::function<void(std::function<void()>)>;
+
+  static void start(ndn::Face& face, ndn::security::Validator& validator, ChunkStore& store,
+                    const ndn::Name& recipeName, const std::string& outPath,
+                    size_t window, Offload offload, Callback cb);
+
+private:
+  ChunkFetcher(ndn::Face& face, ChunkStore& store, const std::string& outPath,
+               size_t window, Offload offload, Callback cb);
+
+  void fetchRecipe(ndn::security::Validator& validator, const ndn::Name& recipeName);
+
+  void onRecipe(ndn::span<const uint8_t> wire);
+
+  // Keep up to m_window chunk Interests outstanding
+  void fill();
+
+  void expressChunk(const ChunkStore::Digest& digest, int triesLeft);
+
+  void onChunk(const ChunkStore::Digest& digest, const ndn::Data& data);
+
+  void finish(bool ok, const std::string& reason = {});
+
+private:
+  ndn::Face& m_face;
+  ChunkStore& m_store;
+  std::string m_outPath;
+  size_t m_window;
+  Offload m_offload;
+  Callback m_cb;
+
+  Result m_result;
+  std::vector<ChunkStore::Digest> m_missing;
+  size_t m_next = 0;     // index into m_missing of the next chunk to request
+  size_t m_inFlight = 0;  // chunks requested or being stored
+  bool m_finished = false;
+};
+
+#endif // V2V_CHUNK_FETCHER_HPP
@@ -0,0 +1,100 @@
+/*
+  Serves the chunk store to other nodes.
+
+  @author Waldo Jordaan
+*/
+
+#include "chunk-server.hpp"
+#include "repo-client.hpp"
+#include "version-index.hpp"
+
+#include <ndn-cxx/security/signing-helpers.hpp>
+#include <ndn-cxx/util/logger.hpp>
+
+#include <algorithm>
+
+NDN_LOG_INIT(PSync.ChunkServer);
+
+namespace {
+
+// A chunk never changes; a recipe is replaced when the object gets a newer version
+const ndn::time::milliseconds CHUNK_FRESHNESS(3600000);
+const ndn::time::milliseconds RECIPE_FRESHNESS(10000);
+
+} // namespace
+
+ChunkServer::ChunkServer(ndn::Face& face, ndn::KeyChain& keyChain, ChunkStore& store)
+  : m_face(face)
+  , m_keyChain(keyChain)
+  , m_store(store)
+{
+  auto onFail = [] (const ndn::Name& prefix, const std::string& reason) {
+    NDN_LOG_ERROR("Cannot register " << prefix << ": " << reason);
+  };
+
+  m_chunkHandle = m_face.setInterestFilter(ndn::Name("/32=chunk"),
+    [this] (const ndn::InterestFilter&, const ndn::Interest& interest) { onChunkInterest(interest); },
+    onFail);
+  m_recipeHandle = m_face.setInterestFilter(ndn::Name("/32=recipe"),
+    [this] (const ndn::InterestFilter&, const ndn::Interest& interest) { onRecipeInterest(interest); },
+    onFail);
+}
+
+void
+ChunkServer::onChunkInterest(const ndn::Interest& interest)
+{
+  ChunkStore::Digest digest;
+  auto content = ChunkStore::parseChunkName(interest.getName(), digest) ? m_store.get(digest) : std::nullopt;
+  if (!content) {
+    ++m_stats.misses;
+    return;
+  }
+
+  ndn::Data data(interest.getName());
+  data.setContent(*content);
+  data.setFreshnessPeriod(CHUNK_FRESHNESS);
+  m_keyChain.sign(data, ndn::security::signingWithSha256());
+  m_face.put(data);
+  ++m_stats.chunks;
+}
+
+void
+ChunkServer::onRecipeInterest(const ndn::Interest& interest)
+{
+  // /32=recipe/<generic name>/t=<ts>[/seg=<i>]
+  const ndn::Name& name = interest.getName();
+  auto [genericPrefix, timestamp] = VersionIndex::splitVersion(name.getSubName(1));
+  size_t versionEnd = 1 + genericPrefix.size() + 1;
+  if (genericPrefix.empty() || timestamp == 0 || name.size() > versionEnd + 1) {
+    ++m_stats.misses;
+    return;
+  }
+
+  auto recipe = m_store.loadRecipe(genericPrefix, timestamp);
+  if (!recipe) {
+    ++m_stats.misses;
+    return;
+  }
+
+  const size_t segmentSize = RepoClient::DEFAULT_SEGMENT_SIZE;
+  uint64_t nSegments = std::max<uint64_t>(1, (recipe->size() + segmentSize - 1) / segmentSize);
+  uint64_t seg = 0;
+  if (name.size() == versionEnd + 1) {
+    if (!name.at(-1).isSegment() || name.at(-1).toSegment() >= nSegments) {
+      ++m_stats.misses;
+      return;
+    }
+    seg = name.at(-1).toSegment();
+  }
+
+  size_t offset = std::min<size_t>(seg * segmentSize, recipe->size());
+  size_t len = std::min(segmentSize, recipe->size() - offset);
+
+  ndn::Data data(name.getPrefix(versionEnd).appendSegment(seg));
+  data.setContent(ndn::span<const uint8_t>(recipe->data() + offset, len));
+  data.setFinalBlock(ndn::name::Component::fromSegment(nSegments - 1));
+  data.setFreshnessPeriod(RECIPE_FRESHNESS);
+  m_keyChain.sign(data, ndn::security::signingWithSha256());
+  m_face.put(data);
+  ++m_stats.recipes;
+}
@@ -0,0 +1,52 @@
+/*
+  Serves the chunk store to other nodes.
+
+  Answers /32=chunk/<hex digest> with the chunk itself and
+  /32=recipe/<name>/t=<ts>[/seg=<i>] with the recipe of that object version,
+  segmented like any other object so SegmentFetcher can retrieve it. Both come
+  straight from the on-disk store, so chunks added by chunk-tool are served
+  without a restart.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CHUNK_SERVER_HPP
+#define V2V_CHUNK_SERVER_HPP
+
+#include "chunk-store.hpp"
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+
+class ChunkServer
+{
+public:
+  struct Stats
+  {
+    uint64_t chunks = 0;  // chunk Data packets sent
+    uint64_t recipes = 0; // recipe segments sent
+    uint64_t misses = 0;  // Interests the store could not answer
+  };
+
+  ChunkServer(ndn::Face& face, ndn::KeyChain& keyChain, ChunkStore& store);
+
+  const Stats& getStats() const
+  {
+    return m_stats;
+  }
+
+private:
+  void onChunkInterest(const ndn::Interest& interest);
+
+  void onRecipeInterest(const ndn::Interest& interest);
+
+private:
+  ndn::Face& m_face;
+  ndn::KeyChain& m_keyChain;
+  ChunkStore& m_store;
+  ndn::ScopedRegisteredPrefixHandle m_chunkHandle;
+  ndn::ScopedRegisteredPrefixHandle m_recipeHandle;
+  Stats m_stats;
+};
+
+#endif // V2V_CHUNK_SERVER_HPP
@@ -0,0 +1,377 @@
+/*
+  Content-addressed chunk store with content-defined chunking.
+
+  @author Waldo Jordaan
+*/
+
+#include "chunk-store.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/string-helper.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_set>
+
+#include <unistd.h>
+
+NDN_LOG_INIT(PSync.ChunkStore);
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Normalized chunking: a harder mask before the average size, an easier one after it.
+// The masks test high bits, which depend on the last 64 bytes rather than the last few.
+const uint64_t MASK_SMALL = ~uint64_t(0) << (64 - 14);
+const uint64_t MASK_LARGE = ~uint64_t(0) << (64 - 10);
+
+// Every node must cut at the same places, so the table is derived from a fixed seed (splitmix64)
+const std::array<uint64_t, 256>&
+gearTable()
+{
+  static const std::array<uint64_t, 256> table = [] {
+    std::array<uint64_t, 256> t{};
+    uint64_t state = 0x7632764348554e4bULL;
+    for (auto& entry : t) {
+      uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      entry = z ^ (z >> 31);
+    }
+    return t;
+  }();
+  return table;
+}
+
+void
+appendBigEndian(std::vector<uint8_t>& out, uint64_t value, size_t width)
+{
+  for (size_t i = width; i > 0; --i) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * (i - 1))));
+  }
+}
+
+uint64_t
+readBigEndian(const uint8_t* in, size_t width)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < width; ++i) {
+    value = (value << 8) | in[i];
+  }
+  return value;
+}
+
+std::string
+toHex(const ChunkStore::Digest& digest)
+{
+  return ndn::toHex(digest, false);
+}
+
+// Write through a temporary sibling and rename, so other processes never see a partial file
+bool
+writeAtomically(const fs::path& path, ndn::span<const uint8_t> content)
+{
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+
+  fs::path tmp = path.string() + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(content.data()), content.size());
+    if (!out) {
+      fs::remove(tmp, ec);
+      return false;
+    }
+  }
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fs::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::vector<uint8_t>>
+readFile(const fs::path& path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return std::nullopt;
+  return std::vector<uint8_t>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+std::vector<uint8_t>
+ChunkStore::Recipe::encode() const
+{
+  std::vector<uint8_t> out;
+  out.reserve(16 + chunks.size() * (sizeof(Digest) + 4));
+  out.insert(out.end(), {'V', '2', 'V', 'R'});
+  appendBigEndian(out, fileSize, 8);
+  appendBigEndian(out, chunks.size(), 4);
+  for (const auto& chunk : chunks) {
+    out.insert(out.end(), chunk.digest.begin(), chunk.digest.end());
+    appendBigEndian(out, chunk.size, 4);
+  }
+  return out;
+}
+
+std::optional<ChunkStore::Recipe>
+ChunkStore::Recipe::decode(ndn::span<const uint8_t> wire)
+{
+  const size_t headerSize = 16;
+  const size_t entrySize = sizeof(Digest) + 4;
+  if (wire.size() < headerSize || std::memcmp(wire.data(), "V2VR", 4) != 0)
+    return std::nullopt;
+
+  Recipe recipe;
+  recipe.fileSize = readBigEndian(wire.data() + 4, 8);
+  uint64_t n = readBigEndian(wire.data() + 12, 4);
+  if (wire.size() != headerSize + n * entrySize)
+    return std::nullopt;
+
+  uint64_t total = 0;
+  recipe.chunks.resize(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    const uint8_t* entry = wire.data() + headerSize + i * entrySize;
+    std::memcpy(recipe.chunks[i].digest.data(), entry, sizeof(Digest));
+    recipe.chunks[i].size = static_cast<uint32_t>(readBigEndian(entry + sizeof(Digest), 4));
+    if (recipe.chunks[i].size > MAX_CHUNK)
+      return std::nullopt;
+    total += recipe.chunks[i].size;
+  }
+
+  if (total != recipe.fileSize)
+    return std::nullopt;
+  return recipe;
+}
+
+ChunkStore::ChunkStore(const fs::path& dir)
+  : m_dir(dir)
+{
+  std::error_code ec;
+  fs::create_directories(m_dir / "chunks", ec);
+  fs::create_directories(m_dir / "recipes", ec);
+}
+
+std::vector<size_t>
+ChunkStore::split(ndn::span<const uint8_t> content)
+{
+  const auto& gear = gearTable();
+  std::vector<size_t> lengths;
+  lengths.reserve(content.size() / AVG_CHUNK + 1);
+
+  size_t pos = 0;
+  while (pos < content.size()) {
+    size_t remaining = content.size() - pos;
+    if (remaining <= MIN_CHUNK) {
+      lengths.push_back(remaining);
+      break;
+    }
+
+    size_t end = std::min(remaining, MAX_CHUNK);
+    size_t normal = std::min(end, AVG_CHUNK);
+    size_t len = end;
+    uint64_t hash = 0;
+    for (size_t i = MIN_CHUNK; i < end; ++i) {
+      hash = (hash << 1) + gear[content[pos + i]];
+      if ((hash & (i < normal ? MASK_SMALL : MASK_LARGE)) == 0) {
+        len = i + 1;
+        break;
+      }
+    }
+
+    lengths.push_back(len);
+    pos += len;
+  }
+  return lengths;
+}
+
+fs::path
+ChunkStore::chunkPath(const Digest& digest) const
+{
+  std::string hex = toHex(digest);
+  return m_dir / "chunks" / hex.substr(0, 2) / hex;
+}
+
+fs::path
+ChunkStore::recipeDir(const ndn::Name& genericPrefix) const
+{
+  // URI-escaped components, so "." and ".." cannot leave the recipes directory
+  fs::path dir = m_dir / "recipes";
+  for (const auto& comp : genericPrefix) {
+    dir /= comp.toUri();
+  }
+  return dir;
+}
+
+bool
+ChunkStore::has(const Digest& digest) const
+{
+  std::error_code ec;
+  return fs::is_regular_file(chunkPath(digest), ec);
+}
+
+std::optional<std::vector<uint8_t>>
+ChunkStore::get(const Digest& digest) const
+{
+  return readFile(chunkPath(digest));
+}
+
+ChunkStore::Digest
+ChunkStore::put(ndn::span<const uint8_t> content)
+{
+  Digest digest = Manifest::computeDigest(content);
+  if (has(digest)) {
+    // A chunk no recipe refers to yet may be collected; reusing it restarts its grace period
+    std::error_code ec;
+    fs::last_write_time(chunkPath(digest), fs::file_time_type::clock::now(), ec);
+    m_stats.reused.fetch_add(1, std::memory_order_relaxed);
+    return digest;
+  }
+
+  if (writeAtomically(chunkPath(digest), content)) {
+    m_stats.added.fetch_add(1, std::memory_order_relaxed);
+  }
+  else {
+    NDN_LOG_WARN("Cannot write chunk " << toHex(digest));
+  }
+  return digest;
+}
+
+std::optional<ChunkStore::Recipe>
+ChunkStore::addFile(const std::string& path)
+{
+  auto content = readFile(path);
+  if (!content)
+    return std::nullopt;
+
+  Recipe recipe;
+  recipe.fileSize = content->size();
+
+  size_t offset = 0;
+  for (size_t len : split(*content)) {
+    ndn::span<const uint8_t> chunk(content->data() + offset, len);
+    recipe.chunks.push_back({put(chunk), static_cast<uint32_t>(len)});
+    offset += len;
+  }
+  return recipe;
+}
+
+bool
+ChunkStore::assemble(const Recipe& recipe, const std::string& outPath) const
+{
+  std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+  if (!out)
+    return false;
+
+  for (const auto& entry : recipe.chunks) {
+    auto chunk = get(entry.digest);
+    if (!chunk || chunk->size() != entry.size) {
+      NDN_LOG_WARN("Chunk " << toHex(entry.digest) << " missing while assembling " << outPath);
+      return false;
+    }
+    out.write(reinterpret_cast<const char*>(chunk->data()), chunk->size());
+  }
+
+  out.close();
+  return static_cast<bool>(out);
+}
+
+bool
+ChunkStore::saveRecipe(const ndn::Name& genericPrefix, uint64_t timestamp, const Recipe& recipe)
+{
+  fs::path dir = recipeDir(genericPrefix);
+  if (!writeAtomically(dir / (std::to_string(timestamp) + ".recipe"), recipe.encode()))
+    return false;
+
+  // Only the newest version of an object is served; its chunks stay as long as a recipe uses them
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    const auto& path = entry.path();
+    if (!entry.is_regular_file(ec) || path.extension() != ".recipe")
+      continue;
+    try {
+      if (std::stoull(path.stem().string()) < timestamp)
+        fs::remove(path, ec);
+    }
+    catch (const std::exception&) {
+    }
+  }
+  return true;
+}
+
+std::optional<std::vector<uint8_t>>
+ChunkStore::loadRecipe(const ndn::Name& genericPrefix, uint64_t timestamp) const
+{
+  return readFile(recipeDir(genericPrefix) / (std::to_string(timestamp) + ".recipe"));
+}
+
+size_t
+ChunkStore::gc(std::chrono::seconds grace)
+{
+  std::unordered_set<std::string> referenced;
+  std::error_code ec;
+  for (const auto& entry : fs::recursive_directory_iterator(m_dir / "recipes", ec)) {
+    if (!entry.is_regular_file(ec) || entry.path().extension() != ".recipe")
+      continue;
+    auto wire = readFile(entry.path());
+    auto recipe = wire ? Recipe::decode(*wire) : std::nullopt;
+    if (!recipe) {
+      // An unreadable recipe could hold references; collecting now might break it
+      NDN_LOG_WARN("Skipping chunk GC: cannot parse " << entry.path());
+      return 0;
+    }
+    for (const auto& chunk : recipe->chunks) {
+      referenced.insert(toHex(chunk.digest));
+    }
+  }
+
+  auto cutoff = fs::file_time_type::clock::now() - grace;
+  size_t removed = 0;
+  for (const auto& entry : fs::recursive_directory_iterator(m_dir / "chunks", ec)) {
+    if (!entry.is_regular_file(ec))
+      continue;
+    if (referenced.count(entry.path().filename().string()) > 0)
+      continue;
+    if (entry.last_write_time(ec) > cutoff)
+      continue;
+    if (fs::remove(entry.path(), ec))
+      ++removed;
+  }
+  return removed;
+}
+
+ndn::Name
+ChunkStore::chunkName(const Digest& digest)
+{
+  return ndn::Name().append(ndn::name::Component::fromEscapedString("32=chunk")).append(toHex(digest));
+}
+
+ndn::Name
+ChunkStore::recipeName(const ndn::Name& genericPrefix)
+{
+  return ndn::Name().append(ndn::name::Component::fromEscapedString("32=recipe")).append(genericPrefix);
+}
+
+bool
+ChunkStore::parseChunkName(const ndn::Name& name, Digest& digest)
+{
+  if (name.size() != 2 || name.at(1).value_size() != 2 * digest.size())
+    return false;
+
+  try {
+    auto bytes = ndn::fromHex(std::string(reinterpret_cast<const char*>(name.at(1).value()),
+                                          name.at(1).value_size()));
+    std::copy_n(bytes->begin(), digest.size(), digest.begin());
+    return true;
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+}
@@ -0,0 +1,124 @@
+/*
+  Content-addressed chunk store with content-defined chunking.
+
+  split() cuts a file where a gear rolling hash over the last 64 bytes hits a
+  mask (FastCDC-style normalized chunking), so an insertion only moves the
+  boundaries next to it and identical regions of different files or versions
+  produce identical chunks. Each chunk is stored once under its SHA-256 digest
+  and is small enough to travel in a single Data packet.
+
+  A file is described by a recipe: its size and the ordered list of chunk
+  digests. Recipes are kept per object version; the chunks they reference are
+  shared by every name and version.
+
+  On-disk layout under the store directory:
+    chunks/<first 2 hex digits>/<64 hex digits>
+    recipes/<generic name>/<timestamp>.recipe
+
+  Recipe layout (network byte order):
+    "V2VR" | u64 fileSize | u32 nChunks | (digest[32] | u32 chunkSize)*
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CHUNK_STORE_HPP
+#define V2V_CHUNK_STORE_HPP
+
+#include "manifest.hpp"
+
+#include <ndn-cxx/name.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+class ChunkStore
+{
+public:
+  static constexpr size_t MIN_CHUNK = 2048;
+  static constexpr size_t AVG_CHUNK = 4096;
+  static constexpr size_t MAX_CHUNK = 8000; // one chunk per Data packet, like putfile.py's segments
+
+  using Digest = Manifest::Digest;
+
+  struct Recipe
+  {
+    struct Entry
+    {
+      Digest digest;
+      uint32_t size = 0;
+    };
+
+    uint64_t fileSize = 0;
+    std::vector<Entry> chunks;
+
+    std::vector<uint8_t> encode() const;
+
+    static std::optional<Recipe> decode(ndn::span<const uint8_t> wire);
+  };
+
+  // Updated from any thread: the store may be used by several shards and the io thread at once
+  struct Stats
+  {
+    std::atomic<uint64_t> added{0};  // chunks written to the store
+    std::atomic<uint64_t> reused{0}; // chunks that were already there
+  };
+
+  explicit ChunkStore(const std::filesystem::path& dir);
+
+  // Lengths of the consecutive chunks content is cut into
+  static std::vector<size_t> split(ndn::span<const uint8_t> content);
+
+  bool has(const Digest& digest) const;
+
+  std::optional<std::vector<uint8_t>> get(const Digest& digest) const;
+
+  // Store content under its digest unless it is already there
+  Digest put(ndn::span<const uint8_t> content);
+
+  // Chunk a file into the store, or nullopt if it cannot be read
+  std::optional<Recipe> addFile(const std::string& path);
+
+  // Write the file a recipe describes to outPath. Fails if a chunk is missing.
+  bool assemble(const Recipe& recipe, const std::string& outPath) const;
+
+  // Keep the recipe of one object version; older versions of the object are forgotten
+  bool saveRecipe(const ndn::Name& genericPrefix, uint64_t timestamp, const Recipe& recipe);
+
+  // Encoded recipe of one object version, as served to other nodes
+  std::optional<std::vector<uint8_t>> loadRecipe(const ndn::Name& genericPrefix, uint64_t timestamp) const;
+
+  /*
+    Remove chunks no recipe refers to. Chunks written or reused by put() within
+    the grace period are kept, since a concurrent addFile() may not have saved
+    its recipe yet. Returns the number of chunks removed.
+  */
+  size_t gc(std::chrono::seconds grace = std::chrono::minutes(10));
+
+  const Stats& getStats() const
+  {
+    return m_stats;
+  }
+
+  // /32=chunk/<hex digest>
+  static ndn::Name chunkName(const Digest& digest);
+
+  // /32=recipe/<genericPrefix>; the timestamp is appended like for the object itself
+  static ndn::Name recipeName(const ndn::Name& genericPrefix);
+
+  static bool parseChunkName(const ndn::Name& name, Digest& digest);
+
+private:
+  std::filesystem::path chunkPath(const Digest& digest) const;
+
+  std::filesystem::path recipeDir(const ndn::Name& genericPrefix) const;
+
+private:
+  std::filesystem::path m_dir;
+  Stats m_stats;
+};
+
+#endif // V2V_CHUNK_STORE_HPP
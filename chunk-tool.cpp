@@ -0,0 +1,74 @@
+/*
+  Command-line access to the chunk store psync-start serves from.
+
+  Usage: ./chunk-tool [--store <dir>] add <file> <name> <timestamp>
+         ./chunk-tool [--store <dir>] get <name> <timestamp> <out-file>
+         ./chunk-tool [--store <dir>] gc
+
+  add chunks a file into the store and saves it as the recipe of
+  <name>/t=<timestamp>; update-repo-file.py runs it for every version it
+  publishes. get rebuilds a stored version. gc removes chunks that no recipe
+  refers to any more. The store defaults to ~/chunk_store.
+
+  @author Waldo Jordaan
+*/
+
+#include "chunk-store.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+int main(int argc, char* argv[])
+{
+  fs::path dir = fs::path(getenv("HOME")) / "chunk_store";
+  int i = 1;
+  if (argc > 2 && std::string(argv[1]) == "--store") {
+    dir = argv[2];
+    i = 3;
+  }
+
+  std::string cmd = i < argc ? argv[i] : "";
+  if (!((cmd == "add" && argc - i == 4) || (cmd == "get" && argc - i == 4) || (cmd == "gc" && argc - i == 1))) {
+    std::cerr << "Usage: " << argv[0] << " [--store <dir>] add <file> <name> <timestamp>\n"
+              << "       " << argv[0] << " [--store <dir>] get <name> <timestamp> <out-file>\n"
+              << "       " << argv[0] << " [--store <dir>] gc\n";
+    return 1;
+  }
+
+  try {
+    ChunkStore store(dir);
+
+    if (cmd == "add") {
+      auto recipe = store.addFile(argv[i + 1]);
+      if (!recipe) {
+        std::cerr << "[Error] cannot read " << argv[i + 1] << std::endl;
+        return 1;
+      }
+      if (!store.saveRecipe(ndn::Name(argv[i + 2]), std::stoull(argv[i + 3]), *recipe)) {
+        std::cerr << "[Error] cannot save recipe in " << dir << std::endl;
+        return 1;
+      }
+      const auto& stats = store.getStats();
+      std::cout << "chunks=" << recipe->chunks.size() << " new=" << stats.added
+                << " reused=" << stats.reused << " bytes=" << recipe->fileSize << std::endl;
+    }
+    else if (cmd == "get") {
+      auto wire = store.loadRecipe(ndn::Name(argv[i + 1]), std::stoull(argv[i + 2]));
+      auto recipe = wire ? ChunkStore::Recipe::decode(*wire) : std::nullopt;
+      if (!recipe || !store.assemble(*recipe, argv[i + 3])) {
+        std::cerr << "[Error] cannot rebuild " << argv[i + 1] << "/t=" << argv[i + 2] << std::endl;
+        return 1;
+      }
+    }
+    else {
+      std::cout << "removed=" << store.gc() << std::endl;
+    }
+    return 0;
+  }
+  catch (const std::exception& e) {
+    std::cerr << "[Error] " << e.what() << std::endl;
+    return 1;
+  }
+}
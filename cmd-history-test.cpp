@@ -0,0 +1,231 @@
+/*
+  Checks that psync-start's command history never admits a /cmd version twice.
+
+  Usage: ./cmd-history-test [--cmd-filter-kib <n>] [--cmd-prefixes <n>] [--cmd-window <seconds>]
+                            [--prefixes <n>] [--rounds <n>] [--restart-every <n>] [--seed <n>]
+                            [--dir <dir>]
+
+  Publishes <rounds> rounds of versions of <prefixes> commands, command p in
+  every (p + 1)th round, and delivers each version one to four times,
+  shuffled within a short span, with some copies replayed much later, as
+  PSync does after a partition heals. The history is as small as the flags
+  make it (defaults: 1 KiB filter, 8 prefixes), so prefixes are evicted and
+  filter generations dropped. Every <restart-every> deliveries psync-start
+  is restarted from its journal, alternately replaying it and compacting it
+  first. Exits non-zero if a version is admitted twice, if an admitted
+  version is later reported as not executed, if dropping a filter generation
+  of one command keeps the first version of another from running, or if
+  neither eviction nor rotation took place.
+
+  @author Waldo Jordaan
+*/
+
+#include "state-journal.hpp"
+#include "cmd-history.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+using Version = std::pair<std::string, uint64_t>;
+
+// What psync-start does at start-up: replay the journal into an empty history
+CmdHistory restore(StateJournal& journal, const CmdHistory::Options& options)
+{
+  CmdHistory cmds(options);
+  journal.replay([&] (const StateJournal::Record& record) {
+    if (record.type == StateJournal::Type::Cmd)
+      cmds.markExecuted(record.key, record.value);
+    else if (record.type == StateJournal::Type::CmdUpTo)
+      cmds.markExecutedUpTo(record.key, record.value);
+  });
+  return cmds;
+}
+
+// Whether a command never seen runs at a timestamp below versions of another command that
+// rotated out of the filter: dropping a generation must only cover the commands in it
+bool runsUnseenAfterRotation(const CmdHistory::Options& options)
+{
+  CmdHistory cmds(options);
+  const uint64_t start = 1700000000;
+  uint64_t ts = start;
+  while (cmds.getStats().rotations < 2) {
+    cmds.markExecuted("/cmd/busy/update.sh", ++ts);
+  }
+  return cmds.markExecuted("/cmd/unseen/update.sh", start + 1);
+}
+
+// What psync-start does when the journal grows too large
+void compact(StateJournal& journal, const CmdHistory& cmds)
+{
+  std::vector<StateJournal::Record> live;
+  for (const auto& [prefix, high] : cmds.getHighWaterMarks()) {
+    live.push_back({StateJournal::Type::CmdUpTo, high, prefix});
+  }
+  journal.compact(live);
+}
+
+int main(int argc, char* argv[])
+{
+  CmdHistory::Options options;
+  options.window = 3600;
+  options.filterBytes = 1024;
+  options.maxPrefixes = 8;
+  size_t nPrefixes = 32;
+  size_t nRounds = 5000;
+  size_t restartEvery = 5000;
+  unsigned seed = 1;
+  fs::path dir = fs::temp_directory_path();
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--cmd-filter-kib" && i + 1 < argc) {
+      options.filterBytes = std::stoul(argv[++i]) * 1024;
+    }
+    else if (arg == "--cmd-prefixes" && i + 1 < argc) {
+      options.maxPrefixes = std::stoul(argv[++i]);
+    }
+    else if (arg == "--cmd-window" && i + 1 < argc) {
+      options.window = std::stoull(argv[++i]);
+    }
+    else if (arg == "--prefixes" && i + 1 < argc) {
+      nPrefixes = std::max<size_t>(1, std::stoul(argv[++i]));
+    }
+    else if (arg == "--rounds" && i + 1 < argc) {
+      nRounds = std::max<size_t>(1, std::stoul(argv[++i]));
+    }
+    else if (arg == "--restart-every" && i + 1 < argc) {
+      restartEvery = std::stoul(argv[++i]);
+    }
+    else if (arg == "--seed" && i + 1 < argc) {
+      seed = std::stoul(argv[++i]);
+    }
+    else if (arg == "--dir" && i + 1 < argc) {
+      dir = argv[++i];
+    }
+    else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 2;
+    }
+  }
+
+  std::mt19937 rng(seed);
+
+  // Versions in publication order, one round every ~10 s: command p is updated every (p + 1)th round,
+  // so a few commands are busy and the rest, which get evicted, are updated now and then
+  std::vector<Version> deliveries;
+  size_t nVersions = 0;
+  for (size_t v = 0; v < nRounds; ++v) {
+    for (size_t p = 0; p < nPrefixes; ++p) {
+      if (v % (p + 1) != 0)
+        continue;
+      std::string prefix = "/cmd/vehicle" + std::to_string(p) + "/update.sh";
+      uint64_t ts = 1700000000 + v * 10 + p % 7;
+      size_t copies = 1 + rng() % 4;
+      ++nVersions;
+      for (size_t c = 0; c < copies; ++c) {
+        deliveries.emplace_back(prefix, ts);
+      }
+    }
+  }
+
+  // Reorder within a short span, then replay ~2% of deliveries much later
+  const size_t span = 64;
+  for (size_t i = 0; i + 1 < deliveries.size(); ++i) {
+    size_t j = i + rng() % std::min(span, deliveries.size() - i);
+    std::swap(deliveries[i], deliveries[j]);
+  }
+  std::vector<std::pair<size_t, Version>> late; // delivered again before deliveries[first]
+  for (size_t i = 0; i < deliveries.size(); ++i) {
+    if (rng() % 50 == 0)
+      late.emplace_back(i + 1 + rng() % (deliveries.size() - i), deliveries[i]);
+  }
+  std::sort(late.begin(), late.end());
+  std::vector<Version> replayed;
+  replayed.reserve(deliveries.size() + late.size());
+  auto next = late.begin();
+  for (size_t i = 0; i <= deliveries.size(); ++i) {
+    for (; next != late.end() && next->first == i; ++next) {
+      replayed.push_back(next->second);
+    }
+    if (i < deliveries.size())
+      replayed.push_back(deliveries[i]);
+  }
+  deliveries.swap(replayed);
+
+  fs::path path = dir / ("cmd-history-test." + std::to_string(getpid()));
+  fs::remove(path);
+
+  size_t twice = 0;
+  size_t forgotten = 0;
+  size_t restarts = 0;
+  CmdHistory::Stats total;
+  std::set<Version> admitted;
+
+  {
+    StateJournal journal(path);
+    CmdHistory cmds(options);
+
+    auto addStats = [&] (const CmdHistory& history) {
+      total.executed += history.getStats().executed;
+      total.repeated += history.getStats().repeated;
+      total.evicted += history.getStats().evicted;
+      total.rotations += history.getStats().rotations;
+    };
+
+    for (size_t i = 0; i < deliveries.size(); ++i) {
+      const auto& [prefix, ts] = deliveries[i];
+
+      if (cmds.markExecuted(prefix, ts)) {
+        journal.append({StateJournal::Type::Cmd, ts, prefix});
+        if (!admitted.insert(deliveries[i]).second && ++twice <= 10)
+          std::cerr << "Admitted twice: " << prefix << " t=" << ts << " (delivery " << i << ")" << std::endl;
+      }
+
+      if (restartEvery > 0 && (i + 1) % restartEvery == 0) {
+        addStats(cmds);
+        if (++restarts % 2 == 0)
+          compact(journal, cmds);
+        cmds = restore(journal, options);
+      }
+    }
+
+    for (const auto& [prefix, ts] : admitted) {
+      if (!cmds.isExecuted(prefix, ts)) {
+        if (++forgotten <= 10)
+          std::cerr << "Forgotten: " << prefix << " t=" << ts << std::endl;
+      }
+    }
+    addStats(cmds);
+  }
+  fs::remove(path);
+
+  std::cout << "deliveries=" << deliveries.size() << " versions=" << nVersions
+            << " admitted=" << admitted.size() << " repeated=" << total.repeated
+            << " evicted=" << total.evicted << " rotations=" << total.rotations
+            << " restarts=" << restarts << std::endl;
+
+  if (!runsUnseenAfterRotation(options)) {
+    std::cerr << "FAILED: a command never seen was refused after a filter rotation" << std::endl;
+    return 1;
+  }
+  if (total.evicted == 0 || total.rotations == 0) {
+    std::cerr << "No eviction or rotation took place; lower --cmd-prefixes or --cmd-filter-kib" << std::endl;
+    return 1;
+  }
+  if (twice > 0 || forgotten > 0) {
+    std::cerr << "FAILED: " << twice << " versions admitted twice, " << forgotten << " forgotten" << std::endl;
+    return 1;
+  }
+  std::cout << "OK" << std::endl;
+  return 0;
+}
@@ -0,0 +1,175 @@
+/*
+  Bounded record of the /cmd versions psync-start has executed.
+
+  @author Waldo Jordaan
+*/
+
+#include "cmd-history.hpp"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+const size_t N_HASHES = 7;     // optimal for ~10 bits per entry
+const size_t BITS_PER_ENTRY = 10;
+
+uint64_t
+mix(uint64_t x)
+{
+  // splitmix64 finalizer
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+} // namespace
+
+CmdHistory::CmdHistory(const Options& options)
+  : m_options(options)
+{
+  size_t words = std::max<size_t>(1, m_options.filterBytes / 2 / sizeof(uint64_t));
+  m_nBits = words * 64;
+  m_capacity = std::max<size_t>(1, m_nBits / BITS_PER_ENTRY);
+  m_current.bits.assign(words, 0);
+  m_previous.bits.assign(words, 0);
+  m_options.maxPrefixes = std::max<size_t>(1, m_options.maxPrefixes);
+}
+
+bool
+CmdHistory::isExecuted(const std::string& prefix, uint64_t timestamp) const
+{
+  if (timestamp <= m_floor)
+    return true;
+
+  auto it = m_prefixes.find(prefix);
+  if (it == m_prefixes.end())
+    return false;
+
+  const Entry& entry = it->second;
+  if (timestamp > entry.high)
+    return false;
+  if (timestamp == entry.high || timestamp <= entry.floor || timestamp + m_options.window < entry.high)
+    return true;
+  return inFilter(hash(prefix, timestamp));
+}
+
+bool
+CmdHistory::markExecuted(const std::string& prefix, uint64_t timestamp)
+{
+  if (isExecuted(prefix, timestamp)) {
+    ++m_stats.repeated;
+    return false;
+  }
+
+  Entry& entry = getEntry(prefix);
+  entry.high = std::max(entry.high, timestamp);
+  addToFilter(hash(prefix, timestamp), timestamp);
+  ++m_stats.executed;
+  return true;
+}
+
+void
+CmdHistory::markExecutedUpTo(const std::string& prefix, uint64_t timestamp)
+{
+  if (prefix.empty()) {
+    m_floor = std::max(m_floor, timestamp);
+    return;
+  }
+
+  Entry& entry = getEntry(prefix);
+  entry.high = std::max(entry.high, timestamp);
+  entry.floor = std::max(entry.floor, timestamp);
+}
+
+std::vector<std::pair<std::string, uint64_t>>
+CmdHistory::getHighWaterMarks() const
+{
+  std::vector<std::pair<std::string, uint64_t>> marks;
+  marks.reserve(m_prefixes.size() + 1);
+  // Covers evicted prefixes and dropped generations, which have no entry of their own
+  if (m_floor != 0) {
+    marks.emplace_back("", m_floor);
+  }
+  for (const auto& [prefix, entry] : m_prefixes) {
+    marks.emplace_back(prefix, entry.high);
+  }
+  return marks;
+}
+
+size_t
+CmdHistory::getMemoryUsage() const
+{
+  size_t bytes = (m_current.bits.size() + m_previous.bits.size()) * sizeof(uint64_t);
+  for (const auto& [prefix, entry] : m_prefixes) {
+    // key, entry and roughly a node plus a bucket of the hash table
+    bytes += prefix.capacity() + sizeof(prefix) + sizeof(entry) + 3 * sizeof(void*);
+  }
+  return bytes;
+}
+
+uint64_t
+CmdHistory::hash(const std::string& prefix, uint64_t timestamp)
+{
+  return mix(std::hash<std::string>{}(prefix) ^ mix(timestamp));
+}
+
+bool
+CmdHistory::inFilter(uint64_t h) const
+{
+  // Double hashing: bit i is h1 + i * h2
+  uint64_t h2 = mix(h) | 1;
+  bool inCurrent = true;
+  bool inPrevious = true;
+  for (size_t i = 0; i < N_HASHES; ++i) {
+    size_t bit = (h + i * h2) % m_nBits;
+    uint64_t mask = uint64_t(1) << (bit % 64);
+    inCurrent = inCurrent && (m_current.bits[bit / 64] & mask);
+    inPrevious = inPrevious && (m_previous.bits[bit / 64] & mask);
+  }
+  return inCurrent || inPrevious;
+}
+
+void
+CmdHistory::addToFilter(uint64_t h, uint64_t timestamp)
+{
+  if (m_current.count >= m_capacity) {
+    // Versions in the dropped generation can no longer be told apart; for each command they may
+    // belong to, all of them count as executed. A command not seen yet is not affected.
+    for (auto& [prefix, entry] : m_prefixes) {
+      entry.floor = std::max(entry.floor, std::min(entry.high, m_previous.maxTimestamp));
+    }
+    std::swap(m_previous, m_current);
+    std::fill(m_current.bits.begin(), m_current.bits.end(), 0);
+    m_current.count = 0;
+    m_current.maxTimestamp = 0;
+    ++m_stats.rotations;
+  }
+
+  uint64_t h2 = mix(h) | 1;
+  for (size_t i = 0; i < N_HASHES; ++i) {
+    size_t bit = (h + i * h2) % m_nBits;
+    m_current.bits[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+  ++m_current.count;
+  m_current.maxTimestamp = std::max(m_current.maxTimestamp, timestamp);
+}
+
+CmdHistory::Entry&
+CmdHistory::getEntry(const std::string& prefix)
+{
+  auto it = m_prefixes.find(prefix);
+  if (it != m_prefixes.end())
+    return it->second;
+
+  if (m_prefixes.size() >= m_options.maxPrefixes) {
+    // The least recently run command goes; its versions are covered by the floor from now on
+    auto oldest = std::min_element(m_prefixes.begin(), m_prefixes.end(),
+                                   [] (const auto& a, const auto& b) { return a.second.high < b.second.high; });
+    m_floor = std::max(m_floor, oldest->second.high);
+    m_prefixes.erase(oldest);
+    ++m_stats.evicted;
+  }
+  return m_prefixes[prefix];
+}
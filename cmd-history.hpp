@@ -0,0 +1,112 @@
+/*
+  Bounded record of the /cmd versions psync-start has executed.
+
+  Each command prefix keeps the highest timestamp it has run. A version above
+  it is new; that one exactly has run. Versions below it arrived out of order
+  and are looked up in a Bloom filter of executed (prefix, timestamp) pairs,
+  split in two generations: when the current one is full it replaces the
+  older one, which is dropped. Memory is the filter size plus one entry per
+  prefix, up to a limit; the prefix with the oldest high-water mark is
+  evicted to make room.
+
+  Every uncertainty resolves to "already executed", so a version never runs
+  twice, while an old one may be skipped:
+  - a Bloom filter false positive (about 1% when a generation is full)
+  - a version more than the window below its prefix's high-water mark
+  - a version no newer than its prefix's versions in a dropped generation
+    (the prefix's floor)
+  - a version no newer than an evicted prefix (the floor shared by all)
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CMD_HISTORY_HPP
+#define V2V_CMD_HISTORY_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class CmdHistory
+{
+public:
+  struct Options
+  {
+    uint64_t window = 24 * 3600;   // timestamps (seconds) below the high-water mark still accepted
+    size_t filterBytes = 64 * 1024; // both generations of the Bloom filter
+    size_t maxPrefixes = 4096;
+  };
+
+  struct Stats
+  {
+    uint64_t executed = 0;
+    uint64_t repeated = 0;  // versions refused because they (may) have run
+    uint64_t evicted = 0;   // prefixes evicted at maxPrefixes
+    uint64_t rotations = 0; // filter generations dropped
+  };
+
+  explicit CmdHistory(const Options& options);
+
+  // Whether the version has (or may have) been executed
+  bool isExecuted(const std::string& prefix, uint64_t timestamp) const;
+
+  // Record the version as executed; false (and nothing recorded) if it already was
+  bool markExecuted(const std::string& prefix, uint64_t timestamp);
+
+  // Treat every version of prefix up to timestamp as executed (restoring a compacted journal).
+  // The empty prefix stands for every prefix: it raises the floor.
+  void markExecutedUpTo(const std::string& prefix, uint64_t timestamp);
+
+  // High-water mark of each prefix, for compacting the journal, plus the floor under the
+  // empty prefix; restoring them with markExecutedUpTo() runs none of these versions again
+  std::vector<std::pair<std::string, uint64_t>> getHighWaterMarks() const;
+
+  size_t getPrefixCount() const
+  {
+    return m_prefixes.size();
+  }
+
+  // Approximate bytes in use: the filter plus the prefix entries
+  size_t getMemoryUsage() const;
+
+  const Stats& getStats() const
+  {
+    return m_stats;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t high = 0;  // newest version executed
+    uint64_t floor = 0; // every version up to this one counts as executed
+  };
+
+  struct Generation
+  {
+    std::vector<uint64_t> bits;
+    size_t count = 0;
+    uint64_t maxTimestamp = 0;
+  };
+
+  static uint64_t hash(const std::string& prefix, uint64_t timestamp);
+
+  bool inFilter(uint64_t h) const;
+
+  void addToFilter(uint64_t h, uint64_t timestamp);
+
+  Entry& getEntry(const std::string& prefix);
+
+private:
+  Options m_options;
+  size_t m_nBits;      // per generation
+  size_t m_capacity;   // entries per generation at ~1% false positives
+  Generation m_current;
+  Generation m_previous;
+  uint64_t m_floor = 0; // raised by evictions only
+  std::unordered_map<std::string, Entry> m_prefixes;
+  Stats m_stats;
+};
+
+#endif // V2V_CMD_HISTORY_HPP
@@ -0,0 +1,167 @@
+/*
+  Benchmark: compression ratio against CPU cost of the publish codecs.
+
+  Usage: ./codec-bench [--repeat <n>] [--synthetic <MiB>] [file...]
+
+  Compresses each input with every built-in codec and level the way
+  psync-start publishes an object (codec::encodeObject), then decodes it in
+  8000-byte pieces through StreamDecoder the way the fetch path does. Prints
+  one CSV row per input, codec and level with the ratio and the per-core CPU
+  cost (best of --repeat runs, std::clock). Without files it uses generated
+  CSV-like sensor data. Run it on the target node (e.g. the RPi) to pick the
+  codec rules in ./codecs.
+
+  @author Waldo Jordaan
+*/
+
+#include "codec.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t SEGMENT_SIZE = 8000; // RepoClient::DEFAULT_SEGMENT_SIZE
+
+// Timestamped rows of slowly varying sensor values, roughly like the bmw CSV exports
+std::vector<uint8_t> makeSyntheticCsv(size_t bytes)
+{
+  std::mt19937 rng(42);
+  std::normal_distribution<double> noise(0.0, 0.05);
+  std::string out = "timestamp,vehicle,speed_kmh,lat,lon,rpm,throttle\n";
+  double speed = 50, lat = -33.9249, lon = 18.4241, rpm = 2000;
+  uint64_t ts = 1700000000000;
+
+  char row[160];
+  while (out.size() < bytes) {
+    speed = std::clamp(speed + noise(rng) * 10, 0.0, 180.0);
+    lat += noise(rng) * 1e-4;
+    lon += noise(rng) * 1e-4;
+    rpm = std::clamp(rpm + noise(rng) * 200, 800.0, 6500.0);
+    ts += 100;
+    std::snprintf(row, sizeof(row), "%llu,v%u,%.2f,%.6f,%.6f,%.0f,%.3f\n",
+                  static_cast<unsigned long long>(ts), static_cast<unsigned>(rng() % 8),
+                  speed, lat, lon, rpm, std::abs(noise(rng)) * 4);
+    out += row;
+  }
+  out.resize(bytes);
+  return std::vector<uint8_t>(out.begin(), out.end());
+}
+
+double cpuMs(std::clock_t start)
+{
+  return 1000.0 * static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+}
+
+double mbPerSec(size_t bytes, double ms)
+{
+  return ms > 0 ? (bytes / 1e6) / (ms / 1e3) : 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  int repeat = 3;
+  size_t syntheticMiB = 8;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--repeat" && i + 1 < argc) {
+      repeat = std::max(1, std::stoi(argv[++i]));
+    }
+    else if (arg == "--synthetic" && i + 1 < argc) {
+      syntheticMiB = std::stoul(argv[++i]);
+    }
+    else if (arg.rfind("--", 0) == 0) {
+      std::cerr << "Usage: " << argv[0] << " [--repeat <n>] [--synthetic <MiB>] [file...]\n";
+      return 1;
+    }
+    else {
+      files.push_back(arg);
+    }
+  }
+
+  std::vector<std::pair<std::string, std::vector<uint8_t>>> inputs;
+  if (files.empty()) {
+    inputs.emplace_back("synthetic-csv", makeSyntheticCsv(syntheticMiB << 20));
+  }
+  for (const auto& file : files) {
+    std::ifstream in(file, std::ios::binary);
+    if (!in) {
+      std::cerr << "[Warn] cannot read " << file << std::endl;
+      continue;
+    }
+    inputs.emplace_back(file, std::vector<uint8_t>((std::istreambuf_iterator<char>(in)),
+                                                   std::istreambuf_iterator<char>()));
+  }
+
+  std::vector<CodecSpec> specs{{Codec::None, 0}};
+  for (int level : {1, 3, 9, 19})
+    specs.push_back({Codec::Zstd, level});
+  for (int level : {0, 9})
+    specs.push_back({Codec::Lz4, level});
+
+  std::cout << "input,codec,level,raw_bytes,object_bytes,ratio,segments,compress_cpu_ms,compress_mb_s,"
+               "decompress_cpu_ms,decompress_mb_s" << std::endl;
+
+  for (Codec c : {Codec::Zstd, Codec::Lz4}) {
+    if (!codec::isAvailable(c))
+      std::cerr << "[Info] " << codec::toString(c) << " not built in, skipped" << std::endl;
+  }
+
+  for (const auto& [label, raw] : inputs) {
+    for (const auto& spec : specs) {
+      if (!codec::isAvailable(spec.codec))
+        continue;
+
+      double bestCompress = 1e300;
+      double bestDecompress = 1e300;
+      std::vector<uint8_t> object;
+      Codec used = Codec::None;
+
+      for (int r = 0; r < repeat; ++r) {
+        auto start = std::clock();
+        object = codec::encodeObject(spec, raw, &used);
+        bestCompress = std::min(bestCompress, cpuMs(start));
+
+        uint64_t decoded = 0;
+        StreamDecoder decoder([&decoded] (const uint8_t*, size_t size) {
+          decoded += size;
+          return true;
+        });
+        start = std::clock();
+        for (size_t off = 0; off < object.size(); off += SEGMENT_SIZE) {
+          decoder.feed(object.data() + off, std::min(SEGMENT_SIZE, object.size() - off));
+        }
+        bool ok = decoder.finish();
+        bestDecompress = std::min(bestDecompress, cpuMs(start));
+
+        if (!ok || decoded != raw.size()) {
+          std::cerr << "[Error] " << label << " did not round-trip with " << codec::toString(spec.codec) << std::endl;
+          return 1;
+        }
+      }
+
+      if (used != spec.codec) {
+        std::cerr << "[Info] " << label << ": " << codec::toString(spec.codec) << " level " << spec.level
+                  << " did not shrink the input, published raw" << std::endl;
+      }
+
+      std::cout << label << ',' << codec::toString(spec.codec) << ',' << spec.level << ','
+                << raw.size() << ',' << object.size() << ','
+                << static_cast<double>(raw.size()) / std::max<size_t>(1, object.size()) << ','
+                << (object.size() + SEGMENT_SIZE - 1) / SEGMENT_SIZE << ','
+                << bestCompress << ',' << mbPerSec(raw.size(), bestCompress) << ','
+                << bestDecompress << ',' << mbPerSec(raw.size(), bestDecompress) << std::endl;
+    }
+  }
+}
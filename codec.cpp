@@ -0,0 +1,384 @@
+/*
+  Publish-time compression of repo objects.
+
+  @author Waldo Jordaan
+*/
+
+#include "codec.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+NDN_LOG_INIT(PSync.Codec);
+
+namespace {
+
+void
+appendHeader(std::vector<uint8_t>& out, Codec codec, uint64_t rawSize)
+{
+  out.insert(out.end(), codec::MAGIC, codec::MAGIC + codec::MAGIC_SIZE);
+  out.push_back(static_cast<uint8_t>(codec));
+  for (int i = 7; i >= 0; --i) {
+    out.push_back(static_cast<uint8_t>(rawSize >> (8 * i)));
+  }
+}
+
+bool
+startsWithMagic(const std::vector<uint8_t>& content)
+{
+  return content.size() >= codec::MAGIC_SIZE &&
+         std::memcmp(content.data(), codec::MAGIC, codec::MAGIC_SIZE) == 0;
+}
+
+// Header followed by the compressed frame, or nullopt if the codec is not built in
+std::optional<std::vector<uint8_t>>
+compress(const CodecSpec& spec, const std::vector<uint8_t>& raw)
+{
+  std::vector<uint8_t> out;
+  appendHeader(out, spec.codec, raw.size());
+  [[maybe_unused]] size_t headerSize = out.size();
+
+  switch (spec.codec) {
+#ifdef HAVE_ZSTD
+  case Codec::Zstd: {
+    out.resize(headerSize + ZSTD_compressBound(raw.size()));
+    size_t n = ZSTD_compress(out.data() + headerSize, out.size() - headerSize,
+                             raw.data(), raw.size(), spec.level); // level 0 is zstd's default
+    if (ZSTD_isError(n)) {
+      NDN_LOG_WARN("zstd compression failed: " << ZSTD_getErrorName(n));
+      return std::nullopt;
+    }
+    out.resize(headerSize + n);
+    return out;
+  }
+#endif
+#ifdef HAVE_LZ4
+  case Codec::Lz4: {
+    LZ4F_preferences_t prefs;
+    std::memset(&prefs, 0, sizeof(prefs));
+    prefs.compressionLevel = spec.level;
+    prefs.frameInfo.contentSize = raw.size();
+
+    out.resize(headerSize + LZ4F_compressFrameBound(raw.size(), &prefs));
+    size_t n = LZ4F_compressFrame(out.data() + headerSize, out.size() - headerSize,
+                                  raw.data(), raw.size(), &prefs);
+    if (LZ4F_isError(n)) {
+      NDN_LOG_WARN("LZ4 compression failed: " << LZ4F_getErrorName(n));
+      return std::nullopt;
+    }
+    out.resize(headerSize + n);
+    return out;
+  }
+#endif
+  default:
+    return std::nullopt;
+  }
+}
+
+} // namespace
+
+namespace codec {
+
+const char*
+toString(Codec codec)
+{
+  switch (codec) {
+  case Codec::None: return "none";
+  case Codec::Zstd: return "zstd";
+  case Codec::Lz4:  return "lz4";
+  }
+  return "unknown";
+}
+
+bool
+parse(const std::string& str, Codec& codec)
+{
+  for (Codec c : {Codec::None, Codec::Zstd, Codec::Lz4}) {
+    if (str == toString(c)) {
+      codec = c;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+isAvailable(Codec codec)
+{
+  switch (codec) {
+  case Codec::None:
+    return true;
+  case Codec::Zstd:
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  case Codec::Lz4:
+#ifdef HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+std::vector<uint8_t>
+encodeObject(const CodecSpec& spec, std::vector<uint8_t> raw, Codec* used)
+{
+  if (used)
+    *used = Codec::None;
+
+  if (spec.codec != Codec::None) {
+    if (!isAvailable(spec.codec)) {
+      NDN_LOG_WARN(toString(spec.codec) << " is not built in, publishing raw");
+    }
+    else if (auto out = compress(spec, raw); out && out->size() < raw.size()) {
+      if (used)
+        *used = spec.codec;
+      return std::move(*out);
+    }
+  }
+
+  if (!startsWithMagic(raw))
+    return raw;
+
+  std::vector<uint8_t> out;
+  out.reserve(HEADER_SIZE + raw.size());
+  appendHeader(out, Codec::None, raw.size());
+  out.insert(out.end(), raw.begin(), raw.end());
+  return out;
+}
+
+std::optional<uint64_t>
+declaredSize(const uint8_t* data, size_t size)
+{
+  if (size < HEADER_SIZE || std::memcmp(data, MAGIC, MAGIC_SIZE) != 0)
+    return std::nullopt;
+
+  uint64_t rawSize = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    rawSize = (rawSize << 8) | data[MAGIC_SIZE + 1 + i];
+  }
+  return rawSize;
+}
+
+long
+PrefixCodecs::loadFile(const std::string& path)
+{
+  std::ifstream in(path);
+  if (!in)
+    return -1;
+
+  long n = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream is(line);
+    std::string prefix, spec;
+    if (!(is >> prefix >> spec))
+      continue;
+
+    CodecSpec codecSpec;
+    auto colon = spec.find(':');
+    try {
+      if (!parse(spec.substr(0, colon), codecSpec.codec))
+        throw std::invalid_argument("unknown codec");
+      if (colon != std::string::npos)
+        codecSpec.level = std::stoi(spec.substr(colon + 1));
+    }
+    catch (const std::exception&) {
+      NDN_LOG_WARN("Ignoring codec rule '" << line << "' in " << path);
+      continue;
+    }
+
+    add(ndn::Name(prefix), codecSpec);
+    ++n;
+  }
+  return n;
+}
+
+} // namespace codec
+
+struct StreamDecoder::Impl
+{
+  ~Impl()
+  {
+#ifdef HAVE_ZSTD
+    ZSTD_freeDStream(zstd);
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_freeDecompressionContext(lz4);
+#endif
+  }
+
+#ifdef HAVE_ZSTD
+  ZSTD_DStream* zstd = nullptr;
+#endif
+#ifdef HAVE_LZ4
+  LZ4F_dctx* lz4 = nullptr;
+#endif
+  std::vector<uint8_t> out = std::vector<uint8_t>(64 * 1024);
+  bool frameDone = false;
+};
+
+StreamDecoder::StreamDecoder(Sink sink)
+  : m_sink(std::move(sink))
+{
+}
+
+StreamDecoder::~StreamDecoder() = default;
+
+bool
+StreamDecoder::feed(const uint8_t* data, size_t size)
+{
+  if (m_failed)
+    return false;
+  if (m_started)
+    return decode(data, size);
+
+  m_head.insert(m_head.end(), data, data + size);
+
+  // Not a header: everything is raw content
+  size_t n = std::min(m_head.size(), codec::MAGIC_SIZE);
+  if (std::memcmp(m_head.data(), codec::MAGIC, n) != 0) {
+    m_started = true;
+    return emit(m_head.data(), m_head.size());
+  }
+  if (m_head.size() < codec::HEADER_SIZE)
+    return true;
+
+  m_started = true;
+  m_hasHeader = true;
+  m_codec = static_cast<Codec>(m_head[codec::MAGIC_SIZE]);
+  m_rawSize = *codec::declaredSize(m_head.data(), m_head.size());
+
+  m_impl = std::make_unique<Impl>();
+  switch (m_codec) {
+  case Codec::None:
+    break;
+#ifdef HAVE_ZSTD
+  case Codec::Zstd:
+    m_impl->zstd = ZSTD_createDStream();
+    if (m_impl->zstd == nullptr || ZSTD_isError(ZSTD_initDStream(m_impl->zstd)))
+      m_failed = true;
+    break;
+#endif
+#ifdef HAVE_LZ4
+  case Codec::Lz4:
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&m_impl->lz4, LZ4F_VERSION)))
+      m_failed = true;
+    break;
+#endif
+  default:
+    NDN_LOG_WARN("Object uses codec " << static_cast<int>(m_codec) << ", which this build cannot decode");
+    m_failed = true;
+  }
+  if (m_failed)
+    return false;
+
+  return decode(m_head.data() + codec::HEADER_SIZE, m_head.size() - codec::HEADER_SIZE);
+}
+
+bool
+StreamDecoder::decode(const uint8_t* data, size_t size)
+{
+  switch (m_codec) {
+#ifdef HAVE_ZSTD
+  case Codec::Zstd: {
+    ZSTD_inBuffer in{data, size, 0};
+    while (true) {
+      ZSTD_outBuffer out{m_impl->out.data(), m_impl->out.size(), 0};
+      size_t ret = ZSTD_decompressStream(m_impl->zstd, &out, &in);
+      if (ZSTD_isError(ret)) {
+        NDN_LOG_WARN("Corrupt zstd object: " << ZSTD_getErrorName(ret));
+        m_failed = true;
+        return false;
+      }
+      if (!emit(m_impl->out.data(), out.pos))
+        return false;
+      m_impl->frameDone = ret == 0;
+      // A full output buffer may leave decoded data inside the stream
+      if (in.pos == in.size && out.pos < out.size)
+        return true;
+    }
+  }
+#endif
+#ifdef HAVE_LZ4
+  case Codec::Lz4: {
+    size_t consumed = 0;
+    while (true) {
+      size_t outSize = m_impl->out.size();
+      size_t inSize = size - consumed;
+      size_t ret = LZ4F_decompress(m_impl->lz4, m_impl->out.data(), &outSize,
+                                   data + consumed, &inSize, nullptr);
+      if (LZ4F_isError(ret)) {
+        NDN_LOG_WARN("Corrupt LZ4 object: " << LZ4F_getErrorName(ret));
+        m_failed = true;
+        return false;
+      }
+      consumed += inSize;
+      if (!emit(m_impl->out.data(), outSize))
+        return false;
+      m_impl->frameDone = ret == 0;
+      if (consumed == size && outSize < m_impl->out.size())
+        return true;
+    }
+  }
+#endif
+  default:
+    // Raw content, with or without a codec-none header
+    return emit(data, size);
+  }
+}
+
+bool
+StreamDecoder::emit(const uint8_t* data, size_t size)
+{
+  if (size == 0)
+    return true;
+
+  m_decoded += size;
+  if (m_hasHeader && m_decoded > m_rawSize) {
+    NDN_LOG_WARN("Object decodes to more than its declared " << m_rawSize << " bytes");
+    m_failed = true;
+    return false;
+  }
+  if (!m_sink(data, size)) {
+    m_failed = true;
+    return false;
+  }
+  return true;
+}
+
+bool
+StreamDecoder::finish()
+{
+  if (m_failed)
+    return false;
+
+  // Shorter than a header: raw content
+  if (!m_started) {
+    m_started = true;
+    return emit(m_head.data(), m_head.size());
+  }
+
+  if (!m_hasHeader)
+    return true;
+  if (m_codec != Codec::None && !m_impl->frameDone)
+    return false;
+  return m_decoded == m_rawSize;
+}
@@ -0,0 +1,156 @@
+/*
+  Publish-time compression of repo objects.
+
+  A compressed object carries its codec in a small header at the start of its
+  content (segment 0), so any node can decode it without extra lookups:
+    "V2VC" | u8 codec | u64 rawSize (network byte order) | payload
+  payload is a standard zstd or LZ4 frame. Objects without the header are
+  stored raw; a raw file that happens to start with "V2VC" is published with a
+  codec-none header so it is never mistaken for a compressed one.
+  codec_utils.py writes and reads the same header.
+
+  zstd and LZ4 support is compiled in when the Makefile finds libzstd / liblz4
+  (HAVE_ZSTD, HAVE_LZ4). Without them compressed objects cannot be decoded and
+  the codec falls back to none when publishing.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CODEC_HPP
+#define V2V_CODEC_HPP
+
+#include "name-trie.hpp"
+
+#include <ndn-cxx/name.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+enum class Codec : uint8_t {
+  None = 0,
+  Zstd = 1,
+  Lz4  = 2,
+};
+
+struct CodecSpec
+{
+  Codec codec = Codec::None;
+  int level = 0; // 0 uses the codec's default
+};
+
+namespace codec {
+
+constexpr char MAGIC[] = "V2VC";
+constexpr size_t MAGIC_SIZE = 4;
+constexpr size_t HEADER_SIZE = MAGIC_SIZE + 1 + 8;
+
+const char* toString(Codec codec);
+
+bool parse(const std::string& str, Codec& codec);
+
+// Whether this build can compress and decompress with codec
+bool isAvailable(Codec codec);
+
+/*
+  Object content for raw file content: header plus compressed payload, or the
+  raw content itself for Codec::None. Falls back to none (logged) if the codec
+  is not available or does not make the content smaller.
+*/
+std::vector<uint8_t> encodeObject(const CodecSpec& spec, std::vector<uint8_t> raw, Codec* used = nullptr);
+
+// Raw size recorded in the header at the start of object content, or nullopt if it has no header
+std::optional<uint64_t> declaredSize(const uint8_t* data, size_t size);
+
+/*
+  Per-prefix codec choice, read from a file of "<prefix> <codec>[:<level>]"
+  lines ('#' starts a comment). The longest matching prefix wins; names no
+  rule covers are published raw.
+*/
+class PrefixCodecs
+{
+public:
+  // Returns the number of rules loaded, or -1 if the file cannot be opened
+  long loadFile(const std::string& path);
+
+  void add(const ndn::Name& prefix, const CodecSpec& spec)
+  {
+    m_rules.insert(prefix, spec);
+  }
+
+  CodecSpec lookup(const ndn::Name& name) const
+  {
+    const CodecSpec* spec = m_rules.longestPrefixMatch(name);
+    return spec ? *spec : CodecSpec{};
+  }
+
+private:
+  NameTrie<CodecSpec> m_rules;
+};
+
+} // namespace codec
+
+/*
+  Incremental decoder for object content arriving in order, e.g. from
+  SegmentFetcher::onInOrderData. Detects the header in the first bytes and
+  passes decoded output to the sink as it becomes available, so the file never
+  has to be held in memory. Content without a header is passed through.
+*/
+class StreamDecoder
+{
+public:
+  // Return false from the sink to abort (e.g. a write error)
+  using Sink = std::function<bool(const uint8_t* data, size_t size)>;
+
+  explicit StreamDecoder(Sink sink);
+
+  ~StreamDecoder();
+
+  StreamDecoder(const StreamDecoder&) = delete;
+  StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+  // Returns false on corrupt input, an unsupported codec or a failed sink
+  bool feed(const uint8_t* data, size_t size);
+
+  // End of content. Returns false if the stream was truncated or the size does not match.
+  bool finish();
+
+  Codec getCodec() const
+  {
+    return m_codec;
+  }
+
+  uint64_t getDecodedSize() const
+  {
+    return m_decoded;
+  }
+
+  // Whether the content started with a codec header (including codec none)
+  bool hasHeader() const
+  {
+    return m_hasHeader;
+  }
+
+private:
+  bool decode(const uint8_t* data, size_t size);
+
+  bool emit(const uint8_t* data, size_t size);
+
+private:
+  struct Impl;
+
+  Sink m_sink;
+  std::vector<uint8_t> m_head; // bytes held until the header is recognized or ruled out
+  bool m_started = false;
+  bool m_hasHeader = false;
+  bool m_failed = false;
+  Codec m_codec = Codec::None;
+  uint64_t m_rawSize = 0;
+  uint64_t m_decoded = 0;
+  std::unique_ptr<Impl> m_impl;
+};
+
+#endif // V2V_CODEC_HPP
@@ -0,0 +1,106 @@
+'''
+Object compression shared by putfile.py, getfile.py and update-repo-file.py.
+
+Compressed objects start with the same header codec.hpp reads:
+    "V2VC" | u8 codec | u64 raw size (big endian) | zstd or LZ4 frame
+A raw file that starts with "V2VC" is wrapped in a codec-none header so it is
+never mistaken for a compressed one.
+
+Per-prefix codec rules live in ./codecs, one "<prefix> <codec>[:<level>]" per
+line; the longest matching prefix wins.
+
+@author Waldo Jordaan
+'''
+import struct
+
+try:
+    import zstandard
+except ImportError:
+    zstandard = None
+
+try:
+    import lz4.frame
+except ImportError:
+    lz4 = None
+
+MAGIC = b'V2VC'
+HEADER = struct.Struct('>4sBQ')
+CODECS = {'none': 0, 'zstd': 1, 'lz4': 2}
+CODECS_FILE = './codecs'
+
+
+def parse_codec(spec: str):
+    '''"zstd:9" -> ("zstd", 9); level 0 is the codec default'''
+    codec, _, level = spec.partition(':')
+    if codec not in CODECS:
+        raise ValueError(f'unknown codec {codec}')
+    return codec, int(level) if level else 0
+
+
+def is_available(codec: str) -> bool:
+    return codec == 'none' or (codec == 'zstd' and zstandard is not None) or (codec == 'lz4' and lz4 is not None)
+
+
+def encode_object(raw: bytes, codec: str = 'none', level: int = 0):
+    '''Object content for raw file content, and the codec actually used'''
+    if codec != 'none' and not is_available(codec):
+        print(f'[Codec] {codec} module not installed, publishing raw')
+    elif codec == 'zstd':
+        payload = zstandard.ZstdCompressor(level=level or 3).compress(raw)
+    elif codec == 'lz4':
+        payload = lz4.frame.compress(raw, compression_level=level)
+
+    if codec != 'none' and is_available(codec) and HEADER.size + len(payload) < len(raw):
+        return HEADER.pack(MAGIC, CODECS[codec], len(raw)) + payload, codec
+
+    if raw.startswith(MAGIC):
+        return HEADER.pack(MAGIC, CODECS['none'], len(raw)) + raw, 'none'
+    return raw, 'none'
+
+
+def decode_object(content: bytes) -> bytes:
+    '''File content of an object, raises ValueError if it cannot be decoded'''
+    if len(content) < HEADER.size or not content.startswith(MAGIC):
+        return content
+
+    _, codec_id, raw_size = HEADER.unpack_from(content)
+    payload = content[HEADER.size:]
+    if codec_id == CODECS['none']:
+        raw = payload
+    elif codec_id == CODECS['zstd'] and zstandard is not None:
+        raw = zstandard.ZstdDecompressor().decompress(payload, max_output_size=raw_size)
+    elif codec_id == CODECS['lz4'] and lz4 is not None:
+        raw = lz4.frame.decompress(payload)
+    else:
+        raise ValueError(f'cannot decode codec {codec_id}')
+
+    if len(raw) != raw_size:
+        raise ValueError(f'decoded {len(raw)} bytes, expected {raw_size}')
+    return raw
+
+
+def load_codec_rules(path: str = CODECS_FILE) -> dict:
+    rules = {}
+    try:
+        with open(path) as f:
+            for line in f:
+                fields = line.split('#', 1)[0].split()
+                if len(fields) < 2:
+                    continue
+                try:
+                    rules[fields[0].rstrip('/') or '/'] = parse_codec(fields[1])
+                except ValueError:
+                    print(f'[Codec] ignoring rule: {line.strip()}')
+    except FileNotFoundError:
+        pass
+    return rules
+
+
+def lookup_codec(rules: dict, name: str):
+    '''(codec, level) of the longest rule prefix of name, by whole components'''
+    best, best_len = ('none', 0), -1
+    for prefix, spec in rules.items():
+        matches = prefix == '/' or name == prefix or name.startswith(prefix + '/')
+        if matches and len(prefix) > best_len:
+            best, best_len = spec, len(prefix)
+    return best
@@ -0,0 +1,142 @@
+/*
+  Erase Content Store entries through the NFD management API.
+
+  Usage: ./cs-erase <prefix>...
+         ./cs-erase --stdin
+
+  With prefixes on the command line, erases them (batched by CsEraser) and
+  exits non-zero if any erase failed. With --stdin it stays running and reads
+  one prefix per line, answering each with "OK <prefix> <erased>" or
+  "ERR <prefix>" (also when the line is not a valid name), so
+  update-repo-file.py can keep one helper open instead of running nfdc for
+  every update.
+
+  @author Waldo Jordaan
+*/
+
+#include "cs-eraser.hpp"
+
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+
+#include <iostream>
+#include <unistd.h>
+
+class StdinEraser
+{
+public:
+  StdinEraser(boost::asio::io_context& io, CsEraser& eraser)
+    : m_io(io)
+    , m_input(io, ::dup(STDIN_FILENO))
+    , m_eraser(eraser)
+  {
+    read();
+  }
+
+private:
+  void read()
+  {
+    boost::asio::async_read_until(m_input, m_buffer, '\n',
+      [this] (const boost::system::error_code& ec, size_t) {
+        if (ec) {
+          m_done = true; // stdin closed: finish outstanding erases, then exit
+          stopIfIdle();
+          return;
+        }
+
+        std::istream is(&m_buffer);
+        std::string line;
+        std::getline(is, line);
+        line.erase(0, line.find_first_not_of(" \t\r"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        ndn::Name prefix;
+        try {
+          prefix = ndn::Name(line);
+        }
+        catch (const ndn::Name::Error&) {
+          // Not an NDN name; a throw here would leave the asio handler and end the helper
+          std::cout << "ERR " << line << std::endl;
+          line.clear();
+        }
+
+        if (!line.empty()) {
+          ++m_outstanding;
+          m_eraser.erase(prefix, [this, line] (bool ok, uint64_t nErased) {
+            if (ok)
+              std::cout << "OK " << line << " " << nErased << std::endl;
+            else
+              std::cout << "ERR " << line << std::endl;
+            --m_outstanding;
+            stopIfIdle();
+          });
+        }
+        read();
+      });
+  }
+
+  void stopIfIdle()
+  {
+    if (m_done && m_outstanding == 0)
+      m_io.stop();
+  }
+
+private:
+  boost::asio::io_context& m_io;
+  boost::asio::posix::stream_descriptor m_input;
+  boost::asio::streambuf m_buffer;
+  CsEraser& m_eraser;
+  size_t m_outstanding = 0;
+  bool m_done = false;
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <prefix>...\n"
+              << "       " << argv[0] << " --stdin\n";
+    return 1;
+  }
+
+  try {
+    ndn::Face face;
+    ndn::KeyChain keyChain;
+    CsEraser eraser(face, keyChain);
+
+    if (std::string(argv[1]) == "--stdin") {
+      StdinEraser input(face.getIoContext(), eraser);
+      face.processEvents(ndn::time::milliseconds::zero(), true);
+      return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; ++i) {
+      std::string prefix = argv[i];
+      ndn::Name name;
+      try {
+        name = ndn::Name(prefix);
+      }
+      catch (const ndn::Name::Error&) {
+        std::cout << "ERR " << prefix << std::endl;
+        status = 1;
+        continue;
+      }
+      eraser.erase(name, [prefix, &status] (bool ok, uint64_t nErased) {
+        if (ok) {
+          std::cout << "OK " << prefix << " " << nErased << std::endl;
+        }
+        else {
+          std::cout << "ERR " << prefix << std::endl;
+          status = 1;
+        }
+      });
+    }
+    face.processEvents();
+    return status;
+  }
+  catch (const std::exception& e) {
+    std::cerr << "[Error] " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,97 @@
+/*
+  Content Store erase through the NFD management API.
+
+  @author Waldo Jordaan
+*/
+
+#include "cs-eraser.hpp"
+
+#include <ndn-cxx/mgmt/nfd/control-command.hpp>
+#include <ndn-cxx/mgmt/nfd/control-parameters.hpp>
+#include <ndn-cxx/util/logger.hpp>
+
+#include <iterator>
+
+NDN_LOG_INIT(PSync.CsEraser);
+
+CsEraser::CsEraser(ndn::Face& face, ndn::KeyChain& keyChain, ndn::time::milliseconds batchDelay)
+  : m_controller(face, keyChain)
+  , m_scheduler(face.getIoContext())
+  , m_batchDelay(batchDelay)
+{
+}
+
+void
+CsEraser::erase(const ndn::Name& prefix, Callback cb)
+{
+  ++m_stats.requested;
+  m_pending[prefix].push_back(std::move(cb));
+
+  if (!m_flushScheduled) {
+    m_flushScheduled = true;
+    m_flushEvent = m_scheduler.schedule(m_batchDelay, [this] { flush(); });
+  }
+}
+
+void
+CsEraser::flush()
+{
+  m_flushScheduled = false;
+  auto pending = std::move(m_pending);
+  m_pending.clear();
+
+  // Names under a prefix sort right after it, so one pass finds every covered name
+  const ndn::Name* cover = nullptr;
+  std::vector<Callback> cbs;
+  for (auto& [prefix, prefixCbs] : pending) {
+    if (cover != nullptr && cover->isPrefixOf(prefix)) {
+      m_stats.coalesced += prefixCbs.size();
+    }
+    else {
+      if (cover != nullptr) {
+        sendErase(*cover, 0, std::move(cbs));
+        cbs.clear();
+      }
+      cover = &prefix;
+      m_stats.coalesced += prefixCbs.size() - 1;
+    }
+    std::move(prefixCbs.begin(), prefixCbs.end(), std::back_inserter(cbs));
+  }
+  if (cover != nullptr) {
+    sendErase(*cover, 0, std::move(cbs));
+  }
+}
+
+void
+CsEraser::sendErase(const ndn::Name& prefix, uint64_t erasedSoFar, std::vector<Callback> cbs)
+{
+  ++m_stats.commands;
+  auto shared = std::make_shared<std::vector<Callback>>(std::move(cbs));
+
+  m_controller.start<ndn::nfd::CsEraseCommand>(
+    ndn::nfd::ControlParameters().setName(prefix),
+    [=] (const ndn::nfd::ControlParameters& resp) {
+      uint64_t erased = erasedSoFar + resp.getCount();
+      m_stats.erased += resp.getCount();
+
+      // Capacity is only set when NFD hit its per-command limit and more entries remain
+      if (resp.hasCapacity()) {
+        sendErase(prefix, erased, std::move(*shared));
+        return;
+      }
+
+      NDN_LOG_DEBUG("CS erase " << prefix << ": " << erased << " entries");
+      for (const auto& cb : *shared) {
+        if (cb)
+          cb(true, erased);
+      }
+    },
+    [=] (const ndn::nfd::ControlResponse& resp) {
+      ++m_stats.failed;
+      NDN_LOG_WARN("CS erase " << prefix << " failed: " << resp.getCode() << " " << resp.getText());
+      for (const auto& cb : *shared) {
+        if (cb)
+          cb(false, erasedSoFar);
+      }
+    });
+}
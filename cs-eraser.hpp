@@ -0,0 +1,67 @@
+/*
+  Content Store erase through the NFD management API.
+
+  Replaces `nfdc cs erase <prefix>` (one fork+exec per update) with
+  cs/erase commands sent by ndn::nfd::Controller on an existing Face. Requests
+  made within a short window are batched: duplicates and prefixes covered by
+  another pending prefix share one command. NFD erases at most a fixed number
+  of entries per command and says so by setting Capacity in the response, in
+  which case the command is repeated until the prefix is clean.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_CS_ERASER_HPP
+#define V2V_CS_ERASER_HPP
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/mgmt/nfd/controller.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+class CsEraser
+{
+public:
+  // Called on the Face's io thread once NFD confirmed the erase (or the command failed)
+  using Callback = std::function<void(bool success, uint64_t nErased)>;
+
+  struct Stats
+  {
+    uint64_t requested = 0; // erase() calls
+    uint64_t commands = 0;  // cs/erase commands sent
+    uint64_t coalesced = 0; // requests answered by another request's command
+    uint64_t erased = 0;    // CS entries removed
+    uint64_t failed = 0;    // commands that failed or timed out
+  };
+
+  CsEraser(ndn::Face& face, ndn::KeyChain& keyChain,
+           ndn::time::milliseconds batchDelay = ndn::time::milliseconds(10));
+
+  void erase(const ndn::Name& prefix, Callback cb);
+
+  const Stats& getStats() const
+  {
+    return m_stats;
+  }
+
+private:
+  // Send one command per pending prefix that no other pending prefix covers
+  void flush();
+
+  void sendErase(const ndn::Name& prefix, uint64_t erasedSoFar, std::vector<Callback> cbs);
+
+private:
+  ndn::nfd::Controller m_controller;
+  ndn::Scheduler m_scheduler;
+  ndn::time::milliseconds m_batchDelay;
+  ndn::scheduler::ScopedEventId m_flushEvent;
+  bool m_flushScheduled = false;
+  std::map<ndn::Name, std::vector<Callback>> m_pending; // canonical order: a prefix sorts before names under it
+  Stats m_stats;
+};
+
+#endif // V2V_CS_ERASER_HPP
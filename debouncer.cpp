@@ -0,0 +1,74 @@
+/*
+  Debounce of per-key events on a single timer wheel.
+
+  @author Waldo Jordaan
+*/
+
+#include "debouncer.hpp"
+
+#include <algorithm>
+
+Debouncer::Debouncer(boost::asio::io_context& io, std::chrono::milliseconds delay,
+                     std::chrono::milliseconds tick, Callback onQuiet)
+  : m_timer(io)
+  , m_tick(std::max(tick, std::chrono::milliseconds(1)))
+  , m_delayTicks(std::max<uint64_t>(1, (delay.count() + m_tick.count() - 1) / m_tick.count()))
+  , m_onQuiet(std::move(onQuiet))
+  , m_slots(m_delayTicks + 1) // the current slot is never a new deadline's slot
+{
+}
+
+void
+Debouncer::touch(const std::string& key)
+{
+  uint64_t deadline = m_now + m_delayTicks;
+  auto [it, isNew] = m_deadlines.try_emplace(key, deadline);
+  if (!isNew) {
+    if (it->second == deadline)
+      return; // already in that slot
+    it->second = deadline;
+  }
+  m_slots[deadline % m_slots.size()].push_back(key);
+
+  if (!m_ticking) {
+    m_ticking = true;
+    m_timer.expires_after(m_tick);
+    m_timer.async_wait([this] (const boost::system::error_code& ec) {
+      if (!ec)
+        onTick();
+    });
+  }
+}
+
+void
+Debouncer::onTick()
+{
+  ++m_now;
+
+  auto due = std::move(m_slots[m_now % m_slots.size()]);
+  m_slots[m_now % m_slots.size()].clear();
+
+  for (const auto& key : due) {
+    auto it = m_deadlines.find(key);
+    if (it == m_deadlines.end() || it->second != m_now)
+      continue; // touched again or cancelled since
+    m_deadlines.erase(it);
+    m_onQuiet(key);
+  }
+
+  if (m_deadlines.empty()) {
+    // Idle: slots may still hold stale entries, which can never match a later deadline
+    for (auto& slot : m_slots) {
+      slot.clear();
+    }
+    m_ticking = false;
+    return;
+  }
+
+  // Fixed steps from the previous expiry, so ticks do not drift with callback time
+  m_timer.expires_at(m_timer.expiry() + m_tick);
+  m_timer.async_wait([this] (const boost::system::error_code& ec) {
+    if (!ec)
+      onTick();
+  });
+}
@@ -0,0 +1,66 @@
+/*
+  Debounce of per-key events on a single timer wheel.
+
+  Each touch() (re)starts a key's quiet period; the callback runs once for the
+  key after delay has passed without another touch. All keys share one timer
+  that ticks only while something is pending, instead of one timer per key:
+  a touch is O(1) and costs no timer re-arm, however many files are changing.
+  Deadlines are rounded to the tick, so a key fires between delay - tick and
+  delay after its last touch.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_DEBOUNCER_HPP
+#define V2V_DEBOUNCER_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Debouncer
+{
+public:
+  using Callback = std::function<void(const std::string& key)>;
+
+  Debouncer(boost::asio::io_context& io, std::chrono::milliseconds delay,
+            std::chrono::milliseconds tick, Callback onQuiet);
+
+  Debouncer(const Debouncer&) = delete;
+  Debouncer& operator=(const Debouncer&) = delete;
+
+  void touch(const std::string& key);
+
+  void cancel(const std::string& key)
+  {
+    m_deadlines.erase(key);
+  }
+
+  size_t size() const
+  {
+    return m_deadlines.size();
+  }
+
+private:
+  void onTick();
+
+private:
+  boost::asio::steady_timer m_timer;
+  std::chrono::milliseconds m_tick;
+  uint64_t m_delayTicks;
+  Callback m_onQuiet;
+
+  // Slot deadline % size holds the keys due at that tick. A touched key is added again to its
+  // new slot; the stale entry is skipped because its deadline no longer matches.
+  std::vector<std::vector<std::string>> m_slots;
+  std::unordered_map<std::string, uint64_t> m_deadlines;
+  uint64_t m_now = 0;
+  bool m_ticking = false;
+};
+
+#endif // V2V_DEBOUNCER_HPP
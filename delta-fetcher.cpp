@@ -0,0 +1,207 @@
+/*
+  Segment-level delta fetch of a new object version.
+
+  @author Waldo Jordaan
+*/
+
+#include "delta-fetcher.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/segment-fetcher.hpp>
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+#include <filesystem>
+
+NDN_LOG_INIT(PSync.DeltaFetcher);
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const ndn::time::milliseconds SEGMENT_LIFETIME(2000);
+// Versions published without a manifest should fall back to a full fetch quickly,
+// not after SegmentFetcher's default 60 s of retries
+const ndn::time::milliseconds MANIFEST_LIFETIME(1000);
+const ndn::time::milliseconds MANIFEST_TIMEOUT(2000);
+const int SEGMENT_TRIES = 3;
+
+} // namespace
+
+void
+DeltaFetcher::start(ndn::Face& face, ndn::security::Validator& validator,
+                    const ndn::Name& versionedName, const ndn::Name& manifestName,
+                    const std::string& basePath, const std::string& outPath,
+                    size_t window, Offload offload, Callback cb)
+{
+  std::shared_ptr<DeltaFetcher> self(new DeltaFetcher(face, versionedName, basePath, outPath,
+                                                      window, std::move(offload), std::move(cb)));
+  self->fetchManifest(validator, manifestName);
+}
+
+DeltaFetcher::DeltaFetcher(ndn::Face& face, const ndn::Name& versionedName,
+                           const std::string& basePath, const std::string& outPath,
+                           size_t window, Offload offload, Callback cb)
+  : m_face(face)
+  , m_versionedName(versionedName)
+  , m_basePath(basePath)
+  , m_outPath(outPath)
+  , m_window(std::max<size_t>(1, window))
+  , m_offload(std::move(offload))
+  , m_cb(std::move(cb))
+{
+}
+
+void
+DeltaFetcher::fetchManifest(ndn::security::Validator& validator, const ndn::Name& manifestName)
+{
+  // Manifests are small but can span several segments for large files
+  ndn::SegmentFetcher::Options opts;
+  opts.interestLifetime = MANIFEST_LIFETIME;
+  opts.maxTimeout = MANIFEST_TIMEOUT;
+  auto fetcher = ndn::SegmentFetcher::start(m_face, ndn::Interest(manifestName), validator, opts);
+
+  fetcher->onComplete.connect([self = shared_from_this()] (ndn::ConstBufferPtr wire) {
+    self->onManifest(*wire);
+  });
+
+  fetcher->onError.connect([self = shared_from_this()] (uint32_t code, const std::string& msg) {
+    NDN_LOG_DEBUG("No manifest for " << self->m_versionedName << " (" << code << "): " << msg);
+    self->finish(false, "no-manifest");
+  });
+}
+
+void
+DeltaFetcher::onManifest(ndn::span<const uint8_t> wire)
+{
+  m_result.manifest = Manifest::decode(wire);
+  if (!m_result.manifest) {
+    finish(false, "bad-manifest");
+    return;
+  }
+  m_result.total = m_result.manifest->getSegmentCount();
+
+  // Nothing else touches the fetcher until onBase(): no Interest is outstanding
+  m_offload([self = shared_from_this()] {
+    const Manifest& manifest = *self->m_result.manifest;
+    auto base = Manifest::fromFile(self->m_basePath, manifest.getSegmentSize());
+    std::optional<std::vector<uint64_t>> changed;
+    std::string reason = "no-base";
+    if (base) {
+      // Start from the base and overwrite what changed; segments past the new end are cut off
+      std::error_code ec;
+      fs::copy_file(self->m_basePath, self->m_outPath, fs::copy_options::overwrite_existing, ec);
+      if (!ec)
+        fs::resize_file(self->m_outPath, manifest.getFileSize(), ec);
+      if (!ec)
+        changed = manifest.diff(*base);
+      reason = "write-error";
+    }
+    boost::asio::post(self->m_face.getIoContext(), [self, changed = std::move(changed), reason] () mutable {
+      self->onBase(std::move(changed), reason);
+    });
+  });
+}
+
+void
+DeltaFetcher::onBase(std::optional<std::vector<uint64_t>> changed, const std::string& reason)
+{
+  if (changed)
+    m_out.open(m_outPath, std::ios::binary | std::ios::in | std::ios::out);
+  if (!changed || !m_out) {
+    finish(false, changed ? "write-error" : reason);
+    return;
+  }
+
+  m_changed = std::move(*changed);
+  fill();
+}
+
+void
+DeltaFetcher::fill()
+{
+  if (m_finished)
+    return;
+
+  if (m_next == m_changed.size() && m_inFlight == 0) {
+    m_out.close();
+    finish(!m_out.fail(), m_out.fail() ? "write-error" : "");
+    return;
+  }
+
+  while (m_inFlight < m_window && m_next < m_changed.size()) {
+    ++m_inFlight;
+    expressSegment(m_changed[m_next++], SEGMENT_TRIES);
+  }
+}
+
+void
+DeltaFetcher::expressSegment(uint64_t segment, int triesLeft)
+{
+  ndn::Interest interest(ndn::Name(m_versionedName).appendSegment(segment));
+  interest.setCanBePrefix(false);
+  interest.setInterestLifetime(SEGMENT_LIFETIME);
+
+  m_face.expressInterest(interest,
+    [self = shared_from_this(), segment] (const ndn::Interest&, const ndn::Data& data) {
+      self->onSegment(segment, data);
+    },
+    [self = shared_from_this()] (const ndn::Interest&, const ndn::lp::Nack&) {
+      self->finish(false, "nack");
+    },
+    [self = shared_from_this(), segment, triesLeft] (const ndn::Interest&) {
+      if (self->m_finished)
+        return;
+      if (triesLeft <= 1) {
+        self->finish(false, "timeout");
+        return;
+      }
+      self->expressSegment(segment, triesLeft - 1);
+    });
+}
+
+void
+DeltaFetcher::onSegment(uint64_t segment, const ndn::Data& data)
+{
+  if (m_finished)
+    return;
+
+  // The manifest digest stands in for validating each segment's signature
+  auto content = data.getContent().value_bytes();
+  if (Manifest::computeDigest(content) != m_result.manifest->getDigest(segment)) {
+    finish(false, "digest-mismatch");
+    return;
+  }
+
+  m_out.seekp(static_cast<std::streamoff>(segment * m_result.manifest->getSegmentSize()));
+  m_out.write(reinterpret_cast<const char*>(content.data()), content.size());
+  if (!m_out) {
+    finish(false, "write-error");
+    return;
+  }
+
+  ++m_result.fetched;
+  m_result.bytes += content.size();
+  --m_inFlight;
+  fill();
+}
+
+void
+DeltaFetcher::finish(bool ok, const std::string& reason)
+{
+  if (m_finished)
+    return;
+  m_finished = true;
+
+  if (m_out.is_open())
+    m_out.close();
+  if (!ok) {
+    std::error_code ec;
+    fs::remove(m_outPath, ec);
+  }
+
+  m_result.ok = ok;
+  m_result.reason = reason;
+  m_cb(m_result);
+}
@@ -0,0 +1,98 @@
+/*
+  Segment-level delta fetch of a new object version.
+
+  Fetches the manifest of <name>/t=<ts>, compares it with the digests of the
+  local copy of the previous version (the base) and fetches only the segments
+  whose digest differs. The new version is assembled in a separate output file:
+  the base is copied there, resized to the new length, and each fetched
+  segment is written at its offset after its digest was checked against the
+  manifest. The caller renames the output into place.
+
+  Any problem (no manifest, timeouts, a digest mismatch) ends the fetch with
+  ok == false; the caller then falls back to fetching the whole object.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_DELTA_FETCHER_HPP
+#define V2V_DELTA_FETCHER_HPP
+
+#include "manifest.hpp"
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/validator.hpp>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+class DeltaFetcher : public std::enable_shared_from_this<DeltaFetcher>
+{
+public:
+  struct Result
+  {
+    bool ok = false;
+    uint64_t fetched = 0;             // segments fetched
+    uint64_t bytes = 0;               // content bytes fetched
+    uint64_t total = 0;               // segments in the new version
+    std::string reason;               // why the delta fetch failed
+    std::optional<Manifest> manifest; // manifest of the new version, once fetched
+  };
+
+  // Called on the Face's io thread, exactly once
+  using Callback = std::function<void(const Result&)>;
+
+  // Runs a task on a worker thread; its result is posted back to the io thread
+  using Offload = std::function<void(std::function<void()>)>;
+
+  /*
+    Digesting the local copy and copying it to outPath run through offload,
+    off the io thread.
+  */
+  static void start(ndn::Face& face, ndn::security::Validator& validator,
+                    const ndn::Name& versionedName, const ndn::Name& manifestName,
+                    const std::string& basePath, const std::string& outPath,
+                    size_t window, Offload offload, Callback cb);
+
+private:
+  DeltaFetcher(ndn::Face& face, const ndn::Name& versionedName,
+               const std::string& basePath, const std::string& outPath,
+               size_t window, Offload offload, Callback cb);
+
+  void fetchManifest(ndn::security::Validator& validator, const ndn::Name& manifestName);
+
+  void onManifest(ndn::span<const uint8_t> wire);
+
+  // The base copied to the output; changed lists the segments to fetch, or reason why it failed
+  void onBase(std::optional<std::vector<uint64_t>> changed, const std::string& reason);
+
+  // Keep up to m_window segment Interests outstanding
+  void fill();
+
+  void expressSegment(uint64_t segment, int triesLeft);
+
+  void onSegment(uint64_t segment, const ndn::Data& data);
+
+  void finish(bool ok, const std::string& reason = {});
+
+private:
+  ndn::Face& m_face;
+  ndn::Name m_versionedName;
+  std::string m_basePath;
+  std::string m_outPath;
+  size_t m_window;
+  Offload m_offload;
+  Callback m_cb;
+
+  Result m_result;
+  std::fstream m_out;
+  std::vector<uint64_t> m_changed;
+  size_t m_next = 0;     // index into m_changed of the next segment to request
+  size_t m_inFlight = 0;
+  bool m_finished = false;
+};
+
+#endif // V2V_DELTA_FETCHER_HPP
@@ -0,0 +1,59 @@
+/*
+  Watches a single file with inotify on the Face's io_context.
+
+  @author Waldo Jordaan
+*/
+
+#include "file-watcher.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+FileWatcher::FileWatcher(boost::asio::io_context& io, const fs::path& file, Callback onChanged)
+  : m_inotify(io)
+  , m_fileName(file.filename().string())
+  , m_onChanged(std::move(onChanged))
+{
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("inotify_init1 failed");
+  m_inotify.assign(fd);
+
+  fs::path dir = file.has_parent_path() ? file.parent_path() : fs::path(".");
+  if (inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0)
+    throw std::runtime_error("inotify_add_watch failed for " + dir.string());
+
+  read();
+}
+
+void
+FileWatcher::read()
+{
+  m_inotify.async_read_some(boost::asio::buffer(m_buffer),
+    [this] (const boost::system::error_code& ec, size_t nBytes) {
+      if (ec)
+        return; // closed, or inotify is unusable; stop watching
+      handleEvents(nBytes);
+      read();
+    });
+}
+
+void
+FileWatcher::handleEvents(size_t nBytes)
+{
+  bool changed = false;
+
+  for (size_t offset = 0; offset < nBytes; ) {
+    const auto* event = reinterpret_cast<const inotify_event*>(m_buffer.data() + offset);
+    if (event->len > 0 && m_fileName == event->name)
+      changed = true;
+    offset += sizeof(inotify_event) + event->len;
+  }
+
+  if (changed)
+    m_onChanged();
+}
@@ -0,0 +1,45 @@
+/*
+  Watches a single file with inotify on the Face's io_context.
+
+  The parent directory is watched rather than the file itself, so editors that
+  save by writing a new file and renaming it over the old one are still seen.
+  onChanged runs on the io_context thread after each close-after-write, rename
+  or delete of the file.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_FILE_WATCHER_HPP
+#define V2V_FILE_WATCHER_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <array>
+#include <filesystem>
+#include <functional>
+
+class FileWatcher
+{
+public:
+  using Callback = std::function<void()>;
+
+  // Throws std::runtime_error if inotify cannot be set up
+  FileWatcher(boost::asio::io_context& io, const std::filesystem::path& file, Callback onChanged);
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+private:
+  void read();
+
+  void handleEvents(size_t nBytes);
+
+private:
+  boost::asio::posix::stream_descriptor m_inotify;
+  std::string m_fileName;
+  Callback m_onChanged;
+  alignas(8) std::array<char, 4096> m_buffer;
+};
+
+#endif // V2V_FILE_WATCHER_HPP
@@ -0,0 +1,386 @@
+/*
+  Synthetic fleet load generator and end-to-end latency benchmark.
+
+  Usage: ./fleet-bench <sync-prefix> [--nodes <n>] [--files <n>] [--rate <publishes/s per node>]
+                       [--duration <s>] [--drain <s>] [--size fixed:<b>|uniform:<min>:<max>|lognormal:<median>:<sigma>]
+                       [--prefix <name>] [--tree <dir>] [--perf-logs <dir>] [--csv]
+
+  Starts <n> publisher nodes against the local NFD, each with its own Face and
+  FullProducer on <sync-prefix>, all driven by one io_context. Every publish
+  writes a real file to <tree>/node<i>/f<k>.bin (a WATCH_DIR-style tree), serves
+  it as <prefix>/node<i>/f<k>.bin/t=<ts>/seg=<j> (same layout as the repo) and
+  announces the versioned name the way psync-update does.
+
+  Run psync-start on the same host (with <prefix> in its subsfile) against the
+  same sync prefix. After the run and a drain period, each published version's
+  FETCHED_FILE_INSERTED event is read from psync-start's .plog files and the
+  publish -> inserted latency is reported.
+
+  @author Waldo Jordaan
+*/
+
+#include "perf-log.hpp"
+#include "termcolor.hpp"
+
+#include <PSync/full-producer.hpp>
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/security/signing-helpers.hpp>
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/random.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+
+NDN_LOG_INIT(PSync.FleetBench);
+using namespace ndn::time_literals;
+
+namespace fs = std::filesystem;
+
+const size_t SEGMENT_SIZE = 8000; // putfile.py --segment_size default
+const size_t VERSIONS_SERVED = 4; // per file; older versions are superseded anyway
+
+uint64_t nowNs()
+{
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+// fixed:<bytes> | uniform:<min>:<max> | lognormal:<median>:<sigma>
+class SizeDistribution
+{
+public:
+  explicit SizeDistribution(const std::string& spec)
+  {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+      auto colon = spec.find(':', start);
+      parts.push_back(spec.substr(start, colon - start));
+      if (colon == std::string::npos)
+        break;
+      start = colon + 1;
+    }
+
+    m_kind = parts[0];
+    if (m_kind == "fixed" && parts.size() == 2) {
+      m_a = std::stod(parts[1]);
+    }
+    else if ((m_kind == "uniform" || m_kind == "lognormal") && parts.size() == 3) {
+      m_a = std::stod(parts[1]);
+      m_b = std::stod(parts[2]);
+    }
+    else {
+      throw std::invalid_argument("bad --size " + spec);
+    }
+  }
+
+  size_t operator()(std::mt19937_64& rng) const
+  {
+    double size = m_a;
+    if (m_kind == "uniform")
+      size = std::uniform_real_distribution<double>(m_a, m_b)(rng);
+    else if (m_kind == "lognormal")
+      size = std::lognormal_distribution<double>(std::log(m_a), m_b)(rng);
+    return std::max<size_t>(1, static_cast<size_t>(size));
+  }
+
+private:
+  std::string m_kind;
+  double m_a = 0;
+  double m_b = 0;
+};
+
+struct BenchConfig
+{
+  ndn::Name syncPrefix;
+  ndn::Name prefix{"/bmw/fleet-bench"};
+  size_t nodes = 4;
+  size_t files = 16;
+  double rate = 1;      // publishes per second per node
+  double duration = 60; // seconds of publishing
+  double drain = 30;    // seconds to wait for the last fetches
+  std::string size = "fixed:8000";
+  fs::path tree = "/tmp/fleet-bench";
+  fs::path perfLogs = fs::path(getenv("HOME")) / "perf_logs";
+  bool csv = false;
+};
+
+struct Published
+{
+  uint64_t publishNs;
+  size_t bytes;
+};
+
+/*
+  One publisher node: its own Face (a separate NFD face and sync participant)
+  on the shared io_context, serving the segments of the versions it published.
+*/
+class BenchNode
+{
+public:
+  BenchNode(boost::asio::io_context& io, ndn::KeyChain& keyChain, const BenchConfig& config, size_t id,
+            std::map<std::string, Published>& published)
+    : m_face(io)
+    , m_keyChain(keyChain)
+    , m_scheduler(io)
+    , m_producer(m_face, m_keyChain, config.syncPrefix, [] {
+        psync::FullProducer::Options opts;
+        opts.syncInterestLifetime = 1600_ms;
+        opts.syncDataFreshness = 1600_ms;
+        return opts;
+      }())
+    , m_config(config)
+    , m_nodePrefix(ndn::Name(config.prefix).append(ndn::name::Component::fromEscapedString("node" + std::to_string(id))))
+    , m_dir(config.tree / ("node" + std::to_string(id)))
+    , m_sizes(config.size)
+    , m_rng(id + 1)
+    , m_lastTs(config.files, 0)
+    , m_published(published)
+  {
+    fs::create_directories(m_dir);
+
+    m_face.setInterestFilter(m_nodePrefix,
+      [this] (const auto&, const ndn::Interest& interest) { serve(interest); },
+      [] (const ndn::Name& prefix, const std::string& reason) {
+        std::cerr << "[Error] cannot register " << prefix << ": " << reason << std::endl;
+      });
+  }
+
+  void start(ndn::time::nanoseconds offset, ndn::time::steady_clock::time_point end)
+  {
+    m_end = end;
+    m_scheduler.schedule(offset, [this] { publish(); });
+  }
+
+private:
+  void publish()
+  {
+    if (ndn::time::steady_clock::now() >= m_end)
+      return;
+
+    size_t file = m_next++ % m_config.files;
+    std::string fileName = "f" + std::to_string(file) + ".bin";
+    ndn::Name generic = ndn::Name(m_nodePrefix).append(ndn::name::Component::fromEscapedString(fileName));
+
+    // Timestamps are in seconds; keep them increasing when a file is republished within a second
+    uint64_t ts = std::max<uint64_t>(nowNs() / 1000000000, m_lastTs[file] + 1);
+    m_lastTs[file] = ts;
+
+    std::vector<uint8_t> content(m_sizes(m_rng));
+    std::generate(content.begin(), content.end(), [this] { return static_cast<uint8_t>(m_rng()); });
+    std::ofstream(m_dir / fileName, std::ios::binary | std::ios::trunc)
+      .write(reinterpret_cast<const char*>(content.data()), content.size());
+
+    ndn::Name versioned = ndn::Name(generic).append(
+      ndn::name::Component::fromNumber(ts, ndn::tlv::TimestampNameComponent));
+    segment(versioned, content);
+
+    m_producer.addUserNode(versioned);
+    m_producer.publishName(versioned);
+    m_published[generic.toUri() + "/t=" + std::to_string(ts)] = {nowNs(), content.size()};
+    NDN_LOG_DEBUG("Publish: " << versioned);
+
+    auto interval = std::chrono::duration<double>(1.0 / m_config.rate);
+    m_scheduler.schedule(std::chrono::duration_cast<ndn::time::nanoseconds>(interval), [this] { publish(); });
+  }
+
+  // Same packet layout as the repo: <name>/t=<ts>/seg=<i>, FinalBlockId, digest signature
+  void segment(const ndn::Name& versioned, const std::vector<uint8_t>& content)
+  {
+    std::vector<std::shared_ptr<ndn::Data>> segments;
+    size_t nSegments = std::max<size_t>(1, (content.size() + SEGMENT_SIZE - 1) / SEGMENT_SIZE);
+    auto finalBlock = ndn::name::Component::fromSegment(nSegments - 1);
+
+    for (size_t i = 0; i < nSegments; ++i) {
+      size_t offset = i * SEGMENT_SIZE;
+      size_t len = std::min(SEGMENT_SIZE, content.size() - std::min(offset, content.size()));
+
+      auto data = std::make_shared<ndn::Data>(ndn::Name(versioned).appendSegment(i));
+      data->setContent(ndn::span<const uint8_t>(content.data() + offset, len));
+      data->setFinalBlock(finalBlock);
+      data->setFreshnessPeriod(10_s);
+      m_keyChain.sign(*data, ndn::security::signingWithSha256());
+      segments.push_back(std::move(data));
+    }
+
+    m_versions.emplace_back(versioned, std::move(segments));
+    if (m_versions.size() > VERSIONS_SERVED * m_config.files) {
+      m_versions.pop_front();
+    }
+  }
+
+  void serve(const ndn::Interest& interest)
+  {
+    const ndn::Name& name = interest.getName();
+    for (const auto& [versioned, segments] : m_versions) {
+      if (!versioned.isPrefixOf(name))
+        continue;
+
+      // SegmentFetcher's first Interest has no segment number
+      uint64_t seg = 0;
+      if (name.size() > versioned.size() && name.at(versioned.size()).isSegment())
+        seg = name.at(versioned.size()).toSegment();
+      if (seg < segments.size())
+        m_face.put(*segments[seg]);
+      return;
+    }
+  }
+
+private:
+  ndn::Face m_face;
+  ndn::KeyChain& m_keyChain;
+  ndn::Scheduler m_scheduler;
+  psync::FullProducer m_producer;
+
+  const BenchConfig& m_config;
+  ndn::Name m_nodePrefix;
+  fs::path m_dir;
+  SizeDistribution m_sizes;
+  std::mt19937_64 m_rng;
+  size_t m_next = 0;
+  std::vector<uint64_t> m_lastTs; // per file
+  ndn::time::steady_clock::time_point m_end;
+
+  std::deque<std::pair<ndn::Name, std::vector<std::shared_ptr<ndn::Data>>>> m_versions;
+  std::map<std::string, Published>& m_published;
+};
+
+// FETCHED_FILE_INSERTED time of versionedName in psync-start's perf logs, or 0
+uint64_t findInserted(const fs::path& perfLogs, const std::string& versionedName)
+{
+  fs::path path = perfLogs / (PerfLog::fileStem(versionedName) + ".plog");
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    return 0;
+
+  uint64_t ns = 0;
+  PerfLog::Record record;
+  if (PerfLog::readHeader(f)) {
+    while (PerfLog::readRecord(f, record)) {
+      if (record.event == "FETCHED_FILE_INSERTED" && record.name == versionedName) {
+        ns = record.ns;
+        break;
+      }
+    }
+  }
+  std::fclose(f);
+  return ns;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <sync-prefix> [--nodes <n>] [--files <n>] [--rate <publishes/s per node>]\n"
+              << "       [--duration <s>] [--drain <s>] [--size fixed:<b>|uniform:<min>:<max>|lognormal:<median>:<sigma>]\n"
+              << "       [--prefix <name>] [--tree <dir>] [--perf-logs <dir>] [--csv]\n";
+    return 1;
+  }
+
+  BenchConfig config;
+  config.syncPrefix = argv[1];
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--nodes" && hasValue)          config.nodes = std::stoul(argv[++i]);
+    else if (arg == "--files" && hasValue)     config.files = std::max<size_t>(1, std::stoul(argv[++i]));
+    else if (arg == "--rate" && hasValue)      config.rate = std::stod(argv[++i]);
+    else if (arg == "--duration" && hasValue)  config.duration = std::stod(argv[++i]);
+    else if (arg == "--drain" && hasValue)     config.drain = std::stod(argv[++i]);
+    else if (arg == "--size" && hasValue)      config.size = argv[++i];
+    else if (arg == "--prefix" && hasValue)    config.prefix = ndn::Name(argv[++i]);
+    else if (arg == "--tree" && hasValue)      config.tree = argv[++i];
+    else if (arg == "--perf-logs" && hasValue) config.perfLogs = argv[++i];
+    else if (arg == "--csv")                   config.csv = true;
+    else {
+      std::cerr << "Unknown option: " << arg << "\n";
+      return 1;
+    }
+  }
+  if (config.rate <= 0) {
+    std::cerr << "--rate must be positive\n";
+    return 1;
+  }
+
+  std::map<std::string, Published> published;
+
+  try {
+    boost::asio::io_context io;
+    ndn::KeyChain keyChain;
+    std::vector<std::unique_ptr<BenchNode>> nodes;
+    for (size_t i = 0; i < config.nodes; ++i) {
+      nodes.push_back(std::make_unique<BenchNode>(io, keyChain, config, i, published));
+    }
+
+    std::cout << termcolor::green << "Publishing " << config.rate << "/s from each of " << config.nodes
+              << " nodes under " << config.prefix << " for " << config.duration << " s"
+              << " (make sure psync-start's subsfile allows " << config.prefix << ")" << termcolor::reset << std::endl;
+
+    // Spread the nodes over one publish interval; give prefix registration and sync a second first
+    auto end = ndn::time::steady_clock::now() + ndn::time::milliseconds(static_cast<int64_t>((1 + config.duration) * 1000));
+    std::uniform_real_distribution<double> phase(0, 1.0 / config.rate);
+    std::mt19937_64 rng(0);
+    for (auto& node : nodes) {
+      auto offset = std::chrono::duration<double>(1 + phase(rng));
+      node->start(std::chrono::duration_cast<ndn::time::nanoseconds>(offset), end);
+    }
+
+    // Keep answering Interests while psync-start catches up
+    ndn::Scheduler scheduler(io);
+    scheduler.schedule(ndn::time::milliseconds(static_cast<int64_t>((1 + config.duration + config.drain) * 1000)),
+                       [&io] { io.stop(); });
+    io.run();
+  }
+  catch (const std::exception& e) {
+    NDN_LOG_ERROR(e.what());
+    std::cerr << "[Error] " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::vector<double> latencyMs;
+  size_t bytes = 0;
+  for (const auto& [name, pub] : published) {
+    uint64_t inserted = findInserted(config.perfLogs, name);
+    if (inserted == 0)
+      continue;
+    latencyMs.push_back((static_cast<double>(inserted) - static_cast<double>(pub.publishNs)) / 1e6);
+    bytes += pub.bytes;
+  }
+  std::sort(latencyMs.begin(), latencyMs.end());
+
+  size_t lost = published.size() - latencyMs.size();
+  double throughput = latencyMs.size() / config.duration;
+
+  if (config.csv) {
+    std::cout << "nodes,rate,size,published,inserted,lost,throughput_per_s,bytes_per_s,p50_ms,p95_ms,p99_ms,max_ms\n"
+              << config.nodes << "," << config.rate << "," << config.size << "," << published.size() << ","
+              << latencyMs.size() << "," << lost << "," << throughput << "," << bytes / config.duration << ","
+              << percentile(latencyMs, 50) << "," << percentile(latencyMs, 95) << ","
+              << percentile(latencyMs, 99) << "," << (latencyMs.empty() ? 0 : latencyMs.back()) << "\n";
+  }
+  else {
+    std::cout << termcolor::blue << "--- [FleetBench] ---\n"
+              << "published " << published.size() << ", inserted " << latencyMs.size() << ", not inserted " << lost << "\n"
+              << "throughput " << throughput << " versions/s, " << bytes / config.duration << " B/s\n"
+              << "publish -> FETCHED_FILE_INSERTED ms: p50 " << percentile(latencyMs, 50)
+              << " p95 " << percentile(latencyMs, 95) << " p99 " << percentile(latencyMs, 99)
+              << " max " << (latencyMs.empty() ? 0 : latencyMs.back()) << termcolor::reset << std::endl;
+  }
+  return 0;
+}
@@ -14,6 +14,7 @@ from ndn.encoding import Name, Component
 from ndn_python_repo.clients import GetfileClient
 from pathlib import Path
 import asyncio
+from codec_utils import decode_object
 
 import socket
 
@@ -71,6 +72,12 @@ async def run_getfile_client(app: NDNApp, **kwargs):
     # Step 2: Fetch file
     try:
         await client.fetch_file(kwargs['name_at_repo'], local_filename=str(local_filepath), overwrite=True)
+
+        # Objects published with a codec (putfile.py --codec) are decompressed in place
+        content = local_filepath.read_bytes()
+        raw = decode_object(content)
+        if raw is not content:
+            local_filepath.write_bytes(raw)
     except Exception as e:
         print(f"[Fetch Error] {e}")
     finally:
@@ -0,0 +1,113 @@
+/*
+  Start-up cost of psync-start's state journal against its size.
+
+  Usage: ./journal-bench [--prefixes <n>] [--dir <dir>] [records...]
+
+  For each record count, writes a journal of that many sync-state updates
+  spread over <n> prefixes (versioned names, as full sync publishes them),
+  plus one executed /cmd per 100 updates. It then measures what psync-start
+  does at start-up: opening the journal, which validates every record's CRC,
+  and replaying it into the per-prefix map and the command history. The
+  compaction psync-start would run next is timed too. Prints CSV.
+
+  @author Waldo Jordaan
+*/
+
+#include "state-journal.hpp"
+#include "cmd-history.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+  size_t nPrefixes = 10000;
+  fs::path dir = fs::temp_directory_path();
+  std::vector<size_t> counts;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--prefixes" && i + 1 < argc) {
+      nPrefixes = std::max<size_t>(1, std::stoul(argv[++i]));
+    }
+    else if (arg == "--dir" && i + 1 < argc) {
+      dir = argv[++i];
+    }
+    else {
+      counts.push_back(std::stoul(arg));
+    }
+  }
+  if (counts.empty()) {
+    counts = {1000, 10000, 100000, 1000000};
+  }
+
+  fs::path path = dir / ("journal-bench." + std::to_string(getpid()));
+  std::cout << "records,bytes,prefixes,append_ms,open_ms,replay_ms,compact_ms,compacted_bytes" << std::endl;
+
+  for (size_t n : counts) {
+    fs::remove(path);
+
+    auto start = Clock::now();
+    {
+      StateJournal journal(path);
+      for (size_t i = 0; i < n; ++i) {
+        std::string prefix = "/bmw/vehicle" + std::to_string(i % nPrefixes) + "/camera/frame.bin/t=" +
+                             std::to_string(1700000000 + i / nPrefixes);
+        journal.append({StateJournal::Type::State, 1, prefix});
+        if (i % 100 == 0) {
+          journal.append({StateJournal::Type::Cmd, 1700000000 + i, "/cmd/update.sh"});
+        }
+      }
+    }
+    double appendMs = msSince(start);
+
+    start = Clock::now();
+    StateJournal journal(path);
+    double openMs = msSince(start);
+
+    start = Clock::now();
+    std::map<std::string, uint64_t> state;
+    CmdHistory cmds(CmdHistory::Options{});
+    journal.replay([&] (const StateJournal::Record& record) {
+      if (record.type == StateJournal::Type::State)
+        state[record.key] = record.value;
+      else if (record.type == StateJournal::Type::Cmd)
+        cmds.markExecuted(record.key, record.value);
+    });
+    double replayMs = msSince(start);
+    size_t bytes = journal.getSize();
+
+    start = Clock::now();
+    std::vector<StateJournal::Record> live;
+    live.reserve(state.size() + cmds.getPrefixCount());
+    for (const auto& [prefix, seq] : state) {
+      live.push_back({StateJournal::Type::State, seq, prefix});
+    }
+    for (const auto& [prefix, high] : cmds.getHighWaterMarks()) {
+      live.push_back({StateJournal::Type::CmdUpTo, high, prefix});
+    }
+    journal.compact(live);
+    double compactMs = msSince(start);
+
+    std::cout << n << "," << bytes << "," << state.size() << "," << appendMs << "," << openMs << ","
+              << replayMs << "," << compactMs << "," << journal.getSize() << std::endl;
+  }
+
+  fs::remove(path);
+  return 0;
+}
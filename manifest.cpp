@@ -0,0 +1,167 @@
+/*
+  Per-version segment manifest.
+
+  @author Waldo Jordaan
+*/
+
+#include "manifest.hpp"
+
+#include <ndn-cxx/util/sha256.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+uint64_t
+segmentCount(uint64_t fileSize, uint32_t segmentSize)
+{
+  return std::max<uint64_t>(1, (fileSize + segmentSize - 1) / segmentSize);
+}
+
+void
+appendBigEndian(std::vector<uint8_t>& out, uint64_t value, size_t width)
+{
+  for (size_t i = width; i > 0; --i) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * (i - 1))));
+  }
+}
+
+uint64_t
+readBigEndian(const uint8_t* in, size_t width)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < width; ++i) {
+    value = (value << 8) | in[i];
+  }
+  return value;
+}
+
+} // namespace
+
+Manifest::Digest
+Manifest::computeDigest(ndn::span<const uint8_t> content)
+{
+  auto buf = ndn::Sha256::computeDigest(content);
+  Digest digest;
+  std::copy_n(buf->begin(), digest.size(), digest.begin());
+  return digest;
+}
+
+Manifest
+Manifest::fromContent(ndn::span<const uint8_t> content, uint32_t segmentSize)
+{
+  Manifest m;
+  m.m_segmentSize = segmentSize;
+  m.m_fileSize = content.size();
+
+  uint64_t n = segmentCount(content.size(), segmentSize);
+  m.m_digests.reserve(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    size_t offset = std::min<size_t>(i * segmentSize, content.size());
+    size_t len = std::min<size_t>(segmentSize, content.size() - offset);
+    m.m_digests.push_back(computeDigest(content.subspan(offset, len)));
+  }
+  return m;
+}
+
+Manifest
+Manifest::fromSegments(const std::vector<ndn::span<const uint8_t>>& segments, uint32_t segmentSize)
+{
+  Manifest m;
+  m.m_segmentSize = segmentSize;
+  m.m_digests.reserve(segments.size());
+  for (const auto& segment : segments) {
+    m.m_digests.push_back(computeDigest(segment));
+    m.m_fileSize += segment.size();
+  }
+  return m;
+}
+
+std::optional<Manifest>
+Manifest::fromFile(const std::string& path, uint32_t segmentSize)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return std::nullopt;
+
+  Manifest m;
+  m.m_segmentSize = segmentSize;
+
+  // One segment in memory at a time, so large files are not read in whole
+  std::vector<uint8_t> segment(segmentSize);
+  while (true) {
+    in.read(reinterpret_cast<char*>(segment.data()), segmentSize);
+    size_t len = static_cast<size_t>(in.gcount());
+    if (len == 0 && !m.m_digests.empty())
+      break;
+
+    m.m_digests.push_back(computeDigest(ndn::span<const uint8_t>(segment.data(), len)));
+    m.m_fileSize += len;
+    if (len < segmentSize)
+      break;
+  }
+
+  if (in.bad())
+    return std::nullopt;
+  return m;
+}
+
+std::optional<Manifest>
+Manifest::decode(ndn::span<const uint8_t> wire)
+{
+  if (wire.size() < HEADER_SIZE || std::memcmp(wire.data(), MAGIC, MAGIC_SIZE) != 0)
+    return std::nullopt;
+
+  Manifest m;
+  m.m_segmentSize = static_cast<uint32_t>(readBigEndian(wire.data() + MAGIC_SIZE, 4));
+  m.m_fileSize = readBigEndian(wire.data() + MAGIC_SIZE + 4, 8);
+  if (m.m_segmentSize == 0)
+    return std::nullopt;
+
+  uint64_t n = segmentCount(m.m_fileSize, m.m_segmentSize);
+  if ((wire.size() - HEADER_SIZE) != n * sizeof(Digest))
+    return std::nullopt;
+
+  m.m_digests.resize(n);
+  for (uint64_t i = 0; i < n; ++i) {
+    std::memcpy(m.m_digests[i].data(), wire.data() + HEADER_SIZE + i * sizeof(Digest), sizeof(Digest));
+  }
+  return m;
+}
+
+std::vector<uint8_t>
+Manifest::encode() const
+{
+  std::vector<uint8_t> out;
+  out.reserve(HEADER_SIZE + m_digests.size() * sizeof(Digest));
+  out.insert(out.end(), MAGIC, MAGIC + MAGIC_SIZE);
+  appendBigEndian(out, m_segmentSize, 4);
+  appendBigEndian(out, m_fileSize, 8);
+  for (const auto& digest : m_digests) {
+    out.insert(out.end(), digest.begin(), digest.end());
+  }
+  return out;
+}
+
+ndn::Name
+Manifest::makeName(const ndn::Name& genericPrefix)
+{
+  return ndn::Name().append(ndn::name::Component::fromEscapedString("32=manifest")).append(genericPrefix);
+}
+
+std::vector<uint64_t>
+Manifest::diff(const Manifest& base) const
+{
+  std::vector<uint64_t> changed;
+  bool sameLayout = base.m_segmentSize == m_segmentSize;
+
+  for (uint64_t i = 0; i < m_digests.size(); ++i) {
+    // Equal digests imply equal length, so a short last segment of base only matches an equally short one
+    bool reusable = sameLayout && i < base.m_digests.size() && base.m_digests[i] == m_digests[i];
+    if (!reusable)
+      changed.push_back(i);
+  }
+  return changed;
+}
@@ -0,0 +1,93 @@
+/*
+  Per-version segment manifest.
+
+  Every object version <name>/t=<ts> is accompanied by a manifest object
+  /32=manifest/<name>/t=<ts> listing the SHA-256 digest of each of its
+  segments. A receiver that still holds the previous version compares the
+  digests of its local copy with the new manifest and only fetches the
+  segments that differ (see DeltaFetcher).
+
+  The keyword component keeps manifests out of the file namespace, so a
+  CanBePrefix Interest for an object version never returns a manifest.
+
+  Manifest layout (network byte order), written identically by putfile.py:
+    "V2VM" | u32 segmentSize | u64 fileSize | digest[nSegments]
+  with nSegments = max(1, ceil(fileSize / segmentSize)) and 32-byte digests.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_MANIFEST_HPP
+#define V2V_MANIFEST_HPP
+
+#include <ndn-cxx/encoding/buffer.hpp>
+#include <ndn-cxx/name.hpp>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+class Manifest
+{
+public:
+  static constexpr char MAGIC[] = "V2VM";
+  static constexpr size_t MAGIC_SIZE = 4;
+  static constexpr size_t HEADER_SIZE = MAGIC_SIZE + 4 + 8;
+
+  using Digest = std::array<uint8_t, 32>;
+
+  // Digest every segment of content
+  static Manifest fromContent(ndn::span<const uint8_t> content, uint32_t segmentSize);
+
+  // Digest every segment of the file at path, or nullopt if it cannot be read
+  static std::optional<Manifest> fromFile(const std::string& path, uint32_t segmentSize);
+
+  // Digest the contents of an object's segments, in order; all but the last are segmentSize long
+  static Manifest fromSegments(const std::vector<ndn::span<const uint8_t>>& segments, uint32_t segmentSize);
+
+  // Parse an encoded manifest, or nullopt if it is malformed
+  static std::optional<Manifest> decode(ndn::span<const uint8_t> wire);
+
+  std::vector<uint8_t> encode() const;
+
+  // /32=manifest/<genericPrefix>; the timestamp is appended like for the object itself
+  static ndn::Name makeName(const ndn::Name& genericPrefix);
+
+  /*
+    Segments of this manifest whose content is not the same in base, i.e. the
+    ones a holder of base has to fetch. Segments past the end of base always
+    differ. Returns every segment if the two use a different segment size.
+  */
+  std::vector<uint64_t> diff(const Manifest& base) const;
+
+  uint32_t getSegmentSize() const
+  {
+    return m_segmentSize;
+  }
+
+  uint64_t getFileSize() const
+  {
+    return m_fileSize;
+  }
+
+  uint64_t getSegmentCount() const
+  {
+    return m_digests.size();
+  }
+
+  const Digest& getDigest(uint64_t segment) const
+  {
+    return m_digests.at(segment);
+  }
+
+  static Digest computeDigest(ndn::span<const uint8_t> content);
+
+private:
+  uint32_t m_segmentSize = 0;
+  uint64_t m_fileSize = 0;
+  std::vector<Digest> m_digests;
+};
+
+#endif // V2V_MANIFEST_HPP
@@ -0,0 +1,241 @@
+/*
+  Counters, gauges and latency histograms in the Prometheus text format.
+
+  @author Waldo Jordaan
+*/
+
+#include "metrics.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <istream>
+#include <sstream>
+
+NDN_LOG_INIT(PSync.Metrics);
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+const size_t MAX_REQUEST_SIZE = 8192;
+
+std::string
+seconds(uint64_t us)
+{
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%llu.%06llu", static_cast<unsigned long long>(us / 1000000),
+                static_cast<unsigned long long>(us % 1000000));
+  return buf;
+}
+
+std::string
+number(double value)
+{
+  if (std::isfinite(value) && value == std::floor(value) && std::fabs(value) < 1e15)
+    return std::to_string(static_cast<int64_t>(value));
+  std::ostringstream os;
+  os << value;
+  return os.str();
+}
+
+// name{labels} or name{labels,extra}
+std::string
+series(const std::string& name, const std::string& labels, const std::string& extra = "")
+{
+  if (labels.empty() && extra.empty())
+    return name;
+  std::string sep = labels.empty() || extra.empty() ? "" : ",";
+  return name + "{" + labels + sep + extra + "}";
+}
+
+} // namespace
+
+void
+Metrics::Histogram::record(uint64_t us)
+{
+  size_t i = 0;
+  if (us > (uint64_t(1) << MIN_SHIFT)) {
+    // Bucket bounds are inclusive, so place us - 1 in [2^o, 2^(o+1)) and split that octave in four
+    uint64_t x = us - 1;
+    unsigned octave = 63 - __builtin_clzll(x);
+    if (octave > MAX_SHIFT) {
+      i = N_BUCKETS;
+    }
+    else {
+      i = 1 + (octave - MIN_SHIFT) * SUB_BUCKETS + ((x >> (octave - 2)) & (SUB_BUCKETS - 1));
+    }
+  }
+  m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+  m_sumUs.fetch_add(us, std::memory_order_relaxed);
+}
+
+uint64_t
+Metrics::Histogram::upperBound(size_t i)
+{
+  if (i == 0)
+    return uint64_t(1) << MIN_SHIFT;
+  unsigned octave = MIN_SHIFT + (i - 1) / SUB_BUCKETS;
+  uint64_t sub = (i - 1) % SUB_BUCKETS;
+  return (SUB_BUCKETS + sub + 1) << (octave - 2);
+}
+
+Metrics::Entry&
+Metrics::add(const std::string& name, const std::string& help, Type type, const std::string& labels)
+{
+  auto it = m_index.find(name);
+  if (it == m_index.end()) {
+    it = m_index.emplace(name, m_families.size()).first;
+    m_families.push_back({name, help, type, {}});
+  }
+  auto& entries = m_families[it->second].entries;
+  entries.emplace_back();
+  entries.back().labels = labels;
+  return entries.back();
+}
+
+Metrics::Counter&
+Metrics::counter(const std::string& name, const std::string& help, const std::string& labels)
+{
+  Entry& entry = add(name, help, Type::Counter, labels);
+  entry.counter = std::make_unique<Counter>();
+  return *entry.counter;
+}
+
+Metrics::Gauge&
+Metrics::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+  Entry& entry = add(name, help, Type::Gauge, labels);
+  entry.gauge = std::make_unique<Gauge>();
+  return *entry.gauge;
+}
+
+Metrics::Histogram&
+Metrics::histogram(const std::string& name, const std::string& help, const std::string& labels)
+{
+  Entry& entry = add(name, help, Type::Histogram, labels);
+  entry.histogram = std::make_unique<Histogram>();
+  return *entry.histogram;
+}
+
+void
+Metrics::sampled(const std::string& name, const std::string& help, const std::string& labels,
+                 std::function<double()> sample, bool isCounter)
+{
+  add(name, help, isCounter ? Type::Counter : Type::Gauge, labels).sample = std::move(sample);
+}
+
+std::string
+Metrics::render() const
+{
+  std::ostringstream os;
+  for (const auto& family : m_families) {
+    const char* type = family.type == Type::Counter ? "counter" :
+                       family.type == Type::Gauge ? "gauge" : "histogram";
+    os << "# HELP " << family.name << " " << family.help << "\n"
+       << "# TYPE " << family.name << " " << type << "\n";
+
+    for (const auto& entry : family.entries) {
+      if (entry.sample) {
+        os << series(family.name, entry.labels) << " " << number(entry.sample()) << "\n";
+      }
+      else if (entry.counter) {
+        os << series(family.name, entry.labels) << " " << entry.counter->get() << "\n";
+      }
+      else if (entry.gauge) {
+        os << series(family.name, entry.labels) << " " << entry.gauge->get() << "\n";
+      }
+      else if (entry.histogram) {
+        const Histogram& h = *entry.histogram;
+        // Buckets are read one by one while others record, so +Inf is the sum of what was read
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < Histogram::N_BUCKETS; ++i) {
+          cumulative += h.m_buckets[i].load(std::memory_order_relaxed);
+          os << series(family.name + "_bucket", entry.labels, "le=\"" + seconds(Histogram::upperBound(i)) + "\"")
+             << " " << cumulative << "\n";
+        }
+        cumulative += h.m_buckets[Histogram::N_BUCKETS].load(std::memory_order_relaxed);
+        os << series(family.name + "_bucket", entry.labels, "le=\"+Inf\"") << " " << cumulative << "\n"
+           << series(family.name + "_sum", entry.labels) << " "
+           << seconds(h.m_sumUs.load(std::memory_order_relaxed)) << "\n"
+           << series(family.name + "_count", entry.labels) << " " << cumulative << "\n";
+      }
+    }
+  }
+  return os.str();
+}
+
+struct MetricsServer::Session
+{
+  explicit Session(boost::asio::io_context& io)
+    : socket(io)
+    , buffer(MAX_REQUEST_SIZE)
+  {
+  }
+
+  tcp::socket socket;
+  boost::asio::streambuf buffer;
+  std::string reply;
+};
+
+MetricsServer::MetricsServer(boost::asio::io_context& io, uint16_t port, const Metrics& metrics)
+  : m_io(io)
+  , m_acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port))
+  , m_metrics(metrics)
+{
+  accept();
+}
+
+void
+MetricsServer::accept()
+{
+  auto session = std::make_shared<Session>(m_io);
+  m_acceptor.async_accept(session->socket, [this, session] (const boost::system::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted)
+      return;
+
+    if (!ec) {
+      read(session);
+    }
+    else {
+      NDN_LOG_WARN("Accept failed: " << ec.message());
+    }
+    accept();
+  });
+}
+
+void
+MetricsServer::read(std::shared_ptr<Session> session)
+{
+  boost::asio::async_read_until(session->socket, session->buffer, "\r\n\r\n",
+    [this, session] (const boost::system::error_code& ec, size_t) {
+      if (ec)
+        return; // closed, or the request was too large
+
+      std::istream is(&session->buffer);
+      std::string method, target;
+      is >> method >> target;
+
+      if (method == "GET" && (target == "/metrics" || target == "/")) {
+        std::string body = m_metrics.render();
+        session->reply = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n\r\n" + body;
+      }
+      else {
+        session->reply = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      }
+
+      boost::asio::async_write(session->socket, boost::asio::buffer(session->reply),
+        [session] (const boost::system::error_code&, size_t) {
+          boost::system::error_code ignored;
+          session->socket.shutdown(tcp::socket::shutdown_both, ignored);
+        });
+    });
+}
@@ -0,0 +1,161 @@
+/*
+  Counters, gauges and latency histograms in the Prometheus text format.
+
+  Metrics are registered once at start-up; after that, updating one is a
+  relaxed atomic add and never locks or allocates, so it is safe from any
+  thread. Histograms are log-linear like HDR histograms: four buckets per
+  power of two of microseconds, from 64 us to about 134 s, so the relative
+  error of a quantile stays under 25% across the range. render() reads
+  everything (and calls the callbacks of values sampled at scrape time) into
+  one exposition. MetricsServer serves it over HTTP on a localhost port.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_METRICS_HPP
+#define V2V_METRICS_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Metrics
+{
+public:
+  class Counter
+  {
+  public:
+    void inc(uint64_t n = 1)
+    {
+      m_value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const
+    {
+      return m_value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> m_value{0};
+  };
+
+  class Gauge
+  {
+  public:
+    void add(int64_t n)
+    {
+      m_value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void set(int64_t n)
+    {
+      m_value.store(n, std::memory_order_relaxed);
+    }
+
+    int64_t get() const
+    {
+      return m_value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<int64_t> m_value{0};
+  };
+
+  class Histogram
+  {
+  public:
+    static constexpr unsigned MIN_SHIFT = 6;  // first bucket: up to 64 us
+    static constexpr unsigned MAX_SHIFT = 26; // last bucket: up to 2^27 us
+    static constexpr size_t SUB_BUCKETS = 4;
+    static constexpr size_t N_BUCKETS = 1 + (MAX_SHIFT - MIN_SHIFT + 1) * SUB_BUCKETS;
+
+    void record(uint64_t us);
+
+    template<typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> d)
+    {
+      auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+      record(static_cast<uint64_t>(us > 0 ? us : 0));
+    }
+
+    // Inclusive upper bound of bucket i in microseconds
+    static uint64_t upperBound(size_t i);
+
+  private:
+    friend class Metrics;
+
+    std::array<std::atomic<uint64_t>, N_BUCKETS + 1> m_buckets{}; // the last one is +Inf
+    std::atomic<uint64_t> m_sumUs{0};
+  };
+
+  // labels are Prometheus label pairs without braces, e.g. stage="fetch"
+  Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+
+  Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+  Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "");
+
+  // A gauge (or, with isCounter, a counter) whose value is sampled when rendered
+  void sampled(const std::string& name, const std::string& help, const std::string& labels,
+               std::function<double()> sample, bool isCounter = false);
+
+  // Prometheus text exposition format 0.0.4
+  std::string render() const;
+
+private:
+  enum class Type { Counter, Gauge, Histogram };
+
+  struct Entry
+  {
+    std::string labels;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+    std::function<double()> sample;
+  };
+
+  struct Family
+  {
+    std::string name;
+    std::string help;
+    Type type;
+    std::vector<Entry> entries;
+  };
+
+  Entry& add(const std::string& name, const std::string& help, Type type, const std::string& labels);
+
+private:
+  std::vector<Family> m_families;      // in registration order
+  std::map<std::string, size_t> m_index;
+};
+
+// Minimal HTTP/1.0 server for GET /metrics on 127.0.0.1, on the given io_context
+class MetricsServer
+{
+public:
+  // Throws boost::system::system_error if the port cannot be bound
+  MetricsServer(boost::asio::io_context& io, uint16_t port, const Metrics& metrics);
+
+private:
+  struct Session;
+
+  void accept();
+
+  void read(std::shared_ptr<Session> session);
+
+private:
+  boost::asio::io_context& m_io;
+  boost::asio::ip::tcp::acceptor m_acceptor;
+  const Metrics& m_metrics;
+};
+
+#endif // V2V_METRICS_HPP
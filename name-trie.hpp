@@ -0,0 +1,100 @@
+/*
+  Component-wise name trie.
+
+  Each node holds its children keyed by name component and an optional value.
+  longestPrefixMatch() walks the name one component at a time, so a lookup
+  costs one hash probe per component regardless of how many prefixes are stored.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_NAME_TRIE_HPP
+#define V2V_NAME_TRIE_HPP
+
+#include <ndn-cxx/name.hpp>
+
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+template<typename T>
+class NameTrie
+{
+public:
+  // Store value at prefix, replacing any value already there. Returns false if it replaced one.
+  bool insert(const ndn::Name& prefix, T value)
+  {
+    Node* node = &m_root;
+    for (const auto& comp : prefix) {
+      auto& child = node->children[comp];
+      if (!child)
+        child = std::make_unique<Node>();
+      node = child.get();
+    }
+
+    bool isNew = !node->value.has_value();
+    if (isNew)
+      ++m_size;
+    node->value = std::move(value);
+    return isNew;
+  }
+
+  // Value stored at exactly prefix, or nullptr
+  const T* find(const ndn::Name& prefix) const
+  {
+    const Node* node = &m_root;
+    for (const auto& comp : prefix) {
+      auto it = node->children.find(comp);
+      if (it == node->children.end())
+        return nullptr;
+      node = it->second.get();
+    }
+    return node->value ? &*node->value : nullptr;
+  }
+
+  // Value of the longest stored prefix of name, or nullptr if none is a prefix
+  const T* longestPrefixMatch(const ndn::Name& name) const
+  {
+    const Node* node = &m_root;
+    const T* best = node->value ? &*node->value : nullptr;
+
+    for (const auto& comp : name) {
+      auto it = node->children.find(comp);
+      if (it == node->children.end())
+        break;
+      node = it->second.get();
+      if (node->value)
+        best = &*node->value;
+    }
+    return best;
+  }
+
+  size_t size() const
+  {
+    return m_size;
+  }
+
+  bool empty() const
+  {
+    return m_size == 0;
+  }
+
+  void clear()
+  {
+    m_root.children.clear();
+    m_root.value.reset();
+    m_size = 0;
+  }
+
+private:
+  struct Node
+  {
+    std::unordered_map<ndn::name::Component, std::unique_ptr<Node>> children;
+    std::optional<T> value;
+  };
+
+  Node m_root;
+  size_t m_size = 0;
+};
+
+#endif // V2V_NAME_TRIE_HPP
@@ -0,0 +1,109 @@
+/*
+  Write path for a file that is being fetched.
+
+  @author Waldo Jordaan
+*/
+
+#include "partial-file.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+NDN_LOG_INIT(PSync.PartialFile);
+
+namespace fs = std::filesystem;
+
+PartialFile::PartialFile(const fs::path& target)
+  : m_target(target)
+  , m_partial(partialPath(target))
+{
+  std::error_code ec;
+  fs::create_directories(m_target.parent_path(), ec);
+
+  m_fd = ::open(m_partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    NDN_LOG_WARN("Cannot open " << m_partial << ": " << std::strerror(errno));
+  }
+}
+
+PartialFile::~PartialFile()
+{
+  abort();
+}
+
+void
+PartialFile::reserve(uint64_t size)
+{
+  if (m_fd < 0 || size <= m_reserved)
+    return;
+
+  // Not every filesystem supports it; writing works the same without
+  if (::posix_fallocate(m_fd, 0, static_cast<off_t>(size)) == 0)
+    m_reserved = size;
+}
+
+bool
+PartialFile::write(const uint8_t* data, size_t size)
+{
+  if (m_fd < 0)
+    return false;
+
+  while (size > 0) {
+    ssize_t n = ::pwrite(m_fd, data, size, static_cast<off_t>(m_offset));
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      NDN_LOG_WARN("Write to " << m_partial << " failed: " << std::strerror(errno));
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+    m_offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+bool
+PartialFile::commit()
+{
+  if (m_fd < 0)
+    return false;
+
+  // A preallocation larger than the content would otherwise leave trailing zeros
+  bool ok = ::ftruncate(m_fd, static_cast<off_t>(m_offset)) == 0;
+  ok = ::close(m_fd) == 0 && ok;
+  m_fd = -1;
+
+  std::error_code ec;
+  if (ok)
+    fs::rename(m_partial, m_target, ec);
+  if (!ok || ec) {
+    NDN_LOG_WARN("Cannot move " << m_partial << " to " << m_target);
+    fs::remove(m_partial, ec);
+    return false;
+  }
+  return true;
+}
+
+void
+PartialFile::abort()
+{
+  if (m_fd < 0)
+    return;
+
+  ::close(m_fd);
+  m_fd = -1;
+  std::error_code ec;
+  fs::remove(m_partial, ec);
+}
+
+fs::path
+PartialFile::partialPath(const fs::path& target)
+{
+  return target.parent_path() / ("." + target.filename().string() + ".part");
+}
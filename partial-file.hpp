@@ -0,0 +1,63 @@
+/*
+  Write path for a file that is being fetched.
+
+  Data goes to a hidden ".<file>.part" sibling of the target through a single
+  descriptor: the expected size is preallocated once and content is written
+  with pwrite at the running offset, with no stream buffer in between.
+  commit() trims the file to what was written and renames it over the target,
+  so readers see either the old file or the complete new one. A PartialFile
+  that is destroyed without a commit removes its .part file.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_PARTIAL_FILE_HPP
+#define V2V_PARTIAL_FILE_HPP
+
+#include <cstdint>
+#include <filesystem>
+
+class PartialFile
+{
+public:
+  // Creates the parent directory if needed. Check isOpen() afterwards.
+  explicit PartialFile(const std::filesystem::path& target);
+
+  ~PartialFile();
+
+  PartialFile(const PartialFile&) = delete;
+  PartialFile& operator=(const PartialFile&) = delete;
+
+  bool isOpen() const
+  {
+    return m_fd >= 0;
+  }
+
+  // Preallocate size bytes; only a hint, the file still ends where writing stopped
+  void reserve(uint64_t size);
+
+  // Append at the current offset. Returns false on a write error.
+  bool write(const uint8_t* data, size_t size);
+
+  // Trim, close and rename over the target
+  bool commit();
+
+  // Close and remove the .part file
+  void abort();
+
+  uint64_t getSize() const
+  {
+    return m_offset;
+  }
+
+  static std::filesystem::path partialPath(const std::filesystem::path& target);
+
+private:
+  std::filesystem::path m_target;
+  std::filesystem::path m_partial;
+  int m_fd = -1;
+  uint64_t m_offset = 0;
+  uint64_t m_reserved = 0;
+};
+
+#endif // V2V_PARTIAL_FILE_HPP
@@ -0,0 +1,385 @@
+/*
+  Propagation-latency analyzer for perf logs collected from several nodes.
+
+  Usage: ./perf-analyze [--format csv|json] [--bucket <seconds>] [--outliers <n>] <node-dir>...
+
+  Each <node-dir> is a copy of one node's ~/perf_logs (the directory name is
+  used as the node id). Text .log files from update-repo-file.py and binary
+  .plog files from psync-start are read and joined by versioned name (every
+  event of one version lands in the same <sanitized name> file on every node).
+
+  The node that logged INSERT_START for a version is its publisher; every node
+  that logged PSYNC_UPDATE or FETCH_* for it is a receiver. For each
+  (version, receiver) pair the stages below are measured:
+
+    insert      INSERT_START  -> INSERT_DONE             publisher
+    notify      INSERT_DONE   -> NOTIFY_UPDATE           publisher
+    propagate   NOTIFY_UPDATE -> PSYNC_UPDATE            publisher -> receiver
+    schedule    PSYNC_UPDATE  -> FETCH_START             receiver
+    fetch       FETCH_START   -> FETCH_DONE              receiver
+    repo_insert FETCH_DONE    -> FETCHED_FILE_INSERTED   receiver
+    end_to_end  INSERT_START  -> FETCHED_FILE_INSERTED   publisher -> receiver
+
+  Cross-node stages assume the nodes' clocks are synchronised (NTP/PTP).
+
+  Output (stdout):
+    csv  : three tables separated by a blank line - stage percentiles,
+           completions per node per time bucket, end-to-end outliers
+    json : {"stages": [...], "throughput": [...], "outliers": [...]}
+
+  @author Waldo Jordaan
+*/
+
+#include "perf-log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// First time each event was seen for one version on one node
+using EventTimes = std::map<std::string, uint64_t>;
+
+struct Version
+{
+  std::string name;                        // versioned NDN name, from any event that carried one
+  std::map<std::string, EventTimes> nodes; // node -> events
+};
+
+struct StageDef
+{
+  enum Where { Publisher, Receiver, Cross }; // Cross: from on the publisher, to on the receiver
+
+  const char* stage;
+  const char* from;
+  const char* to;
+  Where where;
+};
+
+const StageDef STAGES[] = {
+  {"insert",      "INSERT_START",  "INSERT_DONE",           StageDef::Publisher},
+  {"notify",      "INSERT_DONE",   "NOTIFY_UPDATE",         StageDef::Publisher},
+  {"propagate",   "NOTIFY_UPDATE", "PSYNC_UPDATE",          StageDef::Cross},
+  {"schedule",    "PSYNC_UPDATE",  "FETCH_START",           StageDef::Receiver},
+  {"fetch",       "FETCH_START",   "FETCH_DONE",            StageDef::Receiver},
+  {"repo_insert", "FETCH_DONE",    "FETCHED_FILE_INSERTED", StageDef::Receiver},
+  {"end_to_end",  "INSERT_START",  "FETCHED_FILE_INSERTED", StageDef::Cross},
+};
+
+struct Outlier
+{
+  std::string name;
+  std::string node;
+  double endToEndMs;
+  std::string slowestStage;
+  double slowestStageMs;
+};
+
+void addEvent(std::map<std::string, Version>& versions, const std::string& node, const std::string& stem,
+              uint64_t ns, const std::string& event, const std::string& name)
+{
+  Version& version = versions[stem];
+  // INSERT_START carries the unversioned name; prefer any versioned one
+  if (version.name.empty() || version.name.find("/t=") == std::string::npos)
+    version.name = name;
+
+  auto [it, isNew] = version.nodes[node].emplace(event, ns);
+  if (!isNew)
+    it->second = std::min(it->second, ns);
+}
+
+size_t loadTextLog(std::map<std::string, Version>& versions, const std::string& node, const fs::path& path)
+{
+  std::ifstream in(path);
+  std::string line;
+  size_t n = 0;
+
+  while (std::getline(in, line)) {
+    // [ns] EVENT name
+    if (line.empty() || line[0] != '[')
+      continue;
+    auto close = line.find(']');
+    if (close == std::string::npos)
+      continue;
+
+    std::istringstream is(line.substr(close + 1));
+    std::string event, name;
+    is >> event >> name;
+    if (event.empty())
+      continue;
+
+    try {
+      addEvent(versions, node, path.stem().string(), std::stoull(line.substr(1, close - 1)), event, name);
+      ++n;
+    }
+    catch (const std::exception&) {
+      // malformed timestamp, skip the line
+    }
+  }
+  return n;
+}
+
+size_t loadBinaryLog(std::map<std::string, Version>& versions, const std::string& node, const fs::path& path)
+{
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  if (f == nullptr)
+    return 0;
+
+  size_t n = 0;
+  if (PerfLog::readHeader(f)) {
+    PerfLog::Record record;
+    while (PerfLog::readRecord(f, record)) {
+      addEvent(versions, node, path.stem().string(), record.ns, record.event, record.name);
+      ++n;
+    }
+  }
+  else {
+    std::cerr << "[Warn] " << path << " is not a .plog file" << std::endl;
+  }
+  std::fclose(f);
+  return n;
+}
+
+const uint64_t* findEvent(const EventTimes& events, const std::string& event)
+{
+  auto it = events.find(event);
+  return it == events.end() ? nullptr : &it->second;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+
+std::string jsonString(const std::string& str)
+{
+  std::string out = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      out.push_back('\\');
+    out.push_back(c);
+  }
+  return out + "\"";
+}
+
+int main(int argc, char* argv[])
+{
+  std::string format = "csv";
+  double bucketSec = 10;
+  size_t maxOutliers = 20;
+  std::vector<fs::path> dirs;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--format" && i + 1 < argc) {
+      format = argv[++i];
+    }
+    else if (arg == "--bucket" && i + 1 < argc) {
+      bucketSec = std::stod(argv[++i]);
+    }
+    else if (arg == "--outliers" && i + 1 < argc) {
+      maxOutliers = std::stoul(argv[++i]);
+    }
+    else {
+      dirs.push_back(arg);
+    }
+  }
+
+  if (dirs.empty() || (format != "csv" && format != "json") || bucketSec <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [--format csv|json] [--bucket <seconds>] [--outliers <n>] <node-dir>...\n";
+    return 1;
+  }
+
+  std::map<std::string, Version> versions; // file stem -> events per node
+  for (const auto& dir : dirs) {
+    std::string node = fs::absolute(dir).lexically_normal().filename().string();
+    if (node.empty())
+      node = fs::absolute(dir).lexically_normal().parent_path().filename().string();
+
+    std::error_code ec;
+    size_t nEvents = 0;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+      if (!entry.is_regular_file())
+        continue;
+      if (entry.path().extension() == ".log")
+        nEvents += loadTextLog(versions, node, entry.path());
+      else if (entry.path().extension() == ".plog")
+        nEvents += loadBinaryLog(versions, node, entry.path());
+    }
+    if (ec) {
+      std::cerr << "[Error] cannot read " << dir << ": " << ec.message() << std::endl;
+      return 1;
+    }
+    std::cerr << "Read " << nEvents << " events from node " << node << std::endl;
+  }
+
+  std::map<std::string, std::vector<double>> stageMs;
+  std::map<std::string, std::map<uint64_t, uint64_t>> completions; // node -> bucket -> count
+  std::vector<Outlier> candidates;
+  size_t negative = 0;
+
+  auto measure = [&] (const StageDef& def, const EventTimes& fromEvents, const EventTimes& toEvents) -> std::optional<double> {
+    const uint64_t* from = findEvent(fromEvents, def.from);
+    const uint64_t* to = findEvent(toEvents, def.to);
+    if (from == nullptr || to == nullptr)
+      return std::nullopt;
+
+    double ms = (static_cast<double>(*to) - static_cast<double>(*from)) / 1e6;
+    if (ms < 0)
+      ++negative;
+    stageMs[def.stage].push_back(ms);
+    return ms;
+  };
+
+  for (const auto& [stem, version] : versions) {
+    const EventTimes* publisher = nullptr;
+    for (const auto& [node, events] : version.nodes) {
+      if (findEvent(events, "INSERT_START")) {
+        publisher = &events;
+        break;
+      }
+    }
+
+    if (publisher != nullptr) {
+      for (const auto& def : STAGES) {
+        if (def.where == StageDef::Publisher)
+          measure(def, *publisher, *publisher);
+      }
+    }
+
+    for (const auto& [node, events] : version.nodes) {
+      if (!findEvent(events, "PSYNC_UPDATE") && !findEvent(events, "FETCH_START"))
+        continue; // not a receiver of this version
+
+      Outlier outlier{version.name, node, 0, "", 0};
+      for (const auto& def : STAGES) {
+        if (def.where == StageDef::Publisher || (def.where == StageDef::Cross && publisher == nullptr))
+          continue;
+
+        auto ms = measure(def, def.where == StageDef::Cross ? *publisher : events, events);
+        if (!ms)
+          continue;
+
+        if (std::string(def.stage) == "end_to_end") {
+          outlier.endToEndMs = *ms;
+        }
+        else if (*ms > outlier.slowestStageMs) {
+          outlier.slowestStage = def.stage;
+          outlier.slowestStageMs = *ms;
+        }
+      }
+
+      if (outlier.endToEndMs > 0)
+        candidates.push_back(outlier);
+
+      if (const uint64_t* done = findEvent(events, "FETCHED_FILE_INSERTED"))
+        ++completions[node][static_cast<uint64_t>(*done / 1e9 / bucketSec)];
+    }
+  }
+
+  if (negative > 0)
+    std::cerr << "[Warn] " << negative << " negative stage durations; check clock sync between nodes" << std::endl;
+
+  // Outliers: end-to-end above Q3 + 3 * IQR, slowest first
+  std::vector<double> e2e = stageMs["end_to_end"];
+  std::sort(e2e.begin(), e2e.end());
+  double limit = percentile(e2e, 75) + 3 * (percentile(e2e, 75) - percentile(e2e, 25));
+  std::vector<Outlier> outliers;
+  for (const auto& o : candidates) {
+    if (o.endToEndMs > limit)
+      outliers.push_back(o);
+  }
+  std::sort(outliers.begin(), outliers.end(), [] (const Outlier& a, const Outlier& b) {
+    return a.endToEndMs > b.endToEndMs;
+  });
+  if (outliers.size() > maxOutliers)
+    outliers.resize(maxOutliers);
+
+  std::cout << std::fixed << std::setprecision(3);
+  bool json = format == "json";
+
+  if (json)
+    std::cout << "{\n  \"stages\": [";
+  else
+    std::cout << "stage,count,min_ms,p50_ms,p95_ms,p99_ms,max_ms,mean_ms\n";
+
+  bool first = true;
+  for (const auto& def : STAGES) {
+    auto& values = stageMs[def.stage];
+    std::sort(values.begin(), values.end());
+    double mean = 0;
+    for (double v : values)
+      mean += v;
+    mean = values.empty() ? 0 : mean / values.size();
+    double min = values.empty() ? 0 : values.front();
+    double max = values.empty() ? 0 : values.back();
+
+    if (json) {
+      std::cout << (first ? "\n" : ",\n") << "    {\"stage\": " << jsonString(def.stage)
+                << ", \"count\": " << values.size() << ", \"min_ms\": " << min
+                << ", \"p50_ms\": " << percentile(values, 50) << ", \"p95_ms\": " << percentile(values, 95)
+                << ", \"p99_ms\": " << percentile(values, 99) << ", \"max_ms\": " << max
+                << ", \"mean_ms\": " << mean << "}";
+    }
+    else {
+      std::cout << def.stage << "," << values.size() << "," << min << "," << percentile(values, 50) << ","
+                << percentile(values, 95) << "," << percentile(values, 99) << "," << max << "," << mean << "\n";
+    }
+    first = false;
+  }
+
+  if (json)
+    std::cout << "\n  ],\n  \"throughput\": [";
+  else
+    std::cout << "\nnode,bucket_start_s,completed,per_sec\n";
+
+  first = true;
+  for (const auto& [node, buckets] : completions) {
+    for (const auto& [bucket, count] : buckets) {
+      uint64_t start = static_cast<uint64_t>(bucket * bucketSec);
+      if (json) {
+        std::cout << (first ? "\n" : ",\n") << "    {\"node\": " << jsonString(node) << ", \"bucket_start_s\": " << start
+                  << ", \"completed\": " << count << ", \"per_sec\": " << count / bucketSec << "}";
+      }
+      else {
+        std::cout << node << "," << start << "," << count << "," << count / bucketSec << "\n";
+      }
+      first = false;
+    }
+  }
+
+  if (json)
+    std::cout << "\n  ],\n  \"outliers\": [";
+  else
+    std::cout << "\nname,node,end_to_end_ms,slowest_stage,slowest_stage_ms\n";
+
+  first = true;
+  for (const auto& o : outliers) {
+    if (json) {
+      std::cout << (first ? "\n" : ",\n") << "    {\"name\": " << jsonString(o.name) << ", \"node\": " << jsonString(o.node)
+                << ", \"end_to_end_ms\": " << o.endToEndMs << ", \"slowest_stage\": " << jsonString(o.slowestStage)
+                << ", \"slowest_stage_ms\": " << o.slowestStageMs << "}";
+    }
+    else {
+      std::cout << o.name << "," << o.node << "," << o.endToEndMs << "," << o.slowestStage << "," << o.slowestStageMs << "\n";
+    }
+    first = false;
+  }
+
+  if (json)
+    std::cout << "\n  ]\n}\n";
+  return 0;
+}
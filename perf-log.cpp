@@ -0,0 +1,239 @@
+/*
+  Asynchronous perf-event logger.
+
+  The ring is a bounded multi-producer queue (Vyukov): each slot carries a
+  sequence number telling producers and the flusher whose turn it is, so
+  neither side takes a lock.
+
+  @author Waldo Jordaan
+*/
+
+#include "perf-log.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+PerfLog::PerfLog(const fs::path& dir, size_t capacity, size_t maxOpenFiles)
+  : m_dir(dir)
+  , m_capacity(capacity)
+  , m_slots(new Slot[capacity])
+  , m_maxOpenFiles(maxOpenFiles)
+{
+  for (size_t i = 0; i < m_capacity; ++i) {
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  std::error_code ec;
+  fs::create_directories(m_dir, ec);
+
+  m_flusher = std::thread(&PerfLog::flushLoop, this);
+}
+
+PerfLog::~PerfLog()
+{
+  m_stopping = true;
+  m_flusher.join();
+
+  for (auto& [stem, entry] : m_files) {
+    std::fclose(entry.first);
+  }
+}
+
+bool
+PerfLog::log(const char* event, const std::string& name, std::string detail)
+{
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+
+  size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+  Slot* slot;
+  while (true) {
+    slot = &m_slots[pos % m_capacity];
+    size_t seq = slot->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+    if (diff == 0) {
+      if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if (diff < 0) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else {
+      pos = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->record.ns = ns;
+  slot->record.event = event;
+  slot->record.name = name;
+  slot->record.detail = std::move(detail);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool
+PerfLog::tryPop(Record& record)
+{
+  Slot& slot = m_slots[m_dequeuePos % m_capacity];
+  size_t seq = slot.sequence.load(std::memory_order_acquire);
+  if (seq != m_dequeuePos + 1)
+    return false;
+
+  record = std::move(slot.record);
+  slot.sequence.store(m_dequeuePos + m_capacity, std::memory_order_release);
+  ++m_dequeuePos;
+  return true;
+}
+
+void
+PerfLog::flushLoop()
+{
+  std::vector<Record> batch;
+  std::vector<std::FILE*> touched;
+  uint64_t reportedDrops = 0;
+
+  while (true) {
+    // Read the flag before draining so nothing queued before the destructor ran is lost
+    bool stopping = m_stopping.load();
+
+    Record record;
+    while (batch.size() < m_capacity && tryPop(record)) {
+      batch.push_back(std::move(record));
+    }
+
+    for (const auto& r : batch) {
+      std::FILE* f = openFile(fileStem(r.name));
+      if (f == nullptr)
+        continue;
+      writeRecord(f, r);
+      touched.push_back(f);
+    }
+    for (auto* f : touched) {
+      std::fflush(f);
+    }
+
+    bool drained = batch.size() < m_capacity;
+    batch.clear();
+    touched.clear();
+
+    uint64_t dropped = getDropped();
+    if (dropped != reportedDrops) {
+      std::cerr << "[PerfLog] " << dropped - reportedDrops << " events dropped (ring full)" << std::endl;
+      reportedDrops = dropped;
+    }
+
+    if (stopping && drained)
+      return;
+    if (drained)
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+}
+
+std::FILE*
+PerfLog::openFile(const std::string& stem)
+{
+  auto it = m_files.find(stem);
+  if (it != m_files.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+    return it->second.first;
+  }
+
+  if (m_files.size() >= m_maxOpenFiles) {
+    auto victim = m_files.find(m_lru.back());
+    std::fclose(victim->second.first);
+    m_files.erase(victim);
+    m_lru.pop_back();
+  }
+
+  fs::path path = m_dir / (stem + ".plog");
+  std::error_code ec;
+  bool isNew = !fs::exists(path, ec) || fs::file_size(path, ec) == 0;
+
+  std::FILE* f = std::fopen(path.c_str(), "ab");
+  if (f == nullptr)
+    return nullptr;
+
+  std::setvbuf(f, nullptr, _IOFBF, 64 * 1024);
+  if (isNew) {
+    std::fwrite(MAGIC, 1, MAGIC_SIZE, f);
+  }
+
+  m_lru.push_front(stem);
+  m_files.emplace(stem, std::make_pair(f, m_lru.begin()));
+  return f;
+}
+
+void
+PerfLog::writeRecord(std::FILE* f, const Record& record)
+{
+  uint8_t eventLen = static_cast<uint8_t>(std::min<size_t>(record.event.size(), UINT8_MAX));
+  uint16_t nameLen = static_cast<uint16_t>(std::min<size_t>(record.name.size(), UINT16_MAX));
+  uint16_t detailLen = static_cast<uint16_t>(std::min<size_t>(record.detail.size(), UINT16_MAX));
+
+  std::fwrite(&record.ns, sizeof(record.ns), 1, f);
+  std::fwrite(&eventLen, sizeof(eventLen), 1, f);
+  std::fwrite(record.event.data(), 1, eventLen, f);
+  std::fwrite(&nameLen, sizeof(nameLen), 1, f);
+  std::fwrite(record.name.data(), 1, nameLen, f);
+  std::fwrite(&detailLen, sizeof(detailLen), 1, f);
+  std::fwrite(record.detail.data(), 1, detailLen, f);
+}
+
+std::string
+PerfLog::fileStem(const std::string& name)
+{
+  std::string out;
+  out.reserve(name.size());
+
+  // skip leading "/"
+  size_t i = 0;
+  if (!name.empty() && name[0] == '/')
+    i = 1;
+
+  for (; i < name.size(); ++i) {
+    char c = name[i];
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
+      out.push_back(c);
+    } else {
+      out.push_back('-');
+    }
+  }
+  return out;
+}
+
+bool
+PerfLog::readHeader(std::FILE* f)
+{
+  char magic[MAGIC_SIZE];
+  return std::fread(magic, 1, MAGIC_SIZE, f) == MAGIC_SIZE &&
+         std::memcmp(magic, MAGIC, MAGIC_SIZE) == 0;
+}
+
+bool
+PerfLog::readRecord(std::FILE* f, Record& record)
+{
+  auto readString = [f] (std::string& out, size_t len) {
+    out.resize(len);
+    return len == 0 || std::fread(out.data(), 1, len, f) == len;
+  };
+
+  uint8_t eventLen = 0;
+  uint16_t nameLen = 0;
+  uint16_t detailLen = 0;
+
+  return std::fread(&record.ns, sizeof(record.ns), 1, f) == 1 &&
+         std::fread(&eventLen, sizeof(eventLen), 1, f) == 1 &&
+         readString(record.event, eventLen) &&
+         std::fread(&nameLen, sizeof(nameLen), 1, f) == 1 &&
+         readString(record.name, nameLen) &&
+         std::fread(&detailLen, sizeof(detailLen), 1, f) == 1 &&
+         readString(record.detail, detailLen);
+}
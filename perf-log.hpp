@@ -0,0 +1,102 @@
+/*
+  Asynchronous perf-event logger.
+
+  log() stamps the event and pushes it into a fixed-size lock-free ring; it
+  never touches the disk and never blocks. When the ring is full the event is
+  dropped and counted. A background thread drains the ring in batches and
+  appends each record to <dir>/<sanitized name>.plog, keeping an LRU cache of
+  open file handles.
+
+  .plog layout (host byte order):
+    file   : "V2VPLOG1" record*
+    record : u64 ns | u8 eventLen | event | u16 nameLen | name | u16 detailLen | detail
+
+  perflog-dump turns .plog files back into the "[ns] EVENT name" text lines
+  update-repo-file.py writes to .log files.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_PERF_LOG_HPP
+#define V2V_PERF_LOG_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+class PerfLog
+{
+public:
+  static constexpr char MAGIC[] = "V2VPLOG1";
+  static constexpr size_t MAGIC_SIZE = 8;
+
+  struct Record
+  {
+    uint64_t ns = 0;
+    std::string event;
+    std::string name;
+    std::string detail;
+  };
+
+  explicit PerfLog(const std::filesystem::path& dir, size_t capacity = 16384, size_t maxOpenFiles = 256);
+
+  // Drains everything still queued before returning
+  ~PerfLog();
+
+  PerfLog(const PerfLog&) = delete;
+  PerfLog& operator=(const PerfLog&) = delete;
+
+  // Queue one event for name. Returns false if the ring was full and the event was dropped.
+  bool log(const char* event, const std::string& name, std::string detail = {});
+
+  uint64_t getDropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+  // Sanitized file stem for name, the same as update-repo-file.py's sanitize_name()
+  static std::string fileStem(const std::string& name);
+
+  // Read the next record from a .plog file. The caller checks the magic with readHeader() first.
+  static bool readHeader(std::FILE* f);
+  static bool readRecord(std::FILE* f, Record& record);
+
+private:
+  struct Slot
+  {
+    std::atomic<size_t> sequence;
+    Record record;
+  };
+
+  bool tryPop(Record& record);
+
+  void flushLoop();
+
+  // Returns the cached handle for a file stem, opening it (and writing the magic) if needed
+  std::FILE* openFile(const std::string& stem);
+
+  void writeRecord(std::FILE* f, const Record& record);
+
+private:
+  std::filesystem::path m_dir;
+  size_t m_capacity;
+  std::unique_ptr<Slot[]> m_slots;
+  alignas(64) std::atomic<size_t> m_enqueuePos{0};
+  alignas(64) size_t m_dequeuePos = 0; // flusher thread only
+  std::atomic<uint64_t> m_dropped{0};
+
+  size_t m_maxOpenFiles;
+  std::list<std::string> m_lru; // most recently used stem first
+  std::unordered_map<std::string, std::pair<std::FILE*, std::list<std::string>::iterator>> m_files;
+
+  std::atomic<bool> m_stopping{false};
+  std::thread m_flusher;
+};
+
+#endif // V2V_PERF_LOG_HPP
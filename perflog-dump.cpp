@@ -0,0 +1,46 @@
+/*
+  Print .plog files written by psync-start as the "[ns] EVENT name" lines
+  update-repo-file.py writes, with the record's detail appended if it has one.
+
+  Usage: ./perflog-dump <file.plog>...
+
+  @author Waldo Jordaan
+*/
+
+#include "perf-log.hpp"
+
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <file.plog>...\n";
+    return 1;
+  }
+
+  int status = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::FILE* f = std::fopen(argv[i], "rb");
+    if (f == nullptr) {
+      std::cerr << "[Error] cannot open " << argv[i] << std::endl;
+      status = 1;
+      continue;
+    }
+    if (!PerfLog::readHeader(f)) {
+      std::cerr << "[Error] " << argv[i] << " is not a .plog file" << std::endl;
+      std::fclose(f);
+      status = 1;
+      continue;
+    }
+
+    PerfLog::Record record;
+    while (PerfLog::readRecord(f, record)) {
+      std::cout << "[" << record.ns << "] " << record.event << " " << record.name;
+      if (!record.detail.empty())
+        std::cout << " " << record.detail;
+      std::cout << "\n";
+    }
+    std::fclose(f);
+  }
+  return status;
+}
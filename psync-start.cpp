@@ -5,6 +5,7 @@
 */
 
 #include <PSync/full-producer.hpp>
+#include <PSync/consumer.hpp>
 #include <ndn-cxx/face.hpp>
 #include <ndn-cxx/security/key-chain.hpp>
 #include <ndn-cxx/util/logger.hpp>
@@ -12,12 +13,32 @@
 #include <iostream>
 #include <ndn-cxx/util/segment-fetcher.hpp>
 #include <ndn-cxx/security/validator-null.hpp>
+#include <ndn-cxx/util/random.hpp>
 #include <unistd.h>
 #include <PSync/detail/state.hpp>
 #include <map>
 #include "termcolor.hpp"
+#include "repo-client.hpp"
+#include "version-index.hpp"
+#include "update-coalescer.hpp"
+#include "work-executor.hpp"
+#include "subs-matcher.hpp"
+#include "file-watcher.hpp"
+#include "perf-log.hpp"
+#include "cs-eraser.hpp"
+#include "manifest.hpp"
+#include "delta-fetcher.hpp"
+#include "chunk-store.hpp"
+#include "chunk-server.hpp"
+#include "chunk-fetcher.hpp"
+#include "codec.hpp"
+#include "partial-file.hpp"
+#include "state-journal.hpp"
+#include "cmd-history.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+#include "shard-pool.hpp"
 
-// for execCmd()
 #include <cstdio>
 #include <memory>
 #include <stdexcept>
@@ -26,21 +47,25 @@
 #include <fstream>
 #include <vector>
 #include <cstdlib>
-#include <unordered_set>
 
 #include <filesystem>
 #include <thread>
+#include <boost/asio/post.hpp>
+#include <boost/asio/signal_set.hpp>
+
+// for notifyWatcher()
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 // for perf_log
 #include <chrono>
 #include <cctype>
 const bool ENABLE_PERF_LOG = true;
 
-std::string GETFILE = "./getfile.py";
-std::string GETLATEST = "./get-latest.py";
-std::string PUTFILE = "./putfile.py";
-std::string DELFILE = "./delfile.py";
+const ndn::Name REPO_NAME("/bmw");
 const std::string SUBSFILE = "./subsfile";
+const std::string CODECSFILE = "./codecs"; // per-prefix publish codec, shared with update-repo-file.py
 
 NDN_LOG_INIT(PSync.Start);
 using namespace ndn::time_literals;
@@ -48,69 +73,134 @@ using namespace ndn::time_literals;
 namespace fs = std::filesystem;
 // Always place logs in ~/perf_logs
 const fs::path PERF_LOGS_DIR = fs::path(getenv("HOME")) / "perf_logs";
-
-std::string execCmd(const std::string& cmd);
+const fs::path REPO_DB_PATH = fs::path(getenv("HOME")) / ".ndn/ndn-python-repo/sqlite3.db";
+const fs::path CHUNK_STORE_DIR = fs::path(getenv("HOME")) / "chunk_store"; // shared with chunk-tool
+const fs::path JOURNAL_PATH = fs::path(getenv("HOME")) / ".ndn/psync-start.journal";
 
 fs::path PRIMARY_PATH = "/home/brewski";
 fs::path FALLBACK_PATH = "/home/brewski/masters";
 fs::path WATCH_DIR;
-
-std::string sanitizeName(const std::string& name) {
-  std::string out;
-  out.reserve(name.size());
-
-  // skip leading "/"
-  size_t i = 0;
-  if (!name.empty() && name[0] == '/')
-    i = 1;
-
-  for (; i < name.size(); ++i) {
-    char c = name[i];
-    if (std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '-' || c == '_') {
-      out.push_back(c);
-    } else {
-      out.push_back('-');
-    }
-  }
-
-  fs::create_directories(PERF_LOGS_DIR);
-
-  return (PERF_LOGS_DIR / (out + ".log")).string();
-}
-
-void perfLog(const std::string& filename, const std::string& event, const std::string& name) {
+fs::path SOCKET_PATH; // update-repo-file.py LOCK/UNLOCK socket
+
+// Segments kept in flight by the fetcher. 0 keeps SegmentFetcher's adaptive (AIMD) window.
+size_t FETCH_WINDOW = 0;
+
+// Fetch only the segments that changed since the local copy, using the version's manifest (--no-delta)
+bool DELTA_SYNC = true;
+// Segment or chunk Interests a delta or chunk fetch keeps outstanding when --fetch-window is not set
+const size_t DELTA_WINDOW = 16;
+// Fetch objects as recipes of content-defined chunks, and serve our chunk store (--chunks)
+bool CHUNK_SYNC = false;
+// With --chunks, remove the chunks no recipe refers to every CHUNK_GC_INTERVAL (--chunk-gc-interval, 0 disables).
+// Chunks written or reused within CHUNK_GC_GRACE are kept: their recipe may not be saved yet.
+ndn::time::seconds CHUNK_GC_INTERVAL(3600);
+const std::chrono::minutes CHUNK_GC_GRACE(10);
+
+// Fetches start when the CS erase is confirmed, or after ERASE_WAIT_MAX without a confirmation.
+// A failed probe or fetch is retried up to FETCH_MAX_ATTEMPTS times (--fetch-attempts) with backoff.
+const ndn::time::milliseconds ERASE_WAIT_MAX(1000);
+const ndn::time::milliseconds PROBE_LIFETIME(1000);
+const ndn::time::milliseconds FETCH_BACKOFF_BASE(100);
+const ndn::time::milliseconds FETCH_BACKOFF_MAX(5000);
+int FETCH_MAX_ATTEMPTS = 6;
+
+// Subscribe only to the objects the subsfile allows instead of carrying the fleet's full sync state (--partial).
+// Publishers serve partial sync under <sync-prefix>/partial (repo-watcher --partial), with each object's
+// latest timestamp as its sequence number. Objects published since the last hello are found by the next one.
+bool PARTIAL_SYNC = false;
+ndn::time::seconds HELLO_INTERVAL(30);      // --hello-interval
+uint32_t PARTIAL_BF_COUNT = 200;            // subscriptions the Bloom filter is sized for (--partial-subs)
+
+// Fetch updates ignored before a subsfile reload if the new subscriptions allow them (--catch-up)
+bool SUBS_CATCH_UP = false;
+// Objects remembered for catch-up
+const size_t MAX_IGNORED = 100000;
+
+// Keep the sync state and the executed /cmd versions in JOURNAL_PATH across restarts (--no-journal)
+bool STATE_JOURNAL = true;
+
+// Memory bound of the executed /cmd record (--cmd-window <seconds>, --cmd-filter-kib <n>, --cmd-prefixes <n>)
+CmdHistory::Options CMD_HISTORY;
+
+// Serve Prometheus metrics on 127.0.0.1:<port>/metrics (--metrics-port); 0 disables the endpoint
+uint16_t METRICS_PORT = 0;
+// Period of the timer whose lateness psync_io_lag_seconds records
+const std::chrono::milliseconds IO_LAG_INTERVAL(100);
+
+// Record a span per update stage (--trace) in a ring of TRACE_SPANS (--trace-spans); SIGUSR1 and exit
+// write the ring to PERF_LOGS_DIR as Chrome trace-event JSON for chrome://tracing or Perfetto
+bool TRACE = false;
+size_t TRACE_SPANS = 65536;
+
+// Worker threads for the DB reads, file reads, compression and segment signing of update handling
+// (--shards). Work is sharded by generic prefix, so one prefix's work stays in order.
+size_t SHARDS = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+
+// Concurrency and queue limit of each executor stage (--concurrency, --queue-limit), and for fetches
+// the per-priority in-flight limits (--priority-limit) and the wait that raises a priority (--priority-aging)
+std::array<WorkExecutor::StageConfig, WorkExecutor::N_STAGES> STAGE_CONFIG = WorkExecutor::defaultConfig();
+// Subscribed objects whose local copy is at least this large are fetched at bulk priority (--bulk-size)
+uint64_t BULK_SIZE = 1 << 20;
+
+// Perf events are queued in memory; a background thread appends them to PERF_LOGS_DIR/<name>.plog
+PerfLog PERF_LOG(PERF_LOGS_DIR);
+
+void perfLog(const char* event, const std::string& name, std::string detail = {}) {
   if (!ENABLE_PERF_LOG) return;
-  auto now = std::chrono::system_clock::now().time_since_epoch();
-  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
-  std::ofstream f(filename, std::ios::app);
-  f << "[" << ns << "] " << event << " " << name << std::endl;
+  PERF_LOG.log(event, name, std::move(detail));
 }
 
 void initWatchDir()
 {
   if (fs::exists(FALLBACK_PATH)) {
     WATCH_DIR = FALLBACK_PATH / "bmw";  // running on laptop
+    SOCKET_PATH = FALLBACK_PATH / "tmp/ndn-fetch.sock";
   } else {
     WATCH_DIR = PRIMARY_PATH / "bmw";   // running on RPi
+    SOCKET_PATH = PRIMARY_PATH / "tmp/ndn-fetch.sock";
   }
 
   std::cout << "\n[Init] WATCH_DIR set to: " << WATCH_DIR << std::endl;
 }
 
+// Tell update-repo-file.py to ignore file events for a path we are writing (same protocol as getfile.py)
+void notifyWatcher(const std::string& msg, const fs::path& path)
+{
+  int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (sock < 0)
+    return;
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, SOCKET_PATH.c_str(), sizeof(addr.sun_path) - 1);
+
+  std::string payload = msg + fs::weakly_canonical(path).string();
+  sendto(sock, payload.data(), payload.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  close(sock);
+}
+
 class SyncListener
 {
 public:
   SyncListener(const ndn::Name& syncPrefix, const std::string& userPrefix)
-    : m_producer(m_face, m_keyChain, syncPrefix, [this] {
-        psync::FullProducer::Options opts;
-        opts.onUpdate = std::bind(&SyncListener::processSyncUpdate, this, _1);
-        opts.syncInterestLifetime = 1600_ms;
-        opts.syncDataFreshness = 1600_ms;
-        return opts;
-      }())
-    , m_userPrefix(userPrefix)
-  {
-    m_producer.addUserNode(m_userPrefix);
+    : m_userPrefix(userPrefix)
+  {
+    if (PARTIAL_SYNC) {
+      psync::Consumer::Options opts;
+      opts.onHelloData = std::bind(&SyncListener::processHelloData, this, _1);
+      opts.onUpdate = std::bind(&SyncListener::processPartialUpdate, this, _1);
+      opts.bfCount = PARTIAL_BF_COUNT;
+      opts.syncInterestLifetime = 1600_ms;
+      m_consumer = std::make_unique<psync::Consumer>(m_face, ndn::Name(syncPrefix).append("partial"), opts);
+    }
+    else {
+      psync::FullProducer::Options opts;
+      opts.onUpdate = std::bind(&SyncListener::processSyncUpdate, this, _1);
+      opts.syncInterestLifetime = 1600_ms;
+      opts.syncDataFreshness = 1600_ms;
+      m_producer = std::make_unique<psync::FullProducer>(m_face, m_keyChain, syncPrefix, opts);
+      m_producer->addUserNode(m_userPrefix);
+    }
     m_state[m_userPrefix] = 0;
 
     char hostBuf[256];
@@ -118,37 +208,111 @@ public:
       m_hostname = hostBuf;
     }
 
-    std::ifstream in(SUBSFILE);
-    if (!in.is_open()) {
+    auto subs = std::make_shared<SubsMatcher>();
+    subs->setHostname(m_hostname);
+    long nSubs = subs->loadFile(SUBSFILE);
+    if (nSubs < 0) {
       std::cout << "Unable to open subscriptions file: " << SUBSFILE << std::endl;
     }
     else {
-      std::string line;
-      while (std::getline(in, line)) {
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-        if (line.empty())
-          continue;
-        //ndn::Name pref(m_hostname);
-        //pref.append(ndn::Name(line));
-        ndn::Name pref(line);
-        m_allowedPrefixes.push_back(pref);
+      std::cout << "Loaded " << nSubs << " subscription prefixes from " << SUBSFILE << std::endl;
+    }
+    m_subs = subs;
+
+    try {
+      m_subsWatcher = std::make_unique<FileWatcher>(m_face.getIoContext(), SUBSFILE, [this] {
+        // Coalesce the burst of events an editor produces into one reload
+        m_subsReloadEvent = m_scheduler.schedule(ndn::time::milliseconds(200), [this] { reloadSubs(); });
+      });
+    }
+    catch (const std::exception& e) {
+      std::cerr << "[Warn] not watching " << SUBSFILE << " for changes: " << e.what() << std::endl;
+    }
+
+    if (CHUNK_SYNC) {
+      m_chunkServer = std::make_unique<ChunkServer>(m_face, m_keyChain, m_chunks);
+      if (CHUNK_GC_INTERVAL > ndn::time::seconds::zero()) {
+        m_chunkGcEvent = m_scheduler.schedule(CHUNK_GC_INTERVAL, [this] { collectChunks(); });
+      }
+    }
+
+    long nCodecs = m_codecs.loadFile(CODECSFILE);
+    if (nCodecs > 0) {
+      std::cout << "Loaded " << nCodecs << " codec rules from " << CODECSFILE << std::endl;
+    }
+
+    registerMetrics();
+    if (METRICS_PORT != 0) {
+      sampleIoLag(std::chrono::steady_clock::now());
+      try {
+        m_metricsServer = std::make_unique<MetricsServer>(m_face.getIoContext(), METRICS_PORT, m_metrics);
+        std::cout << "Serving metrics on http://127.0.0.1:" << METRICS_PORT << "/metrics" << std::endl;
       }
-      std::cout << "Loaded " << m_allowedPrefixes.size() << " subscription prefixes from " << SUBSFILE << std::endl;
-      for (int i = 0; i < m_allowedPrefixes.size(); i++){
-        std::cout <<  m_allowedPrefixes[i] << std::endl;
+      catch (const std::exception& e) {
+        std::cerr << "[Warn] not serving metrics on port " << METRICS_PORT << ": " << e.what() << std::endl;
       }
     }
 
+    if (TRACE) {
+      m_tracer = std::make_unique<Tracer>(TRACE_SPANS);
+      m_tracer->nameThread("io");
+      m_traceSignal.add(SIGUSR1);
+      waitTraceSignal();
+    }
+
+    // Return from run() on SIGINT/SIGTERM so queued perf events are written out at exit
+    m_signals.async_wait([this] (const boost::system::error_code& ec, int) {
+      if (!ec) {
+        m_face.getIoContext().stop();
+      }
+    });
+
+    size_t nIndexed = m_versions.load();
+    std::cout << "Indexed latest versions of " << nIndexed << " prefixes from " << REPO_DB_PATH << std::endl;
+
+    if (STATE_JOURNAL) {
+      restoreState();
+    }
+
+    if (m_consumer) {
+      sendHello();
+      std::cout << "Partial sync: subscribing to matching objects under " << syncPrefix << "/partial" << std::endl;
+    }
     std::cout << "Sync listener started with prefix: " << m_userPrefix << " on host " << m_hostname << std::endl;
   }
 
+  ~SyncListener()
+  {
+    if (m_subsReloadThread.joinable()) {
+      m_subsReloadThread.join();
+    }
+    if (m_tracer) {
+      writeTrace();
+    }
+  }
+
   void run()
   {
     m_face.processEvents();
   }
 
 private:
+  struct FetchTask
+  {
+    ndn::Name name;          // versioned name
+    ndn::Name genericPrefix;
+    uint64_t timestamp;
+    std::string currentName; // name.toUri(), used for perf logs and /cmd bookkeeping
+    bool isCmd;
+    WorkExecutor::Priority priority;
+    std::optional<bool> compressed = std::nullopt; // from the codec header of segment 0, once a probe returned it
+    std::chrono::steady_clock::time_point admitted = std::chrono::steady_clock::now();
+  };
+
+  // Segments of an object fetched in full, inserted into the local repo as they arrived
+  using Segments = std::map<uint64_t, ndn::Data>;
+  // segments is null when the object was rebuilt from a delta or chunks and has to be re-segmented
+  using FetchDone = std::function<void(bool ok, std::shared_ptr<Segments> segments)>;
 
   static uint64_t extractTimestamp(const std::string& name)
   {
@@ -164,198 +328,1151 @@ private:
     }
   }
 
-  static void deleteFromRepo(const std::string& name)
+  void deleteFromRepo(const std::string& name)
   {
-    std::string cmd = "python3 " + DELFILE + " -r bmw -n " + name + " > /dev/null 2>&1";
-    int ret = std::system(cmd.c_str());
-    if (ret != 0) {
-      std::cerr << "[Delete Error] delfile.py failed for " << name << std::endl;
+    auto [prefix, ts] = VersionIndex::splitVersion(ndn::Name(name));
+
+    auto result = m_executor.submit(WorkExecutor::Stage::Delete, prefix, ts,
+      [this, name, prefix = prefix, ts = ts] (WorkExecutor::Done done) {
+        // The old version's manifest goes with it
+        m_repo.deleteObject(Manifest::makeName(prefix).append(
+          ndn::name::Component::fromNumber(ts, ndn::tlv::TimestampNameComponent)));
+
+        m_repo.deleteObject(ndn::Name(name), std::nullopt, std::nullopt, [=] (bool ok) {
+          done();
+          if (!ok) {
+            std::cerr << "[Delete Error] repo delete failed for " << name << std::endl;
+            return;
+          }
+          m_versions.erase(prefix, ts);
+        });
+      });
+
+    if (result != WorkExecutor::Submitted::Queued) {
+      NDN_LOG_WARN("Delete queue full, leaving " << name << " in the repo");
+    }
+  }
+
+  void trace(const char* stage, const std::string& name, Tracer::Clock::time_point start,
+             Tracer::Clock::time_point end, const std::string& details = {})
+  {
+    if (m_tracer) {
+      m_tracer->record(stage, name, start, end, details);
+    }
+  }
+
+  // A span that ends now
+  void trace(const char* stage, const std::string& name, Tracer::Clock::time_point start,
+             const std::string& details = {})
+  {
+    trace(stage, name, start, Tracer::Clock::now(), details);
+  }
+
+  void waitTraceSignal()
+  {
+    m_traceSignal.async_wait([this] (const boost::system::error_code& ec, int) {
+      if (ec)
+        return;
+      writeTrace();
+      waitTraceSignal();
+    });
+  }
+
+  // Write the span ring to a new file; recording goes on
+  void writeTrace()
+  {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    fs::path path = PERF_LOGS_DIR / ("psync-start-" +
+      std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()) + ".trace.json");
+    if (!m_tracer->writeChromeTrace(path)) {
+      std::cerr << "[Trace Error] cannot write " << path << std::endl;
+      return;
+    }
+    uint64_t nRecorded = m_tracer->getRecorded();
+    std::cout << "Wrote " << std::min<uint64_t>(nRecorded, m_tracer->getCapacity()) << " of " << nRecorded
+              << " trace spans to " << path << std::endl;
+  }
+
+  // Values read from other components when /metrics is scraped
+  void registerMetrics()
+  {
+    for (size_t i = 0; i < WorkExecutor::N_STAGES; ++i) {
+      auto stage = static_cast<WorkExecutor::Stage>(i);
+      std::string label = std::string("stage=\"") + WorkExecutor::toString(stage) + "\"";
+      m_metrics.sampled("psync_stage_queued", "Jobs waiting in an executor stage", label,
+                        [this, stage] { return m_executor.getStats(stage).queued; });
+      m_metrics.sampled("psync_stage_in_flight", "Jobs running in an executor stage", label,
+                        [this, stage] { return m_executor.getStats(stage).inFlight; });
+      m_metrics.sampled("psync_stage_rejected_total", "Jobs dropped because the stage queue was full", label,
+                        [this, stage] { return m_executor.getStats(stage).rejected; }, true);
+    }
+    for (size_t i = 0; i < WorkExecutor::N_PRIORITIES; ++i) {
+      auto priority = static_cast<WorkExecutor::Priority>(i);
+      m_fetchQueueDelay[i] = &m_metrics.histogram("psync_fetch_queue_seconds", i == 0 ? "Fetch queue wait by priority" : "",
+                                                  std::string("priority=\"") + WorkExecutor::toString(priority) + "\"");
+    }
+    m_metrics.sampled("psync_sync_state_entries", "Entries in the sync state", "",
+                      [this] { return m_state.size(); });
+    m_metrics.sampled("psync_shard_queued", "Tasks waiting for a shard worker", "",
+                      [this] { return m_shards.getStats().queued; });
+    m_metrics.sampled("psync_shard_tasks_total", "Tasks run by the shard workers", "",
+                      [this] { return m_shards.getStats().completed; }, true);
+    m_metrics.sampled("psync_perf_events_dropped_total", "Perf events dropped because the ring was full", "",
+                      [] { return PERF_LOG.getDropped(); }, true);
+  }
+
+  // How late a timer due every IO_LAG_INTERVAL fires: the time io-thread work keeps sync
+  // Interests and Data waiting
+  void sampleIoLag(std::chrono::steady_clock::time_point due)
+  {
+    auto now = std::chrono::steady_clock::now();
+    m_ioLag.record(now > due ? now - due : std::chrono::steady_clock::duration::zero());
+    m_ioLagEvent = m_scheduler.schedule(ndn::time::milliseconds(IO_LAG_INTERVAL.count()),
+                                        [this, now] { sampleIoLag(now + IO_LAG_INTERVAL); });
+  }
+
+  // Rebuild m_state and m_cmds from the journal. Entries whose version the repo already holds
+  // (or that the subscriptions ignore) are published to the full sync producer, so the first sync
+  // round does not report them again. The rest were received but not inserted before the restart;
+  // they are left out so sync reports and fetches them again. Ignored versions the repo does not
+  // hold are remembered as if just received, so --catch-up can still fetch them after a subsfile edit.
+  void restoreState()
+  {
+    auto start = std::chrono::steady_clock::now();
+    try {
+      m_journal = std::make_unique<StateJournal>(JOURNAL_PATH);
+    }
+    catch (const std::exception& e) {
+      std::cerr << "[Warn] not journaling sync state: " << e.what() << std::endl;
+      return;
+    }
+
+    std::map<ndn::Name, uint64_t> journaled;
+    size_t nRecords = m_journal->replay([&] (const StateJournal::Record& record) {
+      if (record.type == StateJournal::Type::State) {
+        journaled[ndn::Name(record.key)] = record.value;
+      }
+      else if (record.type == StateJournal::Type::Cmd) {
+        m_cmds.markExecuted(record.key, record.value);
+      }
+      else if (record.type == StateJournal::Type::CmdUpTo) {
+        m_cmds.markExecutedUpTo(record.key, record.value);
+      }
+    });
+    size_t nBytes = m_journal->getSize();
+
+    auto subs = std::atomic_load(&m_subs);
+    size_t nRestored = 0;
+    for (const auto& [prefix, seq] : journaled) {
+      auto [genericPrefix, ts] = VersionIndex::splitVersion(prefix);
+      if (ts != 0 && m_versions.latest(genericPrefix) < ts) {
+        if (subs->match(prefix) != nullptr)
+          continue;
+        rememberIgnored({prefix, genericPrefix, ts});
+      }
+
+      m_state[prefix] = seq;
+      if (m_producer && prefix != m_userPrefix) {
+        m_producer->addUserNode(prefix);
+        m_producer->publishName(prefix, seq);
+      }
+      ++nRestored;
+    }
+    compactJournalIfNeeded();
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Restored " << nRestored << " of " << journaled.size() << " sync prefixes and "
+              << m_cmds.getPrefixCount() << " commands' history from " << JOURNAL_PATH
+              << " (" << nRecords << " records, " << nBytes << " bytes) in " << ms << " ms" << std::endl;
+    perfLog("JOURNAL_RESTORED", JOURNAL_PATH.string(), "records=" + std::to_string(nRecords) +
+            " bytes=" + std::to_string(nBytes) + " ms=" + std::to_string(ms));
+  }
+
+  // Rewrite the journal as the live state once superseded records dominate it
+  void compactJournalIfNeeded()
+  {
+    if (!m_journal || !m_journal->needsCompaction(m_state.size() + m_cmds.getPrefixCount()))
+      return;
+
+    std::vector<StateJournal::Record> live;
+    live.reserve(m_state.size() + m_cmds.getPrefixCount());
+    for (const auto& [prefix, seq] : m_state) {
+      if (prefix != m_userPrefix) {
+        live.push_back({StateJournal::Type::State, seq, prefix.toUri()});
+      }
+    }
+    // Only the high-water marks are kept: versions below them that never ran will not run after a restart
+    for (const auto& [prefix, high] : m_cmds.getHighWaterMarks()) {
+      live.push_back({StateJournal::Type::CmdUpTo, high, prefix});
+    }
+
+    size_t before = m_journal->getSize();
+    if (m_journal->compact(live)) {
+      NDN_LOG_INFO("Compacted state journal from " << before << " to " << m_journal->getSize() << " bytes");
+    }
+  }
+
+  // Partial sync: the hello lists the publisher's objects; it is repeated to find new ones
+  void sendHello()
+  {
+    m_consumer->sendHelloInterest();
+    m_helloEvent = m_scheduler.schedule(HELLO_INTERVAL, [this] { sendHello(); });
+  }
+
+  // Subscribe to the objects the subscription rules allow and drop the ones they no longer do
+  void processHelloData(const std::map<ndn::Name, uint64_t>& available)
+  {
+    auto subs = std::atomic_load(&m_subs);
+    bool changed = false;
+
+    for (const auto& [prefix, ts] : available) {
+      bool wanted = subs->match(prefix) != nullptr;
+      if (wanted && !m_consumer->isSubscribed(prefix)) {
+        // Reports the current version as an update, so objects we lack are fetched right away
+        m_consumer->addSubscription(prefix, ts, true);
+        changed = true;
+      }
+      else if (!wanted && m_consumer->isSubscribed(prefix)) {
+        m_consumer->removeSubscription(prefix);
+        changed = true;
+      }
+    }
+
+    size_t nSubscribed = m_consumer->getSubscriptionList().size();
+    if (nSubscribed > PARTIAL_BF_COUNT) {
+      NDN_LOG_WARN(nSubscribed << " subscriptions exceed --partial-subs " << PARTIAL_BF_COUNT
+                   << ", sync Interests will match extra objects");
+    }
+
+    // The sync Interest carries the subscription Bloom filter, so it is re-sent when that changes
+    if (changed || !m_syncStarted) {
+      m_syncStarted = true;
+      NDN_LOG_INFO("Partial sync: " << nSubscribed << " of " << available.size() << " objects subscribed");
+      m_consumer->sendSyncInterest();
+    }
+  }
+
+  // Partial sync names the object and carries its timestamp as the sequence number
+  void processPartialUpdate(const std::vector<psync::MissingDataInfo>& updates)
+  {
+    std::vector<psync::MissingDataInfo> versioned;
+    versioned.reserve(updates.size());
+    for (const auto& update : updates) {
+      psync::MissingDataInfo info = update;
+      info.prefix = ndn::Name(update.prefix).append(
+        ndn::name::Component::fromNumber(update.highSeq, ndn::tlv::TimestampNameComponent));
+      info.lowSeq = info.highSeq = 1;
+      versioned.push_back(std::move(info));
     }
+    processSyncUpdate(versioned);
   }
 
   void processSyncUpdate(const std::vector<psync::MissingDataInfo>& updates)
   {
-    
+    auto start = std::chrono::steady_clock::now();
+    m_updatesReceived.inc(updates.size());
     for (const auto& update : updates) {
       m_state[update.prefix] = update.highSeq;
+      if (m_journal) {
+        m_journal->append({StateJournal::Type::State, update.highSeq, update.prefix.toUri()});
+      }
     }
+    compactJournalIfNeeded();
 
     for (const auto& update : updates) {
-      for (uint64_t i = update.lowSeq; i <= update.highSeq; ++i) {
-        NDN_LOG_INFO("Received update: " << update.prefix << "/" << i);
-        // Optional: React to update, fetch content, notify, etc.
-
-        ndn::Name name = update.prefix;
-        //name.appendSegment(i-1);
-
-        std::cout << termcolor::on_white << termcolor::blue << "Update received: " << name << termcolor::reset << std::endl;
-        //std::cout << "Update received: " << name << std::endl;
-
-        std::string logfile = sanitizeName(name.toUri());
-        perfLog(logfile, "PSYNC_UPDATE", name.toUri());
-        
-        bool hostnameMatch = true;
-        if (!m_hostname.empty()) {
-          std::string firstComp = name.size() > 0 ? name.at(0).toUri() : "";
-          hostnameMatch = (firstComp == m_hostname);
-        }
+      NDN_LOG_INFO("Received update: " << update.prefix << "/" << update.lowSeq << "-" << update.highSeq);
+
+      perfLog("PSYNC_UPDATE", update.prefix.toUri());
+    }
+
+    // One entry per object at its newest version; older versions in the batch are dropped here
+    auto batch = m_coalescer.coalesce(updates);
+    for (const auto& dropped : batch.dropped) {
+      perfLog("UPDATE_COALESCED", dropped.toUri());
+    }
+    m_updatesCoalesced.inc(batch.dropped.size());
+
+    handleUpdates(batch.updates);
 
-        bool subsMatch = false;
-        if (!m_allowedPrefixes.empty()) {
-          for (const auto& p : m_allowedPrefixes) {
-            if (p.isPrefixOf(name)) {
-              subsMatch = true;
-              break;
+    psync::detail::State curState;
+    for (const auto& [prefix, seq] : m_state) {
+      if (seq != 0) {
+        curState.addContent(ndn::Name(prefix).appendNumber(seq));
+      }
+    }
+    std::cout << termcolor::blue << "\n--- [SyncState] ---\n" << curState << "\n-------------------\n" << termcolor::reset << std::endl;
+    printCoalesceStats();
+    printExecutorStats();
+    //std::cout << "[SyncState] " << curState << std::endl;
+    m_syncUpdateTime.record(std::chrono::steady_clock::now() - start);
+  }
+
+  // Fetch each update that a subscription rule allows
+  void handleUpdates(const std::vector<UpdateCoalescer::Update>& updates)
+  {
+    auto subs = std::atomic_load(&m_subs);
+
+    for (const auto& update : updates) {
+      // Optional: React to update, fetch content, notify, etc.
+
+      const ndn::Name& name = update.name;
+
+      std::cout << termcolor::on_white << termcolor::blue << "Update received: " << name << termcolor::reset << std::endl;
+      //std::cout << "Update received: " << name << std::endl;
+      
+      const SubsMatcher::Rule* rule = subs->match(name);
+      if (rule == nullptr) {
+        m_updatesIgnored.inc();
+        rememberIgnored(update);
+        std::cout << termcolor::yellow << "Ignoring update for " << name << " on host " << m_hostname << termcolor::reset << std::endl;
+        // std::cout << "PSync update received but ignored due to hostname and subscription mismatch: " << name << std::endl;
+        continue;
+      }
+      NDN_LOG_DEBUG("Update " << name << " matched " << SubsMatcher::toString(rule->kind) << " rule " << rule->prefix);
+
+      const ndn::Name& genericPrefix = update.genericPrefix;
+
+      std::string currentName = name.toUri();
+      currentName.erase(std::remove_if(currentName.begin(), currentName.end(), ::isspace), currentName.end());
+
+      uint64_t curTs = extractTimestamp(currentName);
+
+      // Only go back to the repo DB when the index is behind, e.g. for objects
+      // update-repo-file.py inserted on this node. The query runs on the prefix's shard;
+      // later updates of the prefix that also need it queue behind it there.
+      uint64_t latestTs = m_versions.latest(genericPrefix);
+      auto kind = rule->kind;
+      if (latestTs < curTs) {
+        auto queued = std::chrono::steady_clock::now();
+        m_shards.post(genericPrefix, [this, update, kind, currentName, curTs, queued] {
+          auto start = std::chrono::steady_clock::now();
+          auto newest = m_versions.readLatest(update.genericPrefix);
+          trace("shard-queue", currentName, queued, start);
+          trace("index-read", currentName, start);
+          boost::asio::post(m_face.getIoContext(), [this, update, kind, currentName, curTs, newest] () mutable {
+            // A version inserted while the query ran is newer than what it read
+            if (newest && *newest < m_versions.latest(update.genericPrefix)) {
+              newest.reset();
             }
-          }
-        }
+            admitUpdate(update, kind, currentName, curTs, m_versions.applyLatest(update.genericPrefix, newest));
+          });
+        });
+        continue;
+      }
+      admitUpdate(update, kind, currentName, curTs, latestTs);
+    }
+  }
 
-        if (!hostnameMatch && !subsMatch) {
-          std::cout << termcolor::yellow << "Ignoring update for " << name << " on host " << m_hostname << termcolor::reset << std::endl;
-          // std::cout << "PSync update received but ignored due to hostname and subscription mismatch: " << name << std::endl;
-          continue;
-        }
+  // Fetch an update the subscriptions allow (by a rule of kind), given the latest version the repo holds
+  void admitUpdate(const UpdateCoalescer::Update& update, SubsMatcher::Rule::Kind kind,
+                   const std::string& currentName, uint64_t curTs, uint64_t latestTs)
+  {
+    const ndn::Name& name = update.name;
+    const ndn::Name& genericPrefix = update.genericPrefix;
+    std::string latest = latestTs == 0 ? "" : genericPrefix.toUri() + "/t=" + std::to_string(latestTs);
+
+    //bool isCmd = (genericPrefix.toUri().rfind("/cmd", 0) == 0);
+    bool isCmd = false;
+    std::string targetHost;
+
+    // Recognize generic commands: /cmd/<script>
+    // or host specific commands: /cmd/<host>/<script> or /<host>/cmd/<script>
+    if (name.size() > 0 && name.at(0).toUri() == "cmd") {
+      isCmd = true;
+      if (genericPrefix.size() > 2) {
+        targetHost = name.at(1).toUri();
+      }
+    }
+    else if (name.size() > 1 && name.at(1).toUri() == "cmd") {
+      isCmd = true;
+      if (genericPrefix.size() > 2) {
+        targetHost = name.at(0).toUri();
+      }
+    }
 
-        ndn::Name genericPrefix;
-        for (const auto& comp : name) {
-          if (comp.isGeneric()) {
-            genericPrefix.append(comp);
-          } else {
-            break;
-          }
+    if (isCmd && !targetHost.empty() && !m_hostname.empty() && targetHost != m_hostname) {
+      m_updatesIgnored.inc();
+      std::cout << termcolor::yellow << "Ignoring host-specific command for "
+                << targetHost << termcolor::reset << std::endl;
+      return;
+    }
+    // If this update carries a command we've already fetched, still run
+    // the script once per timestamp without refetching
+    if (!latest.empty() && latestTs >= curTs) {
+      m_updatesCurrent.inc();
+      std::cout << termcolor::yellow << "[Skip] Already have latest version: " << latest << termcolor::reset << std::endl;
+
+      if (isCmd) {
+        auto [pfx, file, t] = splitNameComponents(name);
+        runCommand(genericPrefix, curTs, currentName, file);
+      }
+
+      return;
+    }
+
+    // A fetch of this or a newer version may already be pending; an older scheduled one is cancelled.
+    // An older one already fetching finishes first: this version is admitted again once it has
+    // been inserted, with the repo's latest version read then.
+    auto admission = m_coalescer.admit(genericPrefix, curTs);
+    if (admission == UpdateCoalescer::Admission::Stale) {
+      m_updatesCoalesced.inc();
+      std::cout << termcolor::yellow << "[Skip] Newer or same version already pending: " << currentName << termcolor::reset << std::endl;
+      perfLog("UPDATE_COALESCED", currentName);
+      return;
+    }
+    if (admission == UpdateCoalescer::Admission::Chained) {
+      perfLog("UPDATE_CHAINED", currentName);
+      m_coalescer.chain(genericPrefix, curTs, [this, update, kind, currentName, curTs] {
+        admitUpdate(update, kind, currentName, curTs, m_versions.latest(update.genericPrefix));
+      });
+      return;
+    }
+
+    if (!latest.empty()) {
+      deleteFromRepo(latest);
+    }
+
+    FetchTask task{name, genericPrefix, curTs, currentName, isCmd,
+                   fetchPriority(genericPrefix, isCmd, kind == SubsMatcher::Rule::Kind::Hostname)};
+
+    // Step 1: erase from CS using generic prefix; the fetch starts as soon as NFD confirms it
+    m_executor.submit(WorkExecutor::Stage::Erase, genericPrefix, curTs, [this, task] (WorkExecutor::Done done) {
+      auto start = std::chrono::steady_clock::now();
+      m_csEraser.erase(task.genericPrefix, [this, task, done, start] (bool ok, uint64_t nErased) {
+        done();
+        m_eraseLatency.record(std::chrono::steady_clock::now() - start);
+        trace("cs-erase", task.currentName, start, "ok=" + std::to_string(ok) + " erased=" + std::to_string(nErased));
+        if (ok) {
+          perfLog("CS_ERASED", task.currentName, std::to_string(nErased));
         }
+        else {
+          NDN_LOG_WARN("CS erase failed for " << task.genericPrefix);
+        }
+        startFetch(task, ok ? "erased" : "erase-failed");
+      });
+    });
+
+    // Step 2: fall back to fetching anyway if the erase is never confirmed (queue full, NFD not answering)
+    auto fetchEvent = m_scheduler.schedule(ERASE_WAIT_MAX, [this, task] { startFetch(task, "erase-timeout"); });
+    m_coalescer.scheduled(genericPrefix, curTs, fetchEvent);
+  }
+  
+  // /cmd first, then updates addressed to this host, then other subscribed objects by size. The
+  // local copy of the previous version is the size estimate; a new object counts as small.
+  WorkExecutor::Priority fetchPriority(const ndn::Name& genericPrefix, bool isCmd, bool forHost) const
+  {
+    if (isCmd)
+      return WorkExecutor::Priority::Cmd;
+    if (forHost)
+      return WorkExecutor::Priority::Host;
+
+    std::error_code ec;
+    auto size = fs::file_size(WATCH_DIR.string() + genericPrefix.toUri(), ec);
+    return !ec && size >= BULK_SIZE ? WorkExecutor::Priority::Bulk : WorkExecutor::Priority::Subs;
+  }
 
-        std::string latest = execCmd("python3 get-latest.py -n " + genericPrefix.toUri());
-        
-        std::string currentName = name.toUri();
-        currentName.erase(std::remove_if(currentName.begin(), currentName.end(), ::isspace), currentName.end());
+  // Runs once per pending version, from the erase confirmation or the fallback timer, whichever is first
+  void startFetch(const FetchTask& task, const std::string& trigger)
+  {
+    if (!m_coalescer.start(task.genericPrefix, task.timestamp))
+      return;
+
+    perfLog("FETCH_READY", task.currentName, trigger);
+    trace("wait-ready", task.currentName, task.admitted, "trigger=" + trigger);
+    attemptFetch(task, 1);
+  }
 
-        uint64_t curTs = extractTimestamp(currentName);
-        uint64_t latestTs = extractTimestamp(latest);
+  // Probe for the first segment, then fetch the whole object; either failing is retried
+  void attemptFetch(const FetchTask& task, int attempt)
+  {
+    if (!m_coalescer.isPending(task.genericPrefix, task.timestamp)) {
+      // A newer version arrived while this one waited to retry; let it go ahead
+      perfLog("FETCH_SUPERSEDED", task.currentName, "attempt=" + std::to_string(attempt));
+      m_coalescer.finished(task.genericPrefix, task.timestamp);
+      return;
+    }
 
-        //bool isCmd = (genericPrefix.toUri().rfind("/cmd", 0) == 0);
-        bool isCmd = false;
-        std::string targetHost;
+    auto submitted = std::chrono::steady_clock::now();
+    auto result = m_executor.submit(WorkExecutor::Stage::Fetch, task.genericPrefix, task.timestamp,
+      [this, task, attempt, submitted] (WorkExecutor::Done done) {
+        auto start = std::chrono::steady_clock::now();
+        std::string priority = WorkExecutor::toString(task.priority);
+        m_fetchQueueDelay[static_cast<size_t>(task.priority)]->record(start - submitted);
+        perfLog("QUEUE_DELAY", task.currentName, "priority=" + priority + " wait_ms=" +
+                std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(start - submitted).count()) +
+                " attempt=" + std::to_string(attempt));
+        trace("fetch-queue", task.currentName, submitted, start, "priority=" + priority);
+        probe(task.name, [this, task, attempt, done, start] (const ndn::Data* data, const std::string& reason) {
+          if (data == nullptr) {
+            done();
+            trace("probe", task.currentName, start,
+                  "attempt=" + std::to_string(attempt) + " ok=0 reason=" + reason);
+            retryFetch(task, attempt, reason);
+            return;
+          }
 
-        // Recognize generic commands: /cmd/<script>
-        // or host specific commands: /cmd/<host>/<script> or /<host>/cmd/<script>
-        if (name.size() > 0 && name.at(0).toUri() == "cmd") {
-          isCmd = true;
-          if (genericPrefix.size() > 2) {
-            targetHost = name.at(1).toUri();
+          // A compressed object starts with the codec header; one that answered with another segment is unknown
+          FetchTask probed = task;
+          const auto& last = data->getName().at(-1);
+          if (last.isSegment() && last.toSegment() == 0) {
+            auto content = data->getContent().value_bytes();
+            probed.compressed = codec::declaredSize(content.data(), content.size()).has_value();
           }
+
+          fetchObject(probed, [this, task, attempt, done, start] (bool ok, std::shared_ptr<Segments> segments) {
+            done();
+            trace("fetch", task.currentName, start, "attempt=" + std::to_string(attempt) + " ok=" + std::to_string(ok));
+            if (!ok) {
+              retryFetch(task, attempt, "fetch-error");
+              return;
+            }
+            m_fetchLatency.record(std::chrono::steady_clock::now() - start);
+            m_updatesFetched.inc();
+            insertFetched(task.name, task.genericPrefix, task.timestamp, task.currentName, task.isCmd,
+                          task.admitted, std::move(segments));
+          });
+        });
+      }, task.priority);
+
+    if (result == WorkExecutor::Submitted::Superseded) {
+      perfLog("FETCH_SUPERSEDED", task.currentName, "attempt=" + std::to_string(attempt));
+      m_updatesCoalesced.inc();
+      m_coalescer.finished(task.genericPrefix, task.timestamp);
+    }
+    else if (result == WorkExecutor::Submitted::Rejected) {
+      NDN_LOG_WARN("Fetch queue full, dropping " << task.name);
+      m_updatesDropped.inc();
+      m_coalescer.finished(task.genericPrefix, task.timestamp);
+    }
+  }
+
+  // Bounded exponential backoff with jitter: half the step plus a random part of the other half
+  void retryFetch(const FetchTask& task, int attempt, const std::string& reason)
+  {
+    if (attempt >= FETCH_MAX_ATTEMPTS) {
+      NDN_LOG_WARN("Giving up on " << task.name << " after " << attempt << " attempts (" << reason << ")");
+      perfLog("FETCH_FAILED", task.currentName, "attempts=" + std::to_string(attempt) + " reason=" + reason);
+      m_updatesFailed.inc();
+      m_coalescer.finished(task.genericPrefix, task.timestamp);
+      return;
+    }
+
+    auto step = std::min(FETCH_BACKOFF_MAX, FETCH_BACKOFF_BASE * (1 << std::min(attempt - 1, 16)));
+    auto wait = step / 2 + ndn::time::milliseconds(ndn::random::generateWord32() % (step.count() / 2 + 1));
+
+    perfLog("FETCH_RETRY", task.currentName, "attempt=" + std::to_string(attempt + 1) +
+            " wait_ms=" + std::to_string(wait.count()) + " reason=" + reason);
+    m_scheduler.schedule(wait, [this, task, attempt] { attemptFetch(task, attempt + 1); });
+  }
+
+  // One Interest for the object (CanBePrefix) to see whether any producer can serve it yet;
+  // onDone gets the Data that answered, or nullptr and the reason
+  void probe(const ndn::Name& name, std::function<void(const ndn::Data*, const std::string&)> onDone)
+  {
+    ndn::Interest interest(name);
+    interest.setCanBePrefix(true);
+    interest.setInterestLifetime(PROBE_LIFETIME);
+
+    m_face.expressInterest(interest,
+      [onDone] (const ndn::Interest&, const ndn::Data& data) { onDone(&data, ""); },
+      [onDone] (const ndn::Interest&, const ndn::lp::Nack&) { onDone(nullptr, "nack"); },
+      [onDone] (const ndn::Interest&) { onDone(nullptr, "timeout"); });
+  }
+
+  // Parse SUBSFILE off the event loop and swap the new rules in atomically
+  void reloadSubs()
+  {
+    if (m_subsReloadThread.joinable()) {
+      m_subsReloadQueued = true; // the running reload may have read the old content
+      return;
+    }
+
+    m_subsReloadThread = std::thread([this] {
+      auto subs = std::make_shared<SubsMatcher>();
+      long nSubs = -1;
+      try {
+        subs->setHostname(m_hostname);
+        nSubs = subs->loadFile(SUBSFILE);
+      }
+      catch (const std::exception& e) {
+        // An exception escaping this thread would terminate psync-start
+        NDN_LOG_WARN("Reloading " << SUBSFILE << " failed: " << e.what());
+      }
+      if (nSubs >= 0) {
+        std::atomic_store(&m_subs, std::shared_ptr<const SubsMatcher>(std::move(subs)));
+      }
+
+      boost::asio::post(m_face.getIoContext(), [this, nSubs] {
+        m_subsReloadThread.join();
+
+        if (nSubs < 0) {
+          std::cerr << "[Warn] unable to reload " << SUBSFILE << ", keeping previous subscriptions" << std::endl;
         }
-        else if (name.size() > 1 && name.at(1).toUri() == "cmd") {
-          isCmd = true;
-          if (genericPrefix.size() > 2) {
-            targetHost = name.at(0).toUri();
+        else {
+          std::cout << termcolor::green << "Reloaded " << nSubs << " subscription prefixes from " << SUBSFILE << termcolor::reset << std::endl;
+          if (SUBS_CATCH_UP) {
+            catchUpIgnored();
+          }
+          if (m_consumer) {
+            // Subscribe to what the new rules allow without waiting for the next hello
+            m_consumer->sendHelloInterest();
           }
         }
 
-        if (isCmd && !targetHost.empty() && !m_hostname.empty() && targetHost != m_hostname) {
-          std::cout << termcolor::yellow << "Ignoring host-specific command for "
-                    << targetHost << termcolor::reset << std::endl;
-          continue;
+        if (m_subsReloadQueued) {
+          m_subsReloadQueued = false;
+          reloadSubs();
         }
-        // If this update carries a command we've already fetched, still run
-        // the script once per timestamp without refetching
-        if (!latest.empty() && latestTs >= curTs) {
-          std::cout << termcolor::yellow << "[Skip] Already have latest version: " << latest << termcolor::reset << std::endl;
-
-          if (isCmd && m_executedCmds.find(currentName) == m_executedCmds.end()) {
-            auto [pfx, file, t] = splitNameComponents(name);
-            executeCommand(file);
-            m_executedCmds.insert(currentName);
+      });
+    });
+  }
+
+  // Keep the newest ignored version of each object so a later subscription can fetch it
+  void rememberIgnored(const UpdateCoalescer::Update& update)
+  {
+    auto it = m_ignored.find(update.genericPrefix);
+    if (it != m_ignored.end()) {
+      if (update.timestamp > it->second.timestamp) {
+        it->second = update;
+      }
+    }
+    else if (m_ignored.size() < MAX_IGNORED) {
+      m_ignored.emplace(update.genericPrefix, update);
+    }
+  }
+
+  // Fetch previously ignored updates that the reloaded subscriptions now allow
+  void catchUpIgnored()
+  {
+    auto subs = std::atomic_load(&m_subs);
+    std::vector<UpdateCoalescer::Update> allowed;
+
+    for (auto it = m_ignored.begin(); it != m_ignored.end(); ) {
+      if (subs->match(it->second.name) != nullptr) {
+        allowed.push_back(it->second);
+        it = m_ignored.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+
+    if (allowed.empty())
+      return;
+
+    std::cout << termcolor::green << "Catching up on " << allowed.size() << " previously ignored updates" << termcolor::reset << std::endl;
+    for (const auto& update : allowed) {
+      perfLog("SUBS_CATCH_UP", update.name.toUri());
+    }
+    handleUpdates(allowed);
+  }
+
+  // Put a fetched file into the local repo through the insert stage, then run it if it is a /cmd.
+  // Segments kept from the fetch are inserted as they are; otherwise the file is re-segmented.
+  void insertFetched(const ndn::Name& name, const ndn::Name& genericPrefix, uint64_t curTs,
+                     const std::string& currentName, bool isCmd,
+                     std::chrono::steady_clock::time_point admitted, std::shared_ptr<Segments> segments)
+  {
+    auto [prefix, filepath, timestamp] = splitNameComponents(name);
+    auto submitted = std::chrono::steady_clock::now();
+
+    auto result = m_executor.submit(WorkExecutor::Stage::Insert, genericPrefix, curTs,
+      [=, prefix = prefix, filepath = filepath, timestamp = timestamp] (WorkExecutor::Done done) {
+        auto start = std::chrono::steady_clock::now();
+        trace("insert-queue", currentName, submitted, start);
+        auto onInserted = [=] {
+          done();
+          auto now = std::chrono::steady_clock::now();
+          m_insertLatency.record(now - start);
+          m_updateLatency.record(now - admitted);
+          trace("insert", currentName, start, now);
+          trace("update", currentName, admitted, now);
+          m_coalescer.finished(genericPrefix, curTs);
+
+          if (isCmd) {
+            runCommand(genericPrefix, curTs, currentName, filepath);
           }
+        };
 
-          continue;
+        if (segments && !segments->empty()) {
+          insertSegments(std::move(*segments), filepath, prefix, timestamp, onInserted);
         }
-
-        if (!latest.empty()) {
-          std::thread([latest] {
-            deleteFromRepo(latest);
-          }).detach();
+        else {
+          putFile(filepath, prefix, timestamp, onInserted);
         }
+      });
 
-        // Step 1: erase from CS asynchronously using generic prefix
-        std::thread([pref = genericPrefix.toUri()] {
-          std::string cmd = "nfdc cs erase " + pref + " > /dev/null 2>&1";
-          int result = std::system(cmd.c_str());
-          if (result != 0) {
-            NDN_LOG_WARN("CS erase failed for " << pref);
-          }
-        }).detach();
-        
-        // Step 2: schedule fetch and repo insert without blocking main loop
-        m_scheduler.schedule(ndn::time::milliseconds(500), [this, name, currentName, isCmd] {
-          std::thread([this, name, currentName, isCmd] {
-            if (fetchFile(name)) {
-              auto [prefix, filepath, timestamp] = splitNameComponents(name);
-              putFile(filepath, prefix, timestamp);
-
-              if (isCmd && m_executedCmds.find(currentName) == m_executedCmds.end()) {
-                executeCommand(filepath);
-                m_executedCmds.insert(currentName);
-              }
+    if (result != WorkExecutor::Submitted::Queued) {
+      NDN_LOG_WARN("Insert queue full, dropping " << name);
+      m_updatesDropped.inc();
+      m_coalescer.finished(genericPrefix, curTs);
+    }
+  }
 
-            }
-          }).detach();
-        });
-      }
+  // Run a /cmd script once per versioned name on a cmd worker
+  void runCommand(const ndn::Name& genericPrefix, uint64_t curTs,
+                  const std::string& currentName, const std::string& filepath)
+  {
+    std::string prefix = genericPrefix.toUri();
+    if (m_cmds.isExecuted(prefix, curTs)) {
+      NDN_LOG_DEBUG("Command " << currentName << " already executed");
+      return;
     }
-    psync::detail::State curState;
-    for (const auto& [prefix, seq] : m_state) {
-      if (seq != 0) {
-        curState.addContent(ndn::Name(prefix).appendNumber(seq));
+
+    auto result = m_executor.submit(WorkExecutor::Stage::Cmd, genericPrefix, curTs,
+      [this, filepath, currentName] (WorkExecutor::Done done) {
+        auto start = std::chrono::steady_clock::now();
+        int status = executeCommand(filepath);
+        trace("cmd", currentName, start, "status=" + std::to_string(status));
+        done();
+      });
+
+    // Recorded only once queued, so a command dropped by a full queue can still run when seen again
+    if (result != WorkExecutor::Submitted::Queued) {
+      NDN_LOG_WARN("Cmd queue full, not running " << currentName);
+      return;
+    }
+    m_cmds.markExecuted(prefix, curTs);
+    if (m_journal) {
+      m_journal->append({StateJournal::Type::Cmd, curTs, prefix});
+    }
+  }
+
+  void printExecutorStats() const
+  {
+    std::cout << termcolor::blue << "--- [Executor] ---" << termcolor::reset << std::endl;
+    for (size_t i = 0; i < WorkExecutor::N_STAGES; ++i) {
+      auto stage = static_cast<WorkExecutor::Stage>(i);
+      auto stats = m_executor.getStats(stage);
+      std::cout << termcolor::blue << WorkExecutor::toString(stage)
+                << " queued=" << stats.queued << " inFlight=" << stats.inFlight
+                << " maxQueued=" << stats.maxQueued << " completed=" << stats.completed
+                << " replaced=" << stats.replaced << " rejected=" << stats.rejected << " aged=" << stats.aged
+                << termcolor::reset << std::endl;
+    }
+
+    const auto& erase = m_csEraser.getStats();
+    std::cout << termcolor::blue << "cs-erase requested=" << erase.requested << " commands=" << erase.commands
+              << " coalesced=" << erase.coalesced << " erased=" << erase.erased << " failed=" << erase.failed
+              << termcolor::reset << std::endl;
+
+    const auto& cmds = m_cmds.getStats();
+    std::cout << termcolor::blue << "cmd executed=" << cmds.executed << " repeated=" << cmds.repeated
+              << " prefixes=" << m_cmds.getPrefixCount() << " evicted=" << cmds.evicted
+              << " rotations=" << cmds.rotations << " bytes=" << m_cmds.getMemoryUsage()
+              << termcolor::reset << std::endl;
+
+    if (m_chunkServer) {
+      const auto& served = m_chunkServer->getStats();
+      const auto& stored = m_chunks.getStats();
+      std::cout << termcolor::blue << "chunks added=" << stored.added << " reused=" << stored.reused
+                << " served=" << served.chunks << " recipes=" << served.recipes << " misses=" << served.misses
+                << termcolor::reset << std::endl;
+    }
+  }
+
+  // Per-prefix count of updates that were not fetched because of coalescing
+  void printCoalesceStats()
+  {
+    // Only the prefixes counted since the last batch, not every object ever seen
+    bool header = false;
+    for (const auto& prefix : m_coalescer.takeChanged()) {
+      const auto* stats = m_coalescer.getStats(prefix);
+      if (!stats)
+        continue;
+      if (!header) {
+        std::cout << termcolor::blue << "--- [Coalesced] ---" << termcolor::reset << std::endl;
+        header = true;
       }
+      std::cout << termcolor::blue << prefix << " duplicates=" << stats->duplicates
+                << " superseded=" << stats->superseded << " cancelled=" << stats->cancelled
+                << " chained=" << stats->chained
+                << termcolor::reset << std::endl;
     }
-    std::cout << termcolor::blue << "\n--- [SyncState] ---\n" << curState << "\n-------------------\n" << termcolor::reset << std::endl;
-    //std::cout << "[SyncState] " << curState << std::endl;
   }
-  
-  bool fetchFile(const ndn::Name& name)
+
+  // Chunk fetch (--chunks), else segment delta against the local copy, else every segment
+  // FETCH_START / FETCH_DONE bracket the fetch whatever the mode, with mode=chunks|delta|full in the
+  // detail: the mode tried first, and the one that completed after any fallback
+  void fetchObject(const FetchTask& task, FetchDone onDone)
+  {
+    if (CHUNK_SYNC) {
+      perfLog("FETCH_START", task.currentName, "mode=chunks");
+      fetchChunks(task, onDone);
+      return;
+    }
+    perfLog("FETCH_START", task.currentName, canFetchDelta(task) ? "mode=delta" : "mode=full");
+    fetchDelta(task, onDone);
+  }
+
+  // Fetch the recipe and only the chunks the local store lacks, then assemble the file from the store
+  void fetchChunks(const FetchTask& task, FetchDone onDone)
   {
-    std::string logfile = sanitizeName(name.toUri());
-    perfLog(logfile, "FETCH_START", name.toUri());
+    auto [prefix, filepath, timestamp] = splitNameComponents(task.name);
+    fs::path target(filepath);
+    fs::path partial = target.parent_path() / ("." + target.filename().string() + ".part");
+
+    std::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+    notifyWatcher("LOCK:", target);
+    perfLog("CHUNK_START", task.currentName);
+
+    ChunkFetcher::start(m_face, m_validator, m_chunks,
+                        ChunkStore::recipeName(task.genericPrefix).append(
+                          ndn::name::Component::fromNumber(task.timestamp, ndn::tlv::TimestampNameComponent)),
+                        partial.string(), FETCH_WINDOW > 0 ? FETCH_WINDOW : DELTA_WINDOW,
+                        offloadTo(task.genericPrefix),
+      [=] (const ChunkFetcher::Result& result) {
+        m_fetchedBytes.inc(result.bytes);
+        std::error_code ec;
+        if (result.ok) {
+          fs::rename(partial, target, ec);
+        }
+        notifyWatcher("UNLOCK:", target);
+
+        if (!result.ok || ec) {
+          perfLog("CHUNK_FALLBACK", task.currentName, result.ok ? "rename-error" : result.reason);
+          fetchDelta(task, onDone);
+          return;
+        }
+
+        // Serve this version's recipe; its chunks are already in the store. Saved on the prefix's shard
+        // ahead of anything the insert posts there, such as publishRecipe()'s check for it.
+        m_shards.post(task.genericPrefix, [this, task, recipe = *result.recipe] {
+          m_chunks.saveRecipe(task.genericPrefix, task.timestamp, recipe);
+        });
+
+        std::cout << termcolor::green << "[Chunks] " << task.currentName << ": fetched " << result.fetched
+                  << " of " << result.total << " chunks" << termcolor::reset << std::endl;
+        std::string counts = "fetched=" + std::to_string(result.fetched) + " total=" + std::to_string(result.total);
+        perfLog("CHUNK_DONE", task.currentName, counts);
+        perfLog("FETCH_DONE", task.currentName, "mode=chunks " + counts);
+        onDone(true, nullptr);
+      });
+  }
 
-    std::string cmd = "python3 " + GETFILE + " -r bmw -n " + name.toUri() + " > /dev/null 2>&1";
-    int ret = std::system(cmd.c_str());
+  // Whether fetchDelta() will try a delta fetch before fetching every segment
+  bool canFetchDelta(const FetchTask& task)
+  {
+    auto [prefix, filepath, timestamp] = splitNameComponents(task.name);
+    // Compressed objects have no manifest (it would describe the compressed segments), so skip the
+    // manifest fetch when the object is known to be compressed. Otherwise a missing manifest only
+    // costs DeltaFetcher's manifest timeout before the full fetch.
+    return DELTA_SYNC && !task.compressed.value_or(false) && fs::is_regular_file(filepath);
+  }
 
-    if (ret == 0) {
-      //std::cout << "Fetched file via getfile.py: " << name << std::endl;
-      perfLog(logfile, "FETCH_DONE", name.toUri());
-      return true;
+  // Delta-fetch against the local copy when there is one, otherwise fetch every segment
+  void fetchDelta(const FetchTask& task, FetchDone onDone)
+  {
+    if (!canFetchDelta(task)) {
+      fetchFile(task.name, onDone);
+      return;
     }
-    else {
-      NDN_LOG_WARN("getfile.py failed for " << name);
-      return false;
+
+    auto [prefix, filepath, timestamp] = splitNameComponents(task.name);
+
+    fs::path target(filepath);
+    fs::path partial = target.parent_path() / ("." + target.filename().string() + ".part");
+    notifyWatcher("LOCK:", target);
+    perfLog("DELTA_START", task.currentName);
+
+    DeltaFetcher::start(m_face, m_validator, task.name,
+                        Manifest::makeName(task.genericPrefix).append(
+                          ndn::name::Component::fromNumber(task.timestamp, ndn::tlv::TimestampNameComponent)),
+                        target.string(), partial.string(), FETCH_WINDOW > 0 ? FETCH_WINDOW : DELTA_WINDOW,
+                        offloadTo(task.genericPrefix),
+      [=] (const DeltaFetcher::Result& result) {
+        m_fetchedBytes.inc(result.bytes);
+        std::error_code ec;
+        if (result.ok) {
+          fs::rename(partial, target, ec);
+        }
+        notifyWatcher("UNLOCK:", target);
+
+        if (!result.ok || ec) {
+          // e.g. the publisher does not provide manifests
+          perfLog("DELTA_FALLBACK", task.currentName, result.ok ? "rename-error" : result.reason);
+          fetchFile(task.name, onDone);
+          return;
+        }
+
+        std::cout << termcolor::green << "[Delta] " << task.currentName << ": fetched " << result.fetched
+                  << " of " << result.total << " segments" << termcolor::reset << std::endl;
+        std::string counts = "fetched=" + std::to_string(result.fetched) + " total=" + std::to_string(result.total);
+        perfLog("DELTA_DONE", task.currentName, counts);
+        perfLog("FETCH_DONE", task.currentName, "mode=delta " + counts);
+        onDone(true, nullptr);
+      });
+  }
+
+  // Fetch all segments of name over m_face and write them in order to the WATCH_DIR target,
+  // decompressing on the fly if the object was published with a codec. The file is written once,
+  // through a preallocated .part sibling that is renamed into place when complete, and the
+  // validated segments are handed to onDone so they can go into the local repo unchanged.
+  void fetchFile(const ndn::Name& name, FetchDone onDone)
+  {
+    auto [prefix, filepath, timestamp] = splitNameComponents(name);
+    fs::path target(filepath);
+
+    auto out = std::make_shared<PartialFile>(target);
+    if (!out->isOpen()) {
+      std::cerr << "[Fetch Error] cannot open " << PartialFile::partialPath(target) << std::endl;
+      onDone(false, nullptr);
+      return;
     }
+
+    notifyWatcher("LOCK:", target);
+
+    ndn::SegmentFetcher::Options opts;
+    opts.inOrder = true;
+    if (FETCH_WINDOW > 0) {
+      opts.initCwnd = static_cast<double>(FETCH_WINDOW);
+      opts.useConstantCwnd = true;
+    }
+
+    auto fetcher = ndn::SegmentFetcher::start(m_face, ndn::Interest(name), m_validator, opts);
+
+    auto decoder = std::make_shared<StreamDecoder>([out] (const uint8_t* data, size_t size) {
+      return out->write(data, size);
+    });
+    auto segments = std::make_shared<Segments>();
+
+    fetcher->afterSegmentValidated.connect([this, out, segments] (const ndn::Data& data) {
+      const auto& last = data.getName().at(-1);
+      if (!last.isSegment())
+        return;
+      m_fetchedBytes.inc(data.getContent().value_size());
+      uint64_t seg = last.toSegment();
+
+      // Size the file from the first segment: the codec header, or segment count times segment size
+      if (seg == 0) {
+        auto content = data.getContent().value_bytes();
+        auto rawSize = codec::declaredSize(content.data(), content.size());
+        if (!rawSize && data.getFinalBlock() && data.getFinalBlock()->isSegment())
+          rawSize = (data.getFinalBlock()->toSegment() + 1) * content.size();
+        if (rawSize)
+          out->reserve(*rawSize);
+      }
+
+      // Re-decoding the wire shares its buffer and drops the link-layer tags of the incoming packet
+      segments->emplace(seg, ndn::Data(data.wireEncode()));
+    });
+
+    // A decode or write failure sticks in the decoder and is reported once the fetch completes
+    fetcher->onInOrderData.connect([decoder] (ndn::ConstBufferPtr data) {
+      decoder->feed(data->data(), data->size());
+    });
+
+    fetcher->onInOrderComplete.connect([=] {
+      bool ok = decoder->finish() && out->commit();
+      if (!ok) {
+        out->abort();
+      }
+      notifyWatcher("UNLOCK:", target);
+
+      if (!ok) {
+        NDN_LOG_WARN("Fetch of " << name << " could not be decoded or written to " << target);
+        onDone(false, nullptr);
+        return;
+      }
+      perfLog("FETCH_DONE", name.toUri(), std::string("mode=full codec=") + codec::toString(decoder->getCodec()));
+      onDone(true, segments);
+    });
+
+    fetcher->onError.connect([=] (uint32_t code, const std::string& msg) {
+      out->abort();
+      notifyWatcher("UNLOCK:", target);
+
+      NDN_LOG_WARN("Fetch failed for " << name << " (" << code << "): " << msg);
+      onDone(false, nullptr);
+    });
   }
 
-  void putFile(const std::string& filepath, const std::string& namePrefix, uint64_t timestamp)
+  // Insert the segments of a version fetched in full as they are: already signed by the origin
+  // and already in the published encoding, so the file is neither re-read nor re-segmented
+  void insertSegments(Segments segments, const std::string& filepath, const std::string& namePrefix,
+                      uint64_t timestamp, std::function<void()> onInserted)
   {
-    std::string cmd = "python3 " + PUTFILE +
-                      " -r bmw" +
-                      " -f " + filepath +
-                      " -n " + namePrefix +
-                      " --timestamp " + std::to_string(timestamp) +
-                      " > /dev/null 2>&1";
+    auto first = segments.begin()->second.getContent().value_bytes();
+    bool isRaw = !codec::declaredSize(first.data(), first.size());
+    size_t nSegments = segments.size();
+    // The origin may have used another segment size; our manifest has to describe its segments
+    size_t segmentSize = nSegments > 1 ? first.size() : RepoClient::DEFAULT_SEGMENT_SIZE;
+
+    // A manifest lists the digests of the segments as served, which only match the file if it is raw.
+    // It is digested from the validated segments on the prefix's shard, not from the file, which a
+    // newer version may replace at any time; it is inserted once both it and the object are ready.
+    auto manifest = std::make_shared<std::optional<Segments>>();
+    auto pending = std::make_shared<int>(isRaw ? 2 : 1);
+    auto objectOk = std::make_shared<bool>(false);
+    auto insertManifestWhenReady = [=] {
+      if (--*pending > 0)
+        return;
+      if (*objectOk && *manifest) {
+        insertManifest(std::move(**manifest), ndn::Name(namePrefix), timestamp);
+      }
+    };
+
+    if (isRaw) {
+      // Blocks share their buffers, so this copies no content
+      std::vector<ndn::Block> contents;
+      contents.reserve(nSegments);
+      for (const auto& [segment, data] : segments) {
+        contents.push_back(data.getContent());
+      }
+      m_shards.post(ndn::Name(namePrefix), [=, contents = std::move(contents)] {
+        std::vector<ndn::span<const uint8_t>> spans;
+        spans.reserve(contents.size());
+        for (const auto& content : contents) {
+          spans.emplace_back(content.value_bytes());
+        }
+        auto encoded = Manifest::fromSegments(spans, segmentSize).encode();
+        auto built = std::make_shared<Segments>(
+          RepoClient::makeSegments(encoded, makeManifestName(ndn::Name(namePrefix), timestamp)));
+        boost::asio::post(m_face.getIoContext(), [=] {
+          *manifest = std::move(*built);
+          insertManifestWhenReady();
+        });
+      });
+    }
 
-    // std::cout << "[PutFile] Running: " << cmd << std::endl;
-    int ret = std::system(cmd.c_str());
+    ndn::Name objectName = ndn::Name(namePrefix).append(
+      ndn::name::Component::fromNumber(timestamp, ndn::tlv::TimestampNameComponent));
+    m_repo.insertData(std::move(segments), objectName, [=] (bool ok) {
+      if (!ok) {
+        std::cerr << "[PutFile Error] repo insert failed for " << filepath << std::endl;
+      }
+      else {
+        afterInsert(filepath, namePrefix, timestamp, "segments=" + std::to_string(nSegments));
+      }
+      *objectOk = ok;
+      insertManifestWhenReady();
+      onInserted();
+    });
+  }
+
+  // Insert the fetched file into the local repo; onInserted runs once the repo has answered.
+  // Reading, compressing and signing run on the prefix's shard, the insert on the io thread.
+  void putFile(const std::string& filepath, const std::string& namePrefix, uint64_t timestamp,
+               std::function<void()> onInserted)
+  {
+    auto spec = m_codecs.lookup(ndn::Name(namePrefix));
+    m_shards.post(ndn::Name(namePrefix), [=] {
+      std::ifstream in(filepath, std::ios::binary);
+      std::vector<uint8_t> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      if (!in.good() && !in.eof()) {
+        std::cerr << "[PutFile Error] cannot read " << filepath << std::endl;
+        boost::asio::post(m_face.getIoContext(), onInserted);
+        return;
+      }
+
+      // Compress per the codec rule of the prefix; the object records the codec in its header
+      size_t rawSize = raw.size();
+      Codec used;
+      auto content = codec::encodeObject(spec, std::move(raw), &used);
+      ndn::Name objectName = ndn::Name(namePrefix).append(
+        ndn::name::Component::fromNumber(timestamp, ndn::tlv::TimestampNameComponent));
+      auto segments = std::make_shared<Segments>(RepoClient::makeSegments(content, objectName));
+
+      // A manifest lists the digests of the segments as served, which only match the file if it is raw.
+      // It is made from the bytes read here: the file may be replaced by a newer version by the time
+      // the insert is confirmed.
+      std::shared_ptr<Segments> manifest;
+      if (content.size() == rawSize) {
+        auto encoded = Manifest::fromContent(content, RepoClient::DEFAULT_SEGMENT_SIZE).encode();
+        manifest = std::make_shared<Segments>(RepoClient::makeSegments(encoded, makeManifestName(namePrefix, timestamp)));
+      }
+
+      boost::asio::post(m_face.getIoContext(), [=] {
+        m_repo.insertData(std::move(*segments), objectName, [=] (bool ok) {
+          if (!ok) {
+            std::cerr << "[PutFile Error] repo insert failed for " << filepath << std::endl;
+          }
+          else {
+            afterInsert(filepath, namePrefix, timestamp,
+                        used == Codec::None ? "" : std::string("codec=") + codec::toString(used));
+            if (manifest) {
+              insertManifest(std::move(*manifest), ndn::Name(namePrefix), timestamp);
+            }
+          }
+          onInserted();
+        });
+      });
+    });
+  }
+
+  // Bookkeeping once a fetched version is in the local repo
+  void afterInsert(const std::string& filepath, const std::string& namePrefix, uint64_t timestamp,
+                   const std::string& detail)
+  {
+    m_versions.update(ndn::Name(namePrefix), timestamp);
 
-    if (ret != 0) {
-      std::cerr << "[PutFile Error] putfile.py failed for " << filepath << std::endl;
-    }else{ 
     // Construct the full NDN name with version
     std::string versionedName = namePrefix + "/t=" + std::to_string(timestamp);
 
     // Use NDN name for logfile, not filepath
-    std::string logfile = sanitizeName(versionedName);
-    perfLog(logfile, "FETCHED_FILE_INSERTED", versionedName);
+    perfLog("FETCHED_FILE_INSERTED", versionedName, detail);
+
+    if (CHUNK_SYNC) {
+      publishRecipe(filepath, ndn::Name(namePrefix), timestamp);
     }
   }
 
+  static ndn::Name makeManifestName(const ndn::Name& genericPrefix, uint64_t timestamp)
+  {
+    return Manifest::makeName(genericPrefix).append(
+      ndn::name::Component::fromNumber(timestamp, ndn::tlv::TimestampNameComponent));
+  }
+
+  // Insert the manifest of a version we hold so nodes fetching from us can delta-sync too
+  void insertManifest(Segments segments, const ndn::Name& genericPrefix, uint64_t timestamp)
+  {
+    m_repo.insertData(std::move(segments), makeManifestName(genericPrefix, timestamp), [=] (bool ok) {
+      if (!ok) {
+        NDN_LOG_WARN("Manifest insert failed for " << genericPrefix << "/t=" << timestamp);
+      }
+    });
+  }
+
+  // Chunk a version fetched segment-wise into the store, on the prefix's shard, so nodes fetching
+  // from us can use chunks. A version fetched as chunks already has its recipe.
+  void publishRecipe(const std::string& filepath, const ndn::Name& genericPrefix, uint64_t timestamp)
+  {
+    m_shards.post(genericPrefix, [=] {
+      if (m_chunks.loadRecipe(genericPrefix, timestamp))
+        return;
+      auto recipe = m_chunks.addFile(filepath);
+      if (!recipe || !m_chunks.saveRecipe(genericPrefix, timestamp, *recipe)) {
+        NDN_LOG_WARN("Cannot add " << filepath << " to the chunk store");
+      }
+    });
+  }
+
+  // Runs a fetcher's digesting and file work on the prefix's shard
+  std::function<void(std::function<void()>)> offloadTo(const ndn::Name& genericPrefix)
+  {
+    return [this, genericPrefix] (std::function<void()> task) {
+      m_shards.post(genericPrefix, std::move(task));
+    };
+  }
+
+  // Remove unreferenced chunks on a shard, since it reads every recipe and lists every chunk,
+  // then schedule the next run
+  void collectChunks()
+  {
+    m_shards.post(ndn::Name(CHUNK_STORE_DIR.string()), [this] {
+      auto start = std::chrono::steady_clock::now();
+      size_t removed = m_chunks.gc(CHUNK_GC_GRACE);
+      auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+      boost::asio::post(m_face.getIoContext(), [this, removed, ms] {
+        NDN_LOG_INFO("Chunk GC removed " << removed << " chunks in " << ms.count() << " ms");
+        perfLog("CHUNK_GC", CHUNK_STORE_DIR.string(),
+                "removed=" + std::to_string(removed) + " ms=" + std::to_string(ms.count()));
+        m_chunkGcEvent = m_scheduler.schedule(CHUNK_GC_INTERVAL, [this] { collectChunks(); });
+      });
+    });
+  }
+
   std::tuple<std::string, std::string, uint64_t> splitNameComponents(const ndn::Name& name)
   {
 
@@ -378,7 +1495,8 @@ private:
     return {genericPrefix.toUri(), fullPath, ts};
   }
 
-  void executeCommand(const std::string& filepath)
+  // Returns the script's exit status as reported by std::system
+  int executeCommand(const std::string& filepath)
   {
     std::cout << termcolor::on_blue << termcolor::white << "Executing /cmd..." << termcolor::reset << "\n" << std::endl;
 
@@ -386,51 +1504,195 @@ private:
     //std::system(chmodCmd.c_str());
 
     std::string runCmd = "bash " + filepath;
+    m_childProcesses.add(1);
     int ret = std::system(runCmd.c_str());
+    m_childProcesses.add(-1);
+    m_commandsRun.inc();
     if (ret != 0) {
       std::cerr << "[Cmd Error] failed to run " << filepath << std::endl;
     }
+    return ret;
   }
 
 private:
   ndn::Face m_face;
   ndn::KeyChain m_keyChain;
   ndn::Scheduler m_scheduler{m_face.getIoContext()};
-
-  psync::FullProducer m_producer;
+  boost::asio::signal_set m_signals{m_face.getIoContext(), SIGINT, SIGTERM};
+
+  Metrics m_metrics;
+  std::unique_ptr<MetricsServer> m_metricsServer; // only with --metrics-port
+  std::unique_ptr<Tracer> m_tracer;               // only with --trace
+  boost::asio::signal_set m_traceSignal{m_face.getIoContext()}; // SIGUSR1, only with --trace
+  Metrics::Counter& m_updatesReceived = m_metrics.counter("psync_updates_received_total", "Sync updates received");
+  Metrics::Counter& m_updatesIgnored = m_metrics.counter("psync_updates_total", "Updates by outcome", "outcome=\"ignored\"");
+  Metrics::Counter& m_updatesCurrent = m_metrics.counter("psync_updates_total", "", "outcome=\"current\"");
+  Metrics::Counter& m_updatesCoalesced = m_metrics.counter("psync_updates_total", "", "outcome=\"coalesced\"");
+  Metrics::Counter& m_updatesFetched = m_metrics.counter("psync_updates_total", "", "outcome=\"fetched\"");
+  Metrics::Counter& m_updatesFailed = m_metrics.counter("psync_updates_total", "", "outcome=\"failed\"");
+  Metrics::Counter& m_updatesDropped = m_metrics.counter("psync_updates_total", "", "outcome=\"dropped\"");
+  Metrics::Counter& m_fetchedBytes = m_metrics.counter("psync_fetched_bytes_total", "Content bytes fetched");
+  Metrics::Counter& m_commandsRun = m_metrics.counter("psync_commands_total", "/cmd scripts run");
+  Metrics::Gauge& m_childProcesses = m_metrics.gauge("psync_child_processes", "Child processes running");
+  Metrics::Histogram& m_eraseLatency = m_metrics.histogram("psync_cs_erase_seconds", "CS erase, request to confirmation");
+  Metrics::Histogram& m_fetchLatency = m_metrics.histogram("psync_fetch_seconds", "Successful fetch attempt, probe to last segment");
+  Metrics::Histogram& m_insertLatency = m_metrics.histogram("psync_insert_seconds", "Local repo insert");
+  Metrics::Histogram& m_updateLatency = m_metrics.histogram("psync_update_seconds", "Admitted update to version inserted");
+  std::array<Metrics::Histogram*, WorkExecutor::N_PRIORITIES> m_fetchQueueDelay{}; // set by registerMetrics()
+  Metrics::Histogram& m_syncUpdateTime = m_metrics.histogram("psync_sync_update_handler_seconds", "io-thread time per sync update batch");
+  Metrics::Histogram& m_ioLag = m_metrics.histogram("psync_io_lag_seconds", "How late a periodic io-thread timer fires");
+  ndn::scheduler::ScopedEventId m_ioLagEvent; // only with --metrics-port
+
+  VersionIndex m_versions{REPO_DB_PATH.string()};
+  UpdateCoalescer m_coalescer;
+  CsEraser m_csEraser{m_face, m_keyChain};
+  ChunkStore m_chunks{CHUNK_STORE_DIR};
+  std::unique_ptr<ChunkServer> m_chunkServer; // only with --chunks
+  ndn::scheduler::ScopedEventId m_chunkGcEvent; // only with --chunks
+  codec::PrefixCodecs m_codecs;
+  WorkExecutor m_executor{m_face.getIoContext(), STAGE_CONFIG};
+  RepoClient m_repo{m_face, m_keyChain, REPO_NAME,
+                    ndn::Name("/psync-start_client").appendNumber(ndn::random::generateWord32())};
+  ShardPool m_shards{SHARDS}; // after what its tasks use, so it is joined first
+
+  std::unique_ptr<psync::FullProducer> m_producer; // full sync (default)
+  std::unique_ptr<psync::Consumer> m_consumer;     // --partial
+  ndn::scheduler::ScopedEventId m_helloEvent;
+  bool m_syncStarted = false;
   ndn::Name m_userPrefix;
-  //ndn::security::ValidatorNull m_validator;
+  ndn::security::ValidatorNull m_validator;
   std::string m_hostname;
-  std::vector<ndn::Name> m_allowedPrefixes;
+  std::shared_ptr<const SubsMatcher> m_subs; // swapped by reloadSubs(), read with std::atomic_load
+  std::unique_ptr<FileWatcher> m_subsWatcher;
+  ndn::scheduler::ScopedEventId m_subsReloadEvent;
+  std::thread m_subsReloadThread;
+  bool m_subsReloadQueued = false;
+  std::map<ndn::Name, UpdateCoalescer::Update> m_ignored; // newest ignored version per generic prefix
   std::map<ndn::Name, uint64_t> m_state;
-  std::unordered_set<std::string> m_executedCmds; // Track executed command timestamps to avoid repeat execution
+  CmdHistory m_cmds{CMD_HISTORY};          // /cmd versions executed, so none runs twice
+  std::unique_ptr<StateJournal> m_journal; // m_state and m_cmds, unless --no-journal
 };
 
-std::string execCmd(const std::string& cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-
-    // Open the command for reading
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe) {
-        std::cerr << "[Error] Failed to run command: " << cmd << std::endl;
-        return "";
-    }
-
-    // Read output into result
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-    }
-
-    result.erase(std::remove_if(result.begin(), result.end(), ::isspace), result.end());
-
-    return result;
+void printUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " <sync-prefix> <user-prefix> [--fetch-window <segments>]\n"
+            << "       [--concurrency <erase|delete|fetch|insert|cmd>=<n>]... [--queue-limit <n>] [--catch-up]\n"
+            << "       [--priority-limit <cmd|host|subs|bulk>=<n>]... [--priority-aging <ms>] [--bulk-size <bytes>]\n"
+            << "       [--fetch-attempts <n>] [--no-delta] [--chunks [--chunk-gc-interval <seconds>]]\n"
+            << "       [--partial [--hello-interval <seconds>] [--partial-subs <n>]] [--no-journal]\n"
+            << "       [--cmd-window <seconds>] [--cmd-filter-kib <n>] [--cmd-prefixes <n>] [--metrics-port <port>]\n"
+            << "       [--trace [--trace-spans <n>]] [--shards <n>]\n";
 }
 
 int main(int argc, char* argv[])
 {
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <sync-prefix> <user-prefix>\n";
+  if (argc < 3) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // std::stoul and friends throw on a malformed value; report it with the usage instead of aborting
+  int i = 3;
+  try {
+    for (; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--fetch-window" && i + 1 < argc) {
+        FETCH_WINDOW = std::stoul(argv[++i]);
+      }
+      else if (arg == "--concurrency" && i + 1 < argc) {
+        std::string spec = argv[++i];
+        auto eq = spec.find('=');
+        WorkExecutor::Stage stage;
+        if (eq == std::string::npos || !WorkExecutor::parseStage(spec.substr(0, eq), stage)) {
+          std::cerr << "Invalid --concurrency " << spec << "\n";
+          return 1;
+        }
+        STAGE_CONFIG[static_cast<size_t>(stage)].concurrency = std::stoul(spec.substr(eq + 1));
+      }
+      else if (arg == "--priority-limit" && i + 1 < argc) {
+        std::string spec = argv[++i];
+        auto eq = spec.find('=');
+        WorkExecutor::Priority priority;
+        if (eq == std::string::npos || !WorkExecutor::parsePriority(spec.substr(0, eq), priority)) {
+          std::cerr << "Invalid --priority-limit " << spec << "\n";
+          return 1;
+        }
+        STAGE_CONFIG[static_cast<size_t>(WorkExecutor::Stage::Fetch)].priorityLimit[static_cast<size_t>(priority)] =
+          std::stoul(spec.substr(eq + 1));
+      }
+      else if (arg == "--priority-aging" && i + 1 < argc) {
+        STAGE_CONFIG[static_cast<size_t>(WorkExecutor::Stage::Fetch)].aging = std::chrono::milliseconds(std::stoul(argv[++i]));
+      }
+      else if (arg == "--bulk-size" && i + 1 < argc) {
+        BULK_SIZE = std::stoull(argv[++i]);
+      }
+      else if (arg == "--fetch-attempts" && i + 1 < argc) {
+        FETCH_MAX_ATTEMPTS = std::max(1, std::stoi(argv[++i]));
+      }
+      else if (arg == "--chunks") {
+        CHUNK_SYNC = true;
+      }
+      else if (arg == "--chunk-gc-interval" && i + 1 < argc) {
+        CHUNK_GC_INTERVAL = ndn::time::seconds(std::max(0, std::stoi(argv[++i])));
+      }
+      else if (arg == "--partial") {
+        PARTIAL_SYNC = true;
+      }
+      else if (arg == "--hello-interval" && i + 1 < argc) {
+        HELLO_INTERVAL = ndn::time::seconds(std::max(1, std::stoi(argv[++i])));
+      }
+      else if (arg == "--partial-subs" && i + 1 < argc) {
+        PARTIAL_BF_COUNT = static_cast<uint32_t>(std::max(1ul, std::stoul(argv[++i])));
+      }
+      else if (arg == "--no-delta") {
+        DELTA_SYNC = false;
+      }
+      else if (arg == "--cmd-window" && i + 1 < argc) {
+        CMD_HISTORY.window = std::stoull(argv[++i]);
+      }
+      else if (arg == "--cmd-filter-kib" && i + 1 < argc) {
+        CMD_HISTORY.filterBytes = std::stoul(argv[++i]) * 1024;
+      }
+      else if (arg == "--cmd-prefixes" && i + 1 < argc) {
+        CMD_HISTORY.maxPrefixes = std::stoul(argv[++i]);
+      }
+      else if (arg == "--metrics-port" && i + 1 < argc) {
+        unsigned long port = std::stoul(argv[++i]);
+        if (port > 65535)
+          throw std::out_of_range("port");
+        METRICS_PORT = static_cast<uint16_t>(port);
+      }
+      else if (arg == "--shards" && i + 1 < argc) {
+        SHARDS = std::max(1ul, std::stoul(argv[++i]));
+      }
+      else if (arg == "--trace") {
+        TRACE = true;
+      }
+      else if (arg == "--trace-spans" && i + 1 < argc) {
+        TRACE_SPANS = std::max(1ul, std::stoul(argv[++i]));
+      }
+      else if (arg == "--no-journal") {
+        STATE_JOURNAL = false;
+      }
+      else if (arg == "--catch-up") {
+        SUBS_CATCH_UP = true;
+      }
+      else if (arg == "--queue-limit" && i + 1 < argc) {
+        size_t limit = std::stoul(argv[++i]);
+        for (auto& config : STAGE_CONFIG) {
+          config.queueLimit = limit;
+        }
+      }
+      else {
+        std::cerr << "Unknown option: " << arg << "\n";
+        return 1;
+      }
+    }
+  }
+  catch (const std::logic_error&) {
+    // std::invalid_argument or std::out_of_range; i is at the value
+    std::cerr << "Invalid value for " << argv[i - 1] << ": " << argv[i] << "\n";
+    printUsage(argv[0]);
     return 1;
   }
 
@@ -5,6 +5,13 @@
   <sync-prefix> is the sync binary shared "repo" name. This should not be the same as the actual repo name! 
   <user-prefix> is the file prefix
 
+  Run with --daemon to keep one FullProducer alive and publish prefixes received
+  over a UNIX domain socket. Without it, psync-update hands the prefix to the
+  daemon and waits for its acknowledgement.
+
+  Socket protocol (one request per line):
+    PUBLISH <sync-prefix> <user-prefix>\n  ->  OK <user-prefix> <seq>\n | ERR <reason>\n
+
   @author Waldo Jordaan
 */
 
@@ -15,11 +22,30 @@
 #include <ndn-cxx/util/scheduler.hpp>
 #include <iostream>
 #include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <filesystem>
+#include <sstream>
 #include "termcolor.hpp"
 
 NDN_LOG_INIT(PSync.Update);
 using namespace ndn::time_literals;
 
+namespace fs = std::filesystem;
+using boost::asio::local::stream_protocol;
+
+fs::path PRIMARY_PATH = "/home/brewski";
+fs::path FALLBACK_PATH = "/home/brewski/masters";
+
+// Same tmp directory update-repo-file.py uses for ndn-fetch.sock
+fs::path defaultSocketPath()
+{
+  fs::path base = fs::exists(FALLBACK_PATH) ? FALLBACK_PATH : PRIMARY_PATH;
+  return base / "tmp/psync-update.sock";
+}
+
 class Producer
 {
 public:
@@ -92,19 +118,219 @@ private:
 
 };
 
+/*
+  Long-running publisher: one Face, one KeyChain and one FullProducer for every
+  prefix handed in over the socket, so publishes go out immediately and the node
+  stays a single sync participant.
+*/
+class PublisherDaemon
+{
+public:
+  PublisherDaemon(const ndn::Name& syncPrefix, const fs::path& socketPath)
+    : m_producer(m_face, m_keyChain, syncPrefix, [] {
+        psync::FullProducer::Options opts;
+        opts.syncInterestLifetime = 1600_ms;
+        opts.syncDataFreshness = 1600_ms;
+        return opts;
+      }())
+    , m_syncPrefix(syncPrefix)
+    , m_socketPath(socketPath)
+    , m_acceptor(m_face.getIoContext())
+  {
+    fs::create_directories(m_socketPath.parent_path());
+    fs::remove(m_socketPath); // stale socket from a previous run
+
+    stream_protocol::endpoint ep(m_socketPath.string());
+    m_acceptor.open(ep.protocol());
+    m_acceptor.bind(ep);
+    m_acceptor.listen();
+    accept();
+
+    std::cout << "Publisher daemon for " << m_syncPrefix << " listening on " << m_socketPath << std::endl;
+  }
+
+  ~PublisherDaemon()
+  {
+    std::error_code ec;
+    fs::remove(m_socketPath, ec);
+  }
+
+  void run()
+  {
+    m_face.processEvents();
+  }
+
+private:
+  struct Session
+  {
+    explicit Session(boost::asio::io_context& io)
+      : socket(io)
+    {
+    }
+
+    stream_protocol::socket socket;
+    boost::asio::streambuf buffer;
+  };
+
+  void accept()
+  {
+    auto session = std::make_shared<Session>(m_face.getIoContext());
+    m_acceptor.async_accept(session->socket, [this, session] (const boost::system::error_code& ec) {
+      if (ec == boost::asio::error::operation_aborted)
+        return;
+
+      if (!ec) {
+        read(session);
+      }
+      else {
+        NDN_LOG_WARN("Accept failed: " << ec.message());
+      }
+      accept();
+    });
+  }
+
+  // A client may keep its connection open and send many requests
+  void read(std::shared_ptr<Session> session)
+  {
+    boost::asio::async_read_until(session->socket, session->buffer, '\n',
+      [this, session] (const boost::system::error_code& ec, size_t) {
+        if (ec)
+          return; // client closed
+
+        std::istream is(&session->buffer);
+        std::string line;
+        std::getline(is, line);
+
+        auto reply = std::make_shared<std::string>(handleRequest(line));
+        boost::asio::async_write(session->socket, boost::asio::buffer(*reply),
+          [this, session, reply] (const boost::system::error_code& ec, size_t) {
+            if (!ec)
+              read(session);
+          });
+      });
+  }
+
+  std::string handleRequest(const std::string& line)
+  {
+    std::istringstream is(line);
+    std::string cmd, syncPrefix, userPrefix;
+    is >> cmd >> syncPrefix >> userPrefix;
+
+    if (cmd != "PUBLISH" || userPrefix.empty()) {
+      return "ERR malformed request\n";
+    }
+    if (ndn::Name(syncPrefix) != m_syncPrefix) {
+      return "ERR daemon serves sync prefix " + m_syncPrefix.toUri() + "\n";
+    }
+
+    try {
+      ndn::Name prefix(userPrefix);
+      m_producer.addUserNode(prefix);
+      m_producer.publishName(prefix);
+
+      uint64_t seqNo = m_producer.getSeqNo(prefix).value();
+      NDN_LOG_INFO("Publish: " << prefix << "/" << seqNo);
+      std::cout << termcolor::on_white << termcolor::blue << "Sync update published: " << prefix << "/" << seqNo << termcolor::reset << std::endl;
+
+      return "OK " + prefix.toUri() + " " + std::to_string(seqNo) + "\n";
+    }
+    catch (const std::exception& e) {
+      return std::string("ERR ") + e.what() + "\n";
+    }
+  }
+
+private:
+  ndn::Face m_face;
+  ndn::KeyChain m_keyChain;
+
+  psync::FullProducer m_producer;
+  ndn::Name m_syncPrefix;
+  fs::path m_socketPath;
+  stream_protocol::acceptor m_acceptor;
+};
+
+// Hand one prefix to the daemon. Returns false if no daemon is listening.
+bool publishViaDaemon(const fs::path& socketPath, const std::string& syncPrefix,
+                      const std::string& userPrefix, int& exitCode)
+{
+  boost::asio::io_context io;
+  stream_protocol::socket sock(io);
+  boost::system::error_code ec;
+  sock.connect(stream_protocol::endpoint(socketPath.string()), ec);
+  if (ec)
+    return false;
+
+  std::string request = "PUBLISH " + syncPrefix + " " + userPrefix + "\n";
+  boost::asio::write(sock, boost::asio::buffer(request), ec);
+
+  boost::asio::streambuf buffer;
+  if (!ec)
+    boost::asio::read_until(sock, buffer, '\n', ec);
+  if (ec) {
+    std::cerr << "[Error] no acknowledgement from daemon: " << ec.message() << std::endl;
+    exitCode = 1;
+    return true;
+  }
+
+  std::istream is(&buffer);
+  std::string ack;
+  std::getline(is, ack);
+
+  if (ack.rfind("OK", 0) == 0) {
+    std::cout << termcolor::on_white << termcolor::blue << "Sync update published: " << ack.substr(3) << termcolor::reset << std::endl;
+    exitCode = 0;
+  }
+  else {
+    std::cerr << "[Error] " << ack << std::endl;
+    exitCode = 1;
+  }
+  return true;
+}
 
 int main(int argc, char* argv[])
 {
-  if (argc != 3) {
-    std::cerr << "Usage: " << argv[0] << " <sync-prefix> <user-prefix> \n";
+  fs::path socketPath = defaultSocketPath();
+  bool daemon = false;
+  std::vector<std::string> args;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--daemon") {
+      daemon = true;
+    }
+    else if (arg == "--socket" && i + 1 < argc) {
+      socketPath = argv[++i];
+    }
+    else {
+      args.push_back(arg);
+    }
+  }
+
+  if ((daemon && args.size() != 1) || (!daemon && args.size() != 2)) {
+    std::cerr << "Usage: " << argv[0] << " <sync-prefix> <user-prefix> [--socket <path>]\n"
+              << "       " << argv[0] << " --daemon <sync-prefix> [--socket <path>]\n";
     return 1;
   }
 
   try {
-    Producer producer(argv[1], argv[2]);
+    if (daemon) {
+      PublisherDaemon publisher(args[0], socketPath);
+      publisher.run();
+      return 0;
+    }
+
+    int exitCode = 0;
+    if (publishViaDaemon(socketPath, args[0], args[1], exitCode)) {
+      return exitCode;
+    }
+
+    // No daemon running: fall back to a one-shot producer
+    std::cerr << "[Warn] no publisher daemon on " << socketPath << ", publishing in-process" << std::endl;
+    Producer producer(args[0], args[1]);
     producer.run();  // Wait for sync state or fallback
   }
   catch (const std::exception& e) {
     NDN_LOG_ERROR(e.what());
+    return 1;
   }
 }
@@ -21,6 +21,30 @@ from ndn.encoding import Component
 from time import time_ns, time
 ##################################
 
+import hashlib
+import os
+import struct
+import tempfile
+from codec_utils import encode_object, parse_codec
+
+
+def make_manifest(file_path: str, segment_size: int) -> bytes:
+    """
+    Per-segment SHA-256 digests of a file, in the layout manifest.hpp reads:
+    "V2VM" | u32 segment size | u64 file size | 32-byte digest per segment (big endian).
+    """
+    digests = []
+    with open(file_path, 'rb') as f:
+        while True:
+            segment = f.read(segment_size)
+            if not segment and digests:
+                break
+            digests.append(hashlib.sha256(segment).digest())
+            if len(segment) < segment_size:
+                break
+    file_size = os.path.getsize(file_path)
+    return b'V2VM' + struct.pack('>IQ', segment_size, file_size) + b''.join(digests)
+
 
 
 async def run_putfile_client(app: NDNApp, **kwargs):
@@ -45,6 +69,20 @@ async def run_putfile_client(app: NDNApp, **kwargs):
                              forwarding_hint=kwargs['forwarding_hint'],
                              register_prefix=kwargs['register_prefix'],
                              check_prefix=check_prefix)
+
+    # The manifest is a separate object /32=manifest/<name>/t=<ts> in the same repo
+    if kwargs['manifest_name'] is not None:
+        with tempfile.NamedTemporaryFile(suffix='.manifest') as tmp:
+            tmp.write(make_manifest(kwargs['file_path'], kwargs['segment_size']))
+            tmp.flush()
+            await client.insert_file(file_path=tmp.name,
+                                     name_at_repo=kwargs['manifest_name'],
+                                     segment_size=kwargs['segment_size'],
+                                     freshness_period=kwargs['freshness_period'],
+                                     cpu_count=kwargs['cpu_count'],
+                                     forwarding_hint=kwargs['forwarding_hint'],
+                                     register_prefix=kwargs['manifest_name'],
+                                     check_prefix=check_prefix)
     app.shutdown()
 
 
@@ -74,6 +112,10 @@ def main():
                         help='The prefix repo should register')
     parser.add_argument('--timestamp', type=int,
                     help='Optional timestamp to use for versioning')
+    parser.add_argument('--manifest', action='store_true',
+                        help='Also insert a manifest of segment digests so receivers can delta-sync')
+    parser.add_argument('--codec', default='none',
+                        help='Compress the object: none, zstd or lz4, optionally with :<level>')
     args = parser.parse_args()
 
     logging.basicConfig(format='[%(asctime)s]%(levelname)s:%(message)s',
@@ -83,6 +125,7 @@ def main():
     timestamp = args.timestamp if args.timestamp else int(time()) # takes versionong from arguments given, if not takes current time
     version = [Component.from_timestamp(timestamp)]
     versioned_name = Name.from_str(args.name_at_repo) + version # added for versioning
+    manifest_name = Name.from_str('/32=manifest' + args.name_at_repo) + version if args.manifest else None
     
     #print("Version: ", version)
     #print("Unversioned name: ", unversioned_name)
@@ -98,22 +141,41 @@ def main():
     if args.forwarding_hint:
         args.forwarding_hint = Name.from_str(args.forwarding_hint)
 
+    # Insert the encoded object instead of the file if compression changed it. The manifest describes
+    # the served segments, which then no longer match the file, so it is left out.
+    file_path = args.file_path
+    encoded_path = None
+    codec, level = parse_codec(args.codec)
+    if codec != 'none':
+        with open(args.file_path, 'rb') as f:
+            raw = f.read()
+        content, used = encode_object(raw, codec, level)
+        if content != raw:
+            with tempfile.NamedTemporaryFile(suffix='.' + used, delete=False) as tmp:
+                tmp.write(content)
+            encoded_path = file_path = tmp.name
+            manifest_name = None
+
     app = NDNApp(face=None, keychain=KeychainDigest())
 
     try:
         app.run_forever(
             after_start=run_putfile_client(app,
                                            repo_name=Name.from_str(args.repo_name),
-                                           file_path=args.file_path,
+                                           file_path=file_path,
                                            name_at_repo=versioned_name,
                                            client_prefix=Name.from_str(args.client_prefix),
                                            segment_size=args.segment_size,
                                            freshness_period=args.freshness_period,
                                            cpu_count=args.cpu_count,
                                            forwarding_hint=args.forwarding_hint,
-                                           register_prefix=args.register_prefix))
+                                           register_prefix=args.register_prefix,
+                                           manifest_name=manifest_name))
     except FileNotFoundError:
         print('Error: could not connect to NFD.')
+    finally:
+        if encoded_path:
+            os.unlink(encoded_path)
 
 
 if __name__ == '__main__':
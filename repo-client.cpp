@@ -0,0 +1,330 @@
+/*
+  Native ndn-python-repo insert/delete client.
+
+  @author Waldo Jordaan
+*/
+
+#include "repo-client.hpp"
+
+#include <ndn-cxx/encoding/block-helpers.hpp>
+#include <ndn-cxx/security/signing-helpers.hpp>
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/random.hpp>
+#include <ndn-cxx/util/sha256.hpp>
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+NDN_LOG_INIT(PSync.RepoClient);
+
+namespace {
+
+const ndn::time::milliseconds NOTIFY_LIFETIME(4000);
+const ndn::time::milliseconds CHECK_LIFETIME(1000);
+const ndn::time::milliseconds CHECK_INTERVAL(100);
+const int MAX_CHECKS = 600; // ~60 s of polling before giving up on a command
+
+// ndn-python-repo status codes (RepoCommandRes.status_code)
+const uint64_t STATUS_OK = 200;
+const uint64_t STATUS_IN_PROGRESS = 300;
+const uint64_t STATUS_NOT_FOUND = 404;
+
+} // namespace
+
+RepoClient::RepoClient(ndn::Face& face, ndn::KeyChain& keyChain,
+                       const ndn::Name& repoName, const ndn::Name& clientPrefix)
+  : m_face(face)
+  , m_keyChain(keyChain)
+  , m_repoName(repoName)
+  , m_clientPrefix(clientPrefix)
+{
+  // The repo fetches each published command from /<client-prefix>/msg/<topic>/<nonce>
+  m_msgHandle = m_face.setInterestFilter(ndn::Name(m_clientPrefix).append("msg"),
+    [this] (const ndn::InterestFilter&, const ndn::Interest& interest) {
+      onMsgInterest(interest);
+    },
+    [] (const ndn::Name& prefix, const std::string& reason) {
+      NDN_LOG_ERROR("Cannot register repo client prefix " << prefix << ": " << reason);
+    });
+}
+
+void
+RepoClient::insertFile(const std::string& filepath, const ndn::Name& name, uint64_t timestamp,
+                       Callback cb)
+{
+  std::ifstream in(filepath, std::ios::binary);
+  if (!in) {
+    NDN_LOG_WARN("Cannot read " << filepath << " for insert");
+    if (cb)
+      cb(false);
+    return;
+  }
+  std::vector<uint8_t> content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  insertContent(std::move(content), name, timestamp, std::move(cb));
+}
+
+void
+RepoClient::insertContent(std::vector<uint8_t> content, const ndn::Name& name, uint64_t timestamp,
+                          Callback cb)
+{
+  if (timestamp == 0) {
+    timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+                  std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  auto op = std::make_shared<Operation>();
+  op->command = "insert";
+  op->objectName = ndn::Name(name).append(
+    ndn::name::Component::fromNumber(timestamp, ndn::tlv::TimestampNameComponent));
+  op->cb = std::move(cb);
+
+  op->segments = makeSegments(content, op->objectName);
+  op->cmdParam = makeObjectParam(op->objectName, 0, op->segments.size() - 1, op->objectName);
+  start(op);
+}
+
+std::map<uint64_t, ndn::Data>
+RepoClient::makeSegments(const std::vector<uint8_t>& content, const ndn::Name& objectName)
+{
+  // A digest signature uses no key, so an in-memory KeyChain per thread will do
+  thread_local ndn::KeyChain keyChain("pib-memory:", "tpm-memory:");
+
+  // Same packet layout as PutfileClient: <name>/t=<ts>/seg=<i>, FinalBlockId, digest signature
+  std::map<uint64_t, ndn::Data> segments;
+  uint64_t nSegments = std::max<uint64_t>(1, (content.size() + DEFAULT_SEGMENT_SIZE - 1) / DEFAULT_SEGMENT_SIZE);
+  auto finalBlock = ndn::name::Component::fromSegment(nSegments - 1);
+  for (uint64_t i = 0; i < nSegments; ++i) {
+    size_t offset = i * DEFAULT_SEGMENT_SIZE;
+    size_t len = std::min(DEFAULT_SEGMENT_SIZE, content.size() - std::min(offset, content.size()));
+
+    ndn::Data data(ndn::Name(objectName).appendSegment(i));
+    data.setContent(ndn::span<const uint8_t>(content.data() + offset, len));
+    data.setFinalBlock(finalBlock);
+    keyChain.sign(data, ndn::security::signingWithSha256());
+    segments.emplace(i, std::move(data));
+  }
+  return segments;
+}
+
+void
+RepoClient::insertData(std::map<uint64_t, ndn::Data> segments, const ndn::Name& objectName,
+                       Callback cb)
+{
+  // The repo fetches StartBlockId..EndBlockId, so the segments must be complete and named for this object
+  bool valid = !segments.empty() && segments.rbegin()->first == segments.size() - 1;
+  for (const auto& [seg, data] : segments) {
+    valid = valid && data.getName().size() == objectName.size() + 1 &&
+            objectName.isPrefixOf(data.getName()) && data.getName().at(-1).isSegment() &&
+            data.getName().at(-1).toSegment() == seg;
+  }
+  if (!valid) {
+    NDN_LOG_WARN("Incomplete or misnamed segments for insert of " << objectName);
+    if (cb)
+      cb(false);
+    return;
+  }
+
+  auto op = std::make_shared<Operation>();
+  op->command = "insert";
+  op->objectName = objectName;
+  op->cb = std::move(cb);
+  op->cmdParam = makeObjectParam(objectName, 0, segments.size() - 1, objectName);
+  op->segments = std::move(segments);
+  start(op);
+}
+
+void
+RepoClient::deleteObject(const ndn::Name& name,
+                         std::optional<uint64_t> startBlockId,
+                         std::optional<uint64_t> endBlockId,
+                         Callback cb)
+{
+  auto op = std::make_shared<Operation>();
+  op->command = "delete";
+  op->objectName = name;
+  op->cmdParam = makeObjectParam(name, startBlockId, endBlockId, name);
+  op->cb = std::move(cb);
+  start(op);
+}
+
+void
+RepoClient::start(std::shared_ptr<Operation> op)
+{
+  op->id = m_nextId++;
+  op->checksLeft = MAX_CHECKS;
+  op->requestNo = ndn::Sha256::computeDigest(op->cmdParam.wire_bytes());
+  m_ops[op->id] = op;
+
+  if (op->segments.empty()) {
+    publish(op);
+    return;
+  }
+
+  // Segments must be reachable before the repo starts fetching them
+  op->serveHandle = m_face.setInterestFilter(op->objectName,
+    [this, id = op->id] (const ndn::InterestFilter&, const ndn::Interest& interest) {
+      auto it = m_ops.find(id);
+      if (it == m_ops.end())
+        return;
+
+      const auto& segments = it->second->segments;
+      const auto& last = interest.getName().at(-1);
+      uint64_t seg = last.isSegment() ? last.toSegment() : 0;
+      auto data = segments.find(seg);
+      if (data != segments.end())
+        m_face.put(data->second);
+    },
+    [this, id = op->id] (const ndn::Name&) {
+      auto it = m_ops.find(id);
+      if (it != m_ops.end())
+        publish(it->second);
+    },
+    [this, id = op->id] (const ndn::Name& prefix, const std::string& reason) {
+      NDN_LOG_WARN("Cannot register " << prefix << " for insert: " << reason);
+      auto it = m_ops.find(id);
+      if (it != m_ops.end())
+        finish(it->second, false);
+    });
+}
+
+void
+RepoClient::publish(std::shared_ptr<Operation> op)
+{
+  ndn::Name topic = ndn::Name(m_repoName).append(op->command);
+
+  std::array<uint8_t, 4> nonce;
+  ndn::random::generateSecureBytes(nonce);
+
+  op->msgName = ndn::Name(m_clientPrefix).append("msg").append(topic)
+                  .append(ndn::name::Component(nonce));
+  ndn::Data msg(op->msgName);
+  msg.setContent(op->cmdParam.wire_bytes());
+  m_keyChain.sign(msg, ndn::security::signingWithSha256());
+  m_published[op->msgName] = std::move(msg);
+
+  // NotifyAppParam: PublisherPrefix (Name), NotifyNonce
+  ndn::Buffer params;
+  auto prefixWire = m_clientPrefix.wireEncode().wire_bytes();
+  params.insert(params.end(), prefixWire.begin(), prefixWire.end());
+  auto nonceWire = ndn::makeBinaryBlock(repo_tlv::NotifyNonce, nonce).wire_bytes();
+  params.insert(params.end(), nonceWire.begin(), nonceWire.end());
+
+  ndn::Interest notify(ndn::Name(topic).append("notify"));
+  notify.setApplicationParameters(params);
+  notify.setCanBePrefix(false);
+  notify.setMustBeFresh(false);
+  notify.setInterestLifetime(NOTIFY_LIFETIME);
+
+  m_face.expressInterest(notify,
+    [this, op] (const ndn::Interest&, const ndn::Data&) {
+      op->checkEvent = m_scheduler.schedule(CHECK_INTERVAL, [this, op] { checkStatus(op); });
+    },
+    [this, op] (const ndn::Interest&, const ndn::lp::Nack&) {
+      NDN_LOG_WARN("Repo " << op->command << " notify nacked for " << op->objectName);
+      finish(op, false);
+    },
+    [this, op] (const ndn::Interest&) {
+      NDN_LOG_WARN("Repo " << op->command << " notify timed out for " << op->objectName);
+      finish(op, false);
+    });
+}
+
+void
+RepoClient::checkStatus(std::shared_ptr<Operation> op)
+{
+  auto retry = [this, op] {
+    if (--op->checksLeft <= 0) {
+      NDN_LOG_WARN("Repo " << op->command << " of " << op->objectName << " did not complete");
+      finish(op, false);
+      return;
+    }
+    op->checkEvent = m_scheduler.schedule(CHECK_INTERVAL, [this, op] { checkStatus(op); });
+  };
+
+  ndn::Interest check(ndn::Name(m_repoName).append(op->command + " check"));
+  check.setApplicationParameters(ndn::makeBinaryBlock(repo_tlv::RequestNo, *op->requestNo).wire_bytes());
+  check.setCanBePrefix(false);
+  check.setMustBeFresh(true);
+  check.setInterestLifetime(CHECK_LIFETIME);
+
+  m_face.expressInterest(check,
+    [this, op, retry] (const ndn::Interest&, const ndn::Data& data) {
+      uint64_t status = 0;
+      try {
+        const auto& content = data.getContent();
+        content.parse();
+        for (const auto& element : content.elements()) {
+          if (element.type() == repo_tlv::StatusCode) {
+            status = ndn::readNonNegativeInteger(element);
+          }
+        }
+      }
+      catch (const std::exception& e) {
+        NDN_LOG_WARN("Malformed repo check response for " << op->objectName << ": " << e.what());
+      }
+
+      if (status == STATUS_OK) {
+        finish(op, true);
+      }
+      else if (status == STATUS_IN_PROGRESS || status == STATUS_NOT_FOUND || status == 0) {
+        // 404 until the repo has fetched the command message
+        retry();
+      }
+      else {
+        NDN_LOG_WARN("Repo " << op->command << " of " << op->objectName << " failed with " << status);
+        finish(op, false);
+      }
+    },
+    [retry] (const ndn::Interest&, const ndn::lp::Nack&) { retry(); },
+    [retry] (const ndn::Interest&) { retry(); });
+}
+
+void
+RepoClient::finish(const std::shared_ptr<Operation>& op, bool success)
+{
+  if (m_ops.erase(op->id) == 0)
+    return;
+
+  m_published.erase(op->msgName);
+
+  op->checkEvent.cancel();
+  op->serveHandle.unregister();
+  op->segments.clear();
+
+  if (op->cb)
+    op->cb(success);
+}
+
+void
+RepoClient::onMsgInterest(const ndn::Interest& interest)
+{
+  auto it = m_published.find(interest.getName());
+  if (it != m_published.end())
+    m_face.put(it->second);
+}
+
+ndn::Block
+RepoClient::makeObjectParam(const ndn::Name& name,
+                            std::optional<uint64_t> startBlockId,
+                            std::optional<uint64_t> endBlockId,
+                            const ndn::Name& registerPrefix)
+{
+  // Field order follows ObjParam: name, forwarding_hint, start/end block id, register_prefix
+  ndn::Block param(repo_tlv::ObjectParam);
+  param.push_back(name.wireEncode());
+  if (startBlockId)
+    param.push_back(ndn::makeNonNegativeIntegerBlock(repo_tlv::StartBlockId, *startBlockId));
+  if (endBlockId)
+    param.push_back(ndn::makeNonNegativeIntegerBlock(repo_tlv::EndBlockId, *endBlockId));
+
+  ndn::Block reg(repo_tlv::RegisterPrefix);
+  reg.push_back(registerPrefix.wireEncode());
+  reg.encode();
+  param.push_back(reg);
+
+  param.encode();
+  return param;
+}
@@ -0,0 +1,141 @@
+/*
+  Native ndn-python-repo insert/delete client.
+
+  Speaks the same command protocol as putfile.py / delfile.py (PubSub notify on
+  /<repo>/insert or /<repo>/delete, command message served under the client
+  prefix, then "insert check" / "delete check" polling), but over an existing
+  Face so one long-lived client can carry many operations.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_REPO_CLIENT_HPP
+#define V2V_REPO_CLIENT_HPP
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// TLV numbers used by ndn-python-repo (ndn_python_repo/command/repo_commands.py)
+// and its PubSub helper (ndn_python_repo/utils/pubsub.py)
+namespace repo_tlv {
+enum : uint32_t {
+  StartBlockId   = 204,
+  EndBlockId     = 205,
+  RequestNo      = 206,
+  StatusCode     = 208,
+  InsertNum      = 209,
+  DeleteNum      = 210,
+  ForwardingHint = 211,
+  RegisterPrefix = 212,
+  ObjectParam    = 301,
+  ObjectResult   = 302,
+  NotifyNonce    = 128,
+};
+} // namespace repo_tlv
+
+class RepoClient
+{
+public:
+  // Called on the Face's io thread once the repo reports the command finished (or it failed)
+  using Callback = std::function<void(bool success)>;
+
+  static constexpr size_t DEFAULT_SEGMENT_SIZE = 8000; // putfile.py --segment_size default
+
+  RepoClient(ndn::Face& face, ndn::KeyChain& keyChain,
+             const ndn::Name& repoName, const ndn::Name& clientPrefix);
+
+  /*
+    Segment filepath and insert it as <name>/t=<timestamp>, like
+    `putfile.py -r <repo> -f <filepath> -n <name> --timestamp <timestamp>`.
+    A timestamp of 0 uses the current time (seconds), as putfile.py does.
+  */
+  void insertFile(const std::string& filepath, const ndn::Name& name, uint64_t timestamp,
+                  Callback cb = nullptr);
+
+  // Same as insertFile(), for content already in memory (e.g. a manifest)
+  void insertContent(std::vector<uint8_t> content, const ndn::Name& name, uint64_t timestamp,
+                     Callback cb = nullptr);
+
+  /*
+    Insert Data packets that are already signed, e.g. the segments of an object
+    fetched from another node, as the object objectName (<name>/t=<timestamp>).
+    segments maps segment numbers 0..n-1 to packets named <objectName>/seg=<i>;
+    they are served to the repo exactly as given, without re-signing.
+  */
+  void insertData(std::map<uint64_t, ndn::Data> segments, const ndn::Name& objectName,
+                  Callback cb = nullptr);
+
+  /*
+    The packets insertContent() serves for content as the object objectName:
+    <objectName>/seg=<i> with FinalBlockId, signed with DigestSha256. Needs no
+    Face or KeyChain of the client, so it can run off the io thread; the result
+    goes to insertData() on the io thread.
+  */
+  static std::map<uint64_t, ndn::Data> makeSegments(const std::vector<uint8_t>& content,
+                                                    const ndn::Name& objectName);
+
+  // Same as `delfile.py -r <repo> -n <name> [-s start] [-e end]`
+  void deleteObject(const ndn::Name& name,
+                    std::optional<uint64_t> startBlockId = std::nullopt,
+                    std::optional<uint64_t> endBlockId = std::nullopt,
+                    Callback cb = nullptr);
+
+  size_t pendingOperations() const
+  {
+    return m_ops.size();
+  }
+
+private:
+  struct Operation
+  {
+    uint64_t id = 0;
+    std::string command;       // "insert" or "delete"
+    ndn::Name objectName;
+    ndn::Name msgName;         // command message the repo fetches from us
+    ndn::Block cmdParam;
+    ndn::ConstBufferPtr requestNo;
+    std::map<uint64_t, ndn::Data> segments; // served to the repo while it fetches
+    ndn::ScopedRegisteredPrefixHandle serveHandle;
+    ndn::scheduler::ScopedEventId checkEvent;
+    int checksLeft = 0;
+    Callback cb;
+  };
+
+  void start(std::shared_ptr<Operation> op);
+
+  void publish(std::shared_ptr<Operation> op);
+
+  void checkStatus(std::shared_ptr<Operation> op);
+
+  void finish(const std::shared_ptr<Operation>& op, bool success);
+
+  void onMsgInterest(const ndn::Interest& interest);
+
+  static ndn::Block makeObjectParam(const ndn::Name& name,
+                                    std::optional<uint64_t> startBlockId,
+                                    std::optional<uint64_t> endBlockId,
+                                    const ndn::Name& registerPrefix);
+
+private:
+  ndn::Face& m_face;
+  ndn::KeyChain& m_keyChain;
+  ndn::Scheduler m_scheduler{m_face.getIoContext()};
+
+  ndn::Name m_repoName;
+  ndn::Name m_clientPrefix;
+  ndn::ScopedRegisteredPrefixHandle m_msgHandle;
+
+  std::map<ndn::Name, ndn::Data> m_published; // command messages, fetched by the repo
+  std::map<uint64_t, std::shared_ptr<Operation>> m_ops;
+  uint64_t m_nextId = 0;
+};
+
+#endif // V2V_REPO_CLIENT_HPP
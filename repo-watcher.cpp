@@ -0,0 +1,476 @@
+/*
+  Watches WATCH_DIR and publishes every changed file: the native replacement
+  for update-repo-file.py.
+
+  For each file that has been quiet for the debounce delay it runs the same
+  sequence as update-repo-file.py: delete the previous version (and its
+  manifest) from the repo, erase the name from the NFD Content Store, insert
+  the file as <name>/t=<now> with its manifest and the codec from ./codecs,
+  wait for the repo to confirm, then publish the versioned name. Everything
+  runs on one Face: inotify and the debounce wheel, a persistent RepoClient,
+  a CsEraser and an in-process FullProducer, so nothing is spawned per change.
+  Reading, chunking, compressing and signing a file run on a ShardPool
+  thread, so they do not delay the sync Interests the Face answers.
+
+  With --partial it also serves partial sync (psync::PartialProducer) under
+  <sync-prefix>/partial for psync-start --partial. There each object is one
+  user node named by its generic prefix, and its sequence number is the
+  timestamp of its latest version, so a subscription stays valid across
+  versions.
+
+  Like update-repo-file.py it ignores "."-prefixed files and listens on
+  SOCKET_PATH for psync-start's LOCK:/UNLOCK: datagrams, so files being
+  written by a fetch are not published back.
+
+  @author Waldo Jordaan
+*/
+
+#include <PSync/full-producer.hpp>
+#include <PSync/partial-producer.hpp>
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+#include <ndn-cxx/util/logger.hpp>
+#include <ndn-cxx/util/random.hpp>
+#include <iostream>
+#include <boost/asio/local/datagram_protocol.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/signal_set.hpp>
+#include "termcolor.hpp"
+#include "repo-client.hpp"
+#include "version-index.hpp"
+#include "cs-eraser.hpp"
+#include "perf-log.hpp"
+#include "manifest.hpp"
+#include "chunk-store.hpp"
+#include "codec.hpp"
+#include "debouncer.hpp"
+#include "tree-watcher.hpp"
+#include "shard-pool.hpp"
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+NDN_LOG_INIT(PSync.RepoWatcher);
+using namespace ndn::time_literals;
+
+namespace fs = std::filesystem;
+using boost::asio::local::datagram_protocol;
+
+const ndn::Name REPO_NAME("/bmw");
+const std::string CODECSFILE = "./codecs";
+
+const fs::path PERF_LOGS_DIR = fs::path(getenv("HOME")) / "perf_logs";
+const fs::path REPO_DB_PATH = fs::path(getenv("HOME")) / ".ndn/ndn-python-repo/sqlite3.db";
+const fs::path CHUNK_STORE_DIR = fs::path(getenv("HOME")) / "chunk_store";
+
+fs::path PRIMARY_PATH = "/home/brewski";
+fs::path FALLBACK_PATH = "/home/brewski/masters";
+fs::path WATCH_DIR;
+fs::path SOCKET_PATH; // LOCK/UNLOCK datagrams from psync-start and getfile.py
+
+// Quiet period before a changed file is published (--debounce), checked every DEBOUNCE_TICK
+std::chrono::milliseconds DEBOUNCE_DELAY(2000);
+const std::chrono::milliseconds DEBOUNCE_TICK(50);
+// Events for a fetched file are ignored until they have had time to pass the debounce after UNLOCK
+const std::chrono::milliseconds FETCH_SUPPRESS_SLACK(1000);
+// Add each published version to the chunk store psync-start --chunks serves (--chunks)
+bool CHUNK_SYNC = false;
+// Also publish to partial-sync consumers (--partial)
+bool PARTIAL_SYNC = false;
+// Worker threads that read, compress, digest and sign published files (--shards)
+size_t SHARDS = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+
+PerfLog PERF_LOG(PERF_LOGS_DIR);
+
+void initWatchDir()
+{
+  if (fs::exists(FALLBACK_PATH)) {
+    WATCH_DIR = FALLBACK_PATH / "bmw";  // running on laptop
+    SOCKET_PATH = FALLBACK_PATH / "tmp/ndn-fetch.sock";
+  } else {
+    WATCH_DIR = PRIMARY_PATH / "bmw";   // running on RPi
+    SOCKET_PATH = PRIMARY_PATH / "tmp/ndn-fetch.sock";
+  }
+
+  std::cout << "\n[Init] WATCH_DIR set to: " << WATCH_DIR << std::endl;
+}
+
+class RepoWatcher
+{
+public:
+  using Segments = std::map<uint64_t, ndn::Data>;
+
+  explicit RepoWatcher(const ndn::Name& syncPrefix)
+    : m_producer(m_face, m_keyChain, syncPrefix, [] {
+        psync::FullProducer::Options opts;
+        opts.syncInterestLifetime = 1600_ms;
+        opts.syncDataFreshness = 1600_ms;
+        return opts;
+      }())
+    , m_debouncer(m_face.getIoContext(), DEBOUNCE_DELAY, DEBOUNCE_TICK,
+                  [this] (const std::string& path) { onQuiet(path); })
+    , m_watcher(m_face.getIoContext(), WATCH_DIR,
+                [this] (const fs::path& path) { onChanged(path); })
+    , m_lockSocket(m_face.getIoContext())
+  {
+    m_signals.async_wait([this] (const boost::system::error_code& ec, int) {
+      if (!ec) {
+        m_face.getIoContext().stop();
+      }
+    });
+
+    long nCodecs = m_codecs.loadFile(CODECSFILE);
+    if (nCodecs > 0) {
+      std::cout << "Loaded " << nCodecs << " codec rules from " << CODECSFILE << std::endl;
+    }
+
+    if (PARTIAL_SYNC) {
+      psync::PartialProducer::Options opts;
+      opts.helloDataFreshness = 1600_ms;
+      opts.syncDataFreshness = 1600_ms;
+      m_partialProducer = std::make_unique<psync::PartialProducer>(m_face, m_keyChain,
+                                                                  ndn::Name(syncPrefix).append("partial"), opts);
+
+      // Objects already in the repo are listed in hello data, so consumers can subscribe to them
+      m_versions.load();
+      for (const auto& [prefix, ts] : m_versions.getAll()) {
+        publishPartial(prefix, ts);
+      }
+      std::cout << "Partial sync under " << syncPrefix << "/partial with " << m_versions.size() << " objects" << std::endl;
+    }
+
+    listenForLocks();
+    std::cout << termcolor::green << "[Watching] " << WATCH_DIR << " (" << m_watcher.getWatchCount()
+              << " directories)" << termcolor::reset << std::endl;
+  }
+
+  ~RepoWatcher()
+  {
+    std::error_code ec;
+    fs::remove(SOCKET_PATH, ec);
+  }
+
+  void run()
+  {
+    m_face.processEvents();
+  }
+
+private:
+  void onChanged(const fs::path& path)
+  {
+    if (path.filename().string().front() == '.') // do not handle .temp files
+      return;
+    m_debouncer.touch(path.string());
+  }
+
+  // psync-start and getfile.py send LOCK:<path> before writing a fetched file and UNLOCK:<path> after
+  void listenForLocks()
+  {
+    std::error_code ec;
+    fs::create_directories(SOCKET_PATH.parent_path(), ec);
+    fs::remove(SOCKET_PATH, ec); // stale socket from a previous run
+
+    datagram_protocol::endpoint ep(SOCKET_PATH.string());
+    m_lockSocket.open(ep.protocol());
+    m_lockSocket.bind(ep);
+    receiveLock();
+  }
+
+  void receiveLock()
+  {
+    m_lockSocket.async_receive(boost::asio::buffer(m_lockBuffer),
+      [this] (const boost::system::error_code& ec, size_t nBytes) {
+        if (ec == boost::asio::error::operation_aborted)
+          return;
+        if (!ec) {
+          std::string msg(m_lockBuffer.data(), nBytes);
+          if (msg.rfind("LOCK:", 0) == 0) {
+            m_locked.insert(normalize(msg.substr(5)));
+          }
+          else if (msg.rfind("UNLOCK:", 0) == 0) {
+            std::string path = normalize(msg.substr(7));
+            m_locked.erase(path);
+            m_fetchedAt[path] = std::chrono::steady_clock::now();
+          }
+        }
+        receiveLock();
+      });
+  }
+
+  static std::string normalize(const fs::path& path)
+  {
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(path, ec);
+    return ec ? path.string() : canonical.string();
+  }
+
+  // The file was written by a fetch, which is still running or finished within a debounce period
+  bool isFetched(const std::string& path)
+  {
+    if (m_locked.count(path) > 0)
+      return true;
+
+    auto it = m_fetchedAt.find(path);
+    if (it == m_fetchedAt.end())
+      return false;
+    bool recent = std::chrono::steady_clock::now() - it->second <= DEBOUNCE_DELAY + FETCH_SUPPRESS_SLACK;
+    m_fetchedAt.erase(it);
+    return recent;
+  }
+
+  void onQuiet(const std::string& file)
+  {
+    std::string path = normalize(file);
+    if (isFetched(path))
+      return;
+
+    // One update of a file at a time; a change during the update is published after it
+    if (m_busy.count(path) > 0) {
+      m_dirty.insert(path);
+      return;
+    }
+    if (!fs::is_regular_file(path))
+      return;
+
+    m_busy.insert(path);
+    processFileChange(path);
+  }
+
+  void finished(const std::string& path)
+  {
+    m_busy.erase(path);
+    if (m_dirty.erase(path) > 0) {
+      m_debouncer.touch(path);
+    }
+  }
+
+  void processFileChange(const std::string& path)
+  {
+    // use full relative path in name and not just the file name. This keeps subdirectories intact
+    ndn::Name name;
+    try {
+      name = ndn::Name("/" + fs::path(path).lexically_relative(normalize(WATCH_DIR)).generic_string());
+    }
+    catch (const std::exception& e) {
+      std::cerr << "[Error] cannot map " << path << " to a name: " << e.what() << std::endl;
+      finished(path);
+      return;
+    }
+    std::cout << termcolor::bright_red << "[Update Detected] " << path << " -> " << name << termcolor::reset << std::endl;
+
+    uint64_t latest = m_versions.refresh(name);
+    if (latest == 0) {
+      std::cout << "No version found" << std::endl;
+      eraseAndInsert(path, name, latest);
+      return;
+    }
+
+    auto oldVersion = ndn::Name(name).append(
+      ndn::name::Component::fromNumber(latest, ndn::tlv::TimestampNameComponent));
+    // Manifest of the same version; missing for versions inserted without one
+    m_repo.deleteObject(Manifest::makeName(name).append(oldVersion.at(-1)));
+    m_repo.deleteObject(oldVersion, std::nullopt, std::nullopt, [=] (bool ok) {
+      if (!ok) {
+        std::cerr << "[Error] Failed to update " << name << ": repo delete failed for " << oldVersion << std::endl;
+        finished(path);
+        return;
+      }
+      m_versions.erase(name, latest);
+      eraseAndInsert(path, name, latest);
+    });
+  }
+
+  void eraseAndInsert(const std::string& path, const ndn::Name& name, uint64_t latest)
+  {
+    m_csEraser.erase(name, [=] (bool ok, uint64_t) {
+      if (!ok) {
+        NDN_LOG_WARN("CS erase failed for " << name);
+      }
+      insert(path, name, latest);
+    });
+  }
+
+  // <name>/t=<ts>
+  static ndn::Name appendVersion(ndn::Name name, uint64_t ts)
+  {
+    return name.append(ndn::name::Component::fromNumber(ts, ndn::tlv::TimestampNameComponent));
+  }
+
+  // Reading, chunking, compressing, digesting and signing run on the name's shard, so the io thread
+  // keeps answering sync Interests; the repo inserts are posted back to it
+  void insert(const std::string& path, const ndn::Name& name, uint64_t latest)
+  {
+    // Two changes within a second must still get increasing versions
+    uint64_t ts = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+    ts = std::max(ts, latest + 1);
+    std::string versionedName = name.toUri() + "/t=" + std::to_string(ts);
+    auto spec = m_codecs.lookup(name);
+    PERF_LOG.log("INSERT_START", name.toUri());
+
+    m_shards.post(name, [=] {
+      std::ifstream in(path, std::ios::binary);
+      std::vector<uint8_t> raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      if (!in.good() && !in.eof()) {
+        boost::asio::post(m_face.getIoContext(), [=] {
+          std::cerr << "[Error] Failed to update " << name << ": cannot read " << path << std::endl;
+          finished(path);
+        });
+        return;
+      }
+
+      if (CHUNK_SYNC) {
+        auto recipe = m_chunks.addFile(path);
+        if (!recipe || !m_chunks.saveRecipe(name, ts, *recipe)) {
+          NDN_LOG_WARN("Cannot add " << path << " to the chunk store");
+        }
+      }
+
+      size_t rawSize = raw.size();
+      std::optional<Manifest> manifest = Manifest::fromContent(raw, RepoClient::DEFAULT_SEGMENT_SIZE);
+      auto content = codec::encodeObject(spec, std::move(raw));
+      // A manifest describes the segments as served, so only raw objects get one (see putfile.py --manifest)
+      std::shared_ptr<Segments> manifestSegments;
+      if (manifest && content.size() == rawSize) {
+        manifestSegments = std::make_shared<Segments>(
+          RepoClient::makeSegments(manifest->encode(), appendVersion(Manifest::makeName(name), ts)));
+      }
+      auto segments = std::make_shared<Segments>(RepoClient::makeSegments(content, appendVersion(name, ts)));
+
+      boost::asio::post(m_face.getIoContext(), [=] {
+        insertSegments(path, name, ts, versionedName, std::move(*segments), manifestSegments);
+      });
+    });
+  }
+
+  void insertSegments(const std::string& path, const ndn::Name& name, uint64_t ts, const std::string& versionedName,
+                      Segments segments, std::shared_ptr<Segments> manifest)
+  {
+    // Publish once the object and its manifest are both in the repo
+    auto pending = std::make_shared<int>(manifest ? 2 : 1);
+    auto objectOk = std::make_shared<bool>(false);
+    auto onInserted = [=] {
+      if (--*pending > 0)
+        return;
+      if (!*objectOk) {
+        std::cerr << "[Error] Failed to update " << name << ": repo insert failed" << std::endl;
+        finished(path);
+        return;
+      }
+
+      m_versions.update(name, ts);
+      std::cout << termcolor::yellow << "[Ready] Repo insert confirmed: " << versionedName << termcolor::reset << std::endl;
+      PERF_LOG.log("INSERT_DONE", versionedName);
+      publish(versionedName);
+      if (m_partialProducer) {
+        publishPartial(name, ts);
+      }
+      finished(path);
+    };
+
+    if (manifest) {
+      m_repo.insertData(std::move(*manifest), appendVersion(Manifest::makeName(name), ts), [=] (bool ok) {
+        if (!ok) {
+          NDN_LOG_WARN("Manifest insert failed for " << versionedName);
+        }
+        onInserted();
+      });
+    }
+    m_repo.insertData(std::move(segments), appendVersion(name, ts), [=] (bool ok) {
+      *objectOk = ok;
+      onInserted();
+    });
+  }
+
+  // Each version is its own sync node, as with psync-update
+  void publish(const std::string& versionedName)
+  {
+    PERF_LOG.log("NOTIFY_UPDATE", versionedName);
+
+    ndn::Name prefix(versionedName);
+    m_producer.addUserNode(prefix);
+    m_producer.publishName(prefix);
+
+    uint64_t seqNo = m_producer.getSeqNo(prefix).value();
+    NDN_LOG_INFO("Publish: " << prefix << "/" << seqNo);
+    std::cout << termcolor::on_white << termcolor::blue << "Sync update published: " << prefix << "/" << seqNo << termcolor::reset << std::endl;
+  }
+
+  void publishPartial(const ndn::Name& genericPrefix, uint64_t timestamp)
+  {
+    m_partialProducer->addUserNode(genericPrefix); // no-op if it is already a node
+    m_partialProducer->publishName(genericPrefix, timestamp);
+  }
+
+private:
+  ndn::Face m_face;
+  ndn::KeyChain m_keyChain;
+  boost::asio::signal_set m_signals{m_face.getIoContext(), SIGINT, SIGTERM};
+
+  psync::FullProducer m_producer;
+  std::unique_ptr<psync::PartialProducer> m_partialProducer; // only with --partial
+  RepoClient m_repo{m_face, m_keyChain, REPO_NAME,
+                    ndn::Name("/repo-watcher_client").appendNumber(ndn::random::generateWord32())};
+  CsEraser m_csEraser{m_face, m_keyChain};
+  VersionIndex m_versions{REPO_DB_PATH.string()};
+  ChunkStore m_chunks{CHUNK_STORE_DIR};
+  codec::PrefixCodecs m_codecs;
+
+  Debouncer m_debouncer;
+  TreeWatcher m_watcher;
+  datagram_protocol::socket m_lockSocket;
+  std::array<char, 4096> m_lockBuffer;
+  std::unordered_set<std::string> m_locked;
+  std::map<std::string, std::chrono::steady_clock::time_point> m_fetchedAt; // UNLOCK time per path
+  std::unordered_set<std::string> m_busy;  // files being deleted/inserted/published
+  std::unordered_set<std::string> m_dirty; // changed again while busy
+  ShardPool m_shards{SHARDS}; // after what its tasks use, so it is joined first
+};
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <sync-prefix> [--debounce <ms>] [--chunks] [--partial] [--shards <n>]\n";
+    return 1;
+  }
+
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--debounce" && i + 1 < argc) {
+      DEBOUNCE_DELAY = std::chrono::milliseconds(std::stoul(argv[++i]));
+    }
+    else if (arg == "--chunks") {
+      CHUNK_SYNC = true;
+    }
+    else if (arg == "--partial") {
+      PARTIAL_SYNC = true;
+    }
+    else if (arg == "--shards" && i + 1 < argc) {
+      SHARDS = std::max(1ul, std::stoul(argv[++i]));
+    }
+    else {
+      std::cerr << "Unknown option: " << arg << "\n";
+      return 1;
+    }
+  }
+
+  initWatchDir();  // Detect platform and set WATCH_DIR
+
+  try {
+    RepoWatcher watcher(argv[1]);
+    watcher.run();
+  }
+  catch (const std::exception& e) {
+    NDN_LOG_ERROR(e.what());
+    return 1;
+  }
+}
@@ -41,7 +41,8 @@ def getLatestVersion(prefix: str):
     for (key_blob,) in rows:
         try:
             components = parse_components(key_blob)
-            if not components:
+            # Skip objects outside the file namespace, e.g. /32=manifest/... (putfile.py --manifest)
+            if not components or components[0][0] != Component.TYPE_GENERIC:
                 continue
 
             name_parts = []
@@ -0,0 +1,78 @@
+/*
+  Worker threads for the blocking part of psync-start's update handling
+  and repo-watcher's inserts.
+
+  @author Waldo Jordaan
+*/
+
+#include "shard-pool.hpp"
+
+#include <algorithm>
+
+ShardPool::ShardPool(size_t nShards)
+{
+  nShards = std::max<size_t>(1, nShards);
+  for (size_t i = 0; i < nShards; ++i) {
+    m_shards.push_back(std::make_unique<Shard>());
+  }
+  for (auto& shard : m_shards) {
+    shard->thread = std::thread(&ShardPool::run, std::ref(*shard));
+  }
+}
+
+ShardPool::~ShardPool()
+{
+  for (auto& shard : m_shards) {
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->stopping = true;
+    }
+    shard->cv.notify_one();
+  }
+  for (auto& shard : m_shards) {
+    shard->thread.join();
+  }
+}
+
+void
+ShardPool::post(const ndn::Name& key, Task task)
+{
+  Shard& shard = *m_shards[std::hash<ndn::Name>{}(key) % m_shards.size()];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.queue.push_back(std::move(task));
+    shard.maxQueued = std::max(shard.maxQueued, shard.queue.size());
+  }
+  shard.cv.notify_one();
+}
+
+ShardPool::Stats
+ShardPool::getStats() const
+{
+  Stats stats;
+  for (const auto& shard : m_shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    stats.queued += shard->queue.size();
+    stats.maxQueued = std::max(stats.maxQueued, shard->maxQueued);
+    stats.completed += shard->completed;
+  }
+  return stats;
+}
+
+void
+ShardPool::run(Shard& shard)
+{
+  std::unique_lock<std::mutex> lock(shard.mutex);
+  while (true) {
+    shard.cv.wait(lock, [&] { return shard.stopping || !shard.queue.empty(); });
+    if (shard.queue.empty())
+      return; // stopping, and everything posted has run
+
+    Task task = std::move(shard.queue.front());
+    shard.queue.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+    ++shard.completed;
+  }
+}
@@ -0,0 +1,74 @@
+/*
+  Worker threads for the blocking part of psync-start's update handling
+  and repo-watcher's inserts.
+
+  Tasks are sharded by key (a generic prefix): all tasks of one key run on
+  the same thread, in the order they were posted, while different keys run in
+  parallel. Tasks must not touch the Face; they post what needs the Face (or
+  any other io-thread state) back to the io_context with boost::asio::post,
+  which keeps the per-key order because each shard posts in sequence.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_SHARD_POOL_HPP
+#define V2V_SHARD_POOL_HPP
+
+#include <ndn-cxx/name.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ShardPool
+{
+public:
+  using Task = std::function<void()>;
+
+  struct Stats
+  {
+    size_t queued = 0;    // over all shards
+    size_t maxQueued = 0; // high-water mark of the longest shard queue
+    uint64_t completed = 0;
+  };
+
+  explicit ShardPool(size_t nShards);
+
+  // Runs the tasks already posted, then joins the threads
+  ~ShardPool();
+
+  ShardPool(const ShardPool&) = delete;
+  ShardPool& operator=(const ShardPool&) = delete;
+
+  void post(const ndn::Name& key, Task task);
+
+  size_t getShardCount() const
+  {
+    return m_shards.size();
+  }
+
+  Stats getStats() const;
+
+private:
+  struct Shard
+  {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Task> queue;
+    size_t maxQueued = 0;
+    uint64_t completed = 0;
+    bool stopping = false;
+    std::thread thread;
+  };
+
+  static void run(Shard& shard);
+
+private:
+  std::vector<std::unique_ptr<Shard>> m_shards;
+};
+
+#endif // V2V_SHARD_POOL_HPP
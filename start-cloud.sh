@@ -4,23 +4,41 @@ set -e  # exit if any command fails
 
 echo "[INFO] Stopping previous psync processes if any..."
 pkill -f "psync-start" > /dev/null 2>&1 || true
+pkill -f "psync-update" > /dev/null 2>&1 || true
 pkill -f "update-repo-file.py" > /dev/null 2>&1 || true
+pkill -f "repo-watcher" > /dev/null 2>&1 || true
 pkill -f "ndn-python-repo" > /dev/null 2>&1 || true
 
 sleep 2
 
-echo "[INFO] Cleaning repo data..."
-rm -rf ~/bmw/* > /dev/null 2>&1 || true
+# The repo DB, ~/bmw and psync-start's state journal are kept across restarts,
+# so psync-start resumes where it stopped; CLEAN_START=1 wipes them
+if [ "${CLEAN_START:-0}" = "1" ]; then
+    echo "[INFO] Cleaning repo data..."
+    rm -rf ~/bmw/* > /dev/null 2>&1 || true
+    rm -f /home/brewski/.ndn/ndn-python-repo/sqlite3.db > /dev/null 2>&1 || true
+    rm -f ~/.ndn/psync-start.journal > /dev/null 2>&1 || true
+fi
 nfdc cs erase / > /dev/null 2>&1
-rm -f /home/brewski/.ndn/ndn-python-repo/sqlite3.db > /dev/null 2>&1 || true
 
 echo "[INFO] Starting ndn-python-repo..."
 ndn-python-repo > /dev/null 2>&1 &
 sleep 5
 
-echo "[INFO] Starting update-repo-file.py..."
-python3 update-repo-file.py &
-sleep 5
+if [ -x ./repo-watcher ]; then
+    # Watches, inserts and publishes in one process
+    echo "[INFO] Starting repo-watcher..."
+    ./repo-watcher psync &
+    sleep 1
+else
+    echo "[INFO] Starting psync-update publisher daemon..."
+    ./psync-update --daemon psync &
+    sleep 1
+
+    echo "[INFO] Starting update-repo-file.py..."
+    python3 update-repo-file.py &
+    sleep 5
+fi
 
 echo "[INFO] Starting psync-start..."
 ./psync-start psync / &
@@ -0,0 +1,262 @@
+/*
+  Append-only, memory-mapped journal of psync-start's sync state.
+
+  @author Waldo Jordaan
+*/
+
+#include "state-journal.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <boost/crc.hpp>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+NDN_LOG_INIT(PSync.StateJournal);
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char MAGIC[4] = {'V', '2', 'V', 'J'};
+const uint32_t VERSION = 1;
+const size_t HEADER_SIZE = 8;
+const size_t RECORD_HEADER_SIZE = 8;   // payload size, crc
+const size_t PAYLOAD_MIN = 1 + 8;      // type, value
+const size_t PAYLOAD_MAX = 64 * 1024;  // keys are names; anything larger is garbage
+const size_t GROW_STEP = 1 << 20;
+
+void
+putU32(uint8_t* out, uint32_t value)
+{
+  for (int i = 3; i >= 0; --i) {
+    *out++ = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+uint32_t
+getU32(const uint8_t* in)
+{
+  return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3];
+}
+
+uint32_t
+crc32(const uint8_t* data, size_t size)
+{
+  boost::crc_32_type crc;
+  crc.process_bytes(data, size);
+  return crc.checksum();
+}
+
+} // namespace
+
+StateJournal::StateJournal(const fs::path& path)
+  : m_path(path)
+{
+  std::error_code ec;
+  fs::create_directories(m_path.parent_path(), ec);
+
+  m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat st;
+  if (m_fd < 0 || ::fstat(m_fd, &st) != 0)
+    throw std::runtime_error("Cannot open journal " + m_path.string());
+
+  size_t fileSize = static_cast<size_t>(st.st_size);
+  if (!map(std::max(fileSize, GROW_STEP)))
+    throw std::runtime_error("Cannot map journal " + m_path.string());
+
+  if (fileSize < HEADER_SIZE || std::memcmp(m_data, MAGIC, sizeof(MAGIC)) != 0 ||
+      getU32(m_data + sizeof(MAGIC)) != VERSION) {
+    if (fileSize > 0) {
+      NDN_LOG_WARN("Unrecognized journal " << m_path << ", starting a new one");
+    }
+    std::memset(m_data, 0, m_capacity);
+    std::memcpy(m_data, MAGIC, sizeof(MAGIC));
+    putU32(m_data + sizeof(MAGIC), VERSION);
+    m_tail = HEADER_SIZE;
+    return;
+  }
+
+  // Find the end of the valid records
+  size_t pos = HEADER_SIZE;
+  while (pos + RECORD_HEADER_SIZE <= m_capacity) {
+    uint32_t size = getU32(m_data + pos);
+    if (size < PAYLOAD_MIN || size > PAYLOAD_MAX || pos + RECORD_HEADER_SIZE + size > m_capacity)
+      break;
+    const uint8_t* payload = m_data + pos + RECORD_HEADER_SIZE;
+    if (getU32(m_data + pos + 4) != crc32(payload, size))
+      break;
+    pos += RECORD_HEADER_SIZE + size;
+    ++m_nRecords;
+  }
+  m_tail = pos;
+
+  // Clear a torn record so that later appends never run into its remains
+  if (m_tail < m_capacity && getU32(m_data + m_tail) != 0) {
+    NDN_LOG_WARN("Dropping a torn record at offset " << m_tail << " of " << m_path);
+    std::memset(m_data + m_tail, 0, m_capacity - m_tail);
+  }
+}
+
+StateJournal::~StateJournal()
+{
+  if (m_data != nullptr) {
+    sync();
+    unmap();
+    // Drop the preallocated space; it is grown again on the next start
+    if (::ftruncate(m_fd, static_cast<off_t>(m_tail)) != 0) {
+      NDN_LOG_WARN("Cannot trim " << m_path);
+    }
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+  }
+}
+
+size_t
+StateJournal::replay(const std::function<void(const Record&)>& cb)
+{
+  size_t n = 0;
+  // Everything up to m_tail was checked when the journal was opened or written
+  for (size_t pos = HEADER_SIZE; pos < m_tail; ++n) {
+    uint32_t size = getU32(m_data + pos);
+    const uint8_t* payload = m_data + pos + RECORD_HEADER_SIZE;
+
+    Record record;
+    record.type = static_cast<Type>(payload[0]);
+    for (size_t i = 1; i < PAYLOAD_MIN; ++i) {
+      record.value = (record.value << 8) | payload[i];
+    }
+    record.key.assign(reinterpret_cast<const char*>(payload + PAYLOAD_MIN), size - PAYLOAD_MIN);
+    cb(record);
+
+    pos += RECORD_HEADER_SIZE + size;
+  }
+  return n;
+}
+
+void
+StateJournal::encode(const Record& record, std::vector<uint8_t>& out)
+{
+  size_t start = out.size();
+  size_t size = PAYLOAD_MIN + record.key.size();
+  out.resize(start + RECORD_HEADER_SIZE + size);
+
+  uint8_t* payload = out.data() + start + RECORD_HEADER_SIZE;
+  payload[0] = static_cast<uint8_t>(record.type);
+  for (size_t i = 1; i < PAYLOAD_MIN; ++i) {
+    payload[i] = static_cast<uint8_t>(record.value >> (8 * (PAYLOAD_MIN - 1 - i)));
+  }
+  std::memcpy(payload + PAYLOAD_MIN, record.key.data(), record.key.size());
+
+  putU32(out.data() + start, static_cast<uint32_t>(size));
+  putU32(out.data() + start + 4, crc32(payload, size));
+}
+
+bool
+StateJournal::append(const Record& record)
+{
+  if (PAYLOAD_MIN + record.key.size() > PAYLOAD_MAX)
+    return false;
+
+  std::vector<uint8_t> buf;
+  encode(record, buf);
+
+  if (m_tail + buf.size() > m_capacity) {
+    unmap();
+    if (!map(std::max(m_capacity * 2, m_tail + buf.size() + GROW_STEP))) {
+      NDN_LOG_ERROR("Cannot grow journal " << m_path);
+      map(m_capacity);
+      return false;
+    }
+  }
+
+  // The payload goes in before its size, which is what makes the record visible to replay()
+  std::memcpy(m_data + m_tail + 4, buf.data() + 4, buf.size() - 4);
+  std::memcpy(m_data + m_tail, buf.data(), 4);
+  m_tail += buf.size();
+  ++m_nRecords;
+  return true;
+}
+
+bool
+StateJournal::compact(const std::vector<Record>& live)
+{
+  std::vector<uint8_t> buf(HEADER_SIZE);
+  std::memcpy(buf.data(), MAGIC, sizeof(MAGIC));
+  putU32(buf.data() + sizeof(MAGIC), VERSION);
+  for (const auto& record : live) {
+    encode(record, buf);
+  }
+
+  fs::path tmp = m_path.string() + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0 && ::write(fd, buf.data(), buf.size()) == static_cast<ssize_t>(buf.size()) &&
+            ::fsync(fd) == 0;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  std::error_code ec;
+  if (ok) {
+    fs::rename(tmp, m_path, ec);
+  }
+  if (!ok || ec) {
+    NDN_LOG_WARN("Cannot compact " << m_path);
+    fs::remove(tmp, ec);
+    return false;
+  }
+
+  unmap();
+  ::close(m_fd);
+  m_fd = ::open(m_path.c_str(), O_RDWR | O_CLOEXEC);
+  if (m_fd < 0 || !map(buf.size() + GROW_STEP)) {
+    throw std::runtime_error("Cannot reopen compacted journal " + m_path.string());
+  }
+  m_tail = buf.size();
+  m_nRecords = live.size();
+  return true;
+}
+
+bool
+StateJournal::needsCompaction(size_t nLive, size_t minSize, size_t factor) const
+{
+  return m_tail > minSize && m_nRecords > nLive * factor;
+}
+
+void
+StateJournal::sync()
+{
+  if (m_data != nullptr && ::msync(m_data, m_tail, MS_SYNC) != 0) {
+    NDN_LOG_WARN("msync of " << m_path << " failed");
+  }
+}
+
+bool
+StateJournal::map(size_t capacity)
+{
+  if (::ftruncate(m_fd, static_cast<off_t>(capacity)) != 0)
+    return false;
+
+  void* data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (data == MAP_FAILED)
+    return false;
+
+  m_data = static_cast<uint8_t*>(data);
+  m_capacity = capacity;
+  return true;
+}
+
+void
+StateJournal::unmap()
+{
+  if (m_data != nullptr) {
+    ::munmap(m_data, m_capacity);
+    m_data = nullptr;
+  }
+}
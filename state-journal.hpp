@@ -0,0 +1,96 @@
+/*
+  Append-only, memory-mapped journal of psync-start's sync state.
+
+  The file is a small header followed by records, each checked by a CRC-32:
+    "V2VJ" | u32 version
+    record: u32 payloadSize | u32 crc32(payload) | payload
+    payload: u8 type | u64 value | key bytes
+  The file is grown ahead of the tail in steps and mapped MAP_SHARED, so an
+  append is a copy into the mapping and survives a crash of the process; the
+  page cache writes it back. replay() stops at the first record that is
+  zero, truncated or fails its CRC, so a record torn by a crash (or a power
+  loss before sync()) is dropped with everything after it.
+
+  Records are never updated in place. Once the journal has grown well past
+  the live state, the owner rewrites it with compact(): a fresh file holding
+  one record per live entry, synced and renamed over the old one.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_STATE_JOURNAL_HPP
+#define V2V_STATE_JOURNAL_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+class StateJournal
+{
+public:
+  enum class Type : uint8_t {
+    State   = 1, // key: sync prefix, value: sequence number
+    Cmd     = 2, // key: /cmd prefix, value: timestamp of a version executed
+    CmdUpTo = 3, // key: /cmd prefix, value: every version up to this timestamp executed
+  };
+
+  struct Record
+  {
+    Type type;
+    uint64_t value = 0;
+    std::string key;
+  };
+
+  // Opens or creates the journal; throws std::runtime_error if it cannot be mapped
+  explicit StateJournal(const std::filesystem::path& path);
+
+  ~StateJournal();
+
+  StateJournal(const StateJournal&) = delete;
+  StateJournal& operator=(const StateJournal&) = delete;
+
+  // Call every valid record in order. Returns the number of records.
+  size_t replay(const std::function<void(const Record&)>& cb);
+
+  // Returns false if the journal cannot grow (e.g. the disk is full)
+  bool append(const Record& record);
+
+  // Replace the journal with exactly these records
+  bool compact(const std::vector<Record>& live);
+
+  // Worth compacting: past minSize and more than factor times the live state
+  bool needsCompaction(size_t nLive, size_t minSize = 1 << 20, size_t factor = 4) const;
+
+  // Force appended records to disk (msync)
+  void sync();
+
+  // Bytes in use (header plus records)
+  size_t getSize() const
+  {
+    return m_tail;
+  }
+
+  size_t getRecordCount() const
+  {
+    return m_nRecords;
+  }
+
+private:
+  bool map(size_t capacity);
+
+  void unmap();
+
+  static void encode(const Record& record, std::vector<uint8_t>& out);
+
+private:
+  std::filesystem::path m_path;
+  int m_fd = -1;
+  uint8_t* m_data = nullptr;
+  size_t m_capacity = 0;
+  size_t m_tail = 0;
+  size_t m_nRecords = 0;
+};
+
+#endif // V2V_STATE_JOURNAL_HPP
@@ -2,5 +2,7 @@
 
 echo "[INFO] Stopping previous psync processes..."
 pkill -f "psync-start" || true
+pkill -f "psync-update" || true
 pkill -f "update-repo-file.py" || true
+pkill -f "repo-watcher" || true
 pkill -f "ndn-python-repo" || true
@@ -0,0 +1,73 @@
+/*
+  Subscription matcher for psync-start.
+
+  @author Waldo Jordaan
+*/
+
+#include "subs-matcher.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <fstream>
+
+NDN_LOG_INIT(PSync.SubsMatcher);
+
+long
+SubsMatcher::loadFile(const std::string& path)
+{
+  std::ifstream in(path);
+  if (!in.is_open())
+    return -1;
+
+  long nRules = 0;
+  size_t lineNo = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    ++lineNo;
+    line.erase(0, line.find_first_not_of(" \t\r\n"));
+    line.erase(line.find_last_not_of(" \t\r\n") + 1);
+    if (line.empty())
+      continue;
+
+    try {
+      addSubscription(ndn::Name(line), lineNo);
+    }
+    catch (const std::exception& e) {
+      NDN_LOG_WARN("Ignoring line " << lineNo << " of " << path << " ('" << line << "'): " << e.what());
+      continue;
+    }
+    ++nRules;
+  }
+  return nRules;
+}
+
+void
+SubsMatcher::addSubscription(const ndn::Name& prefix, size_t line)
+{
+  // A hostname rule for the same prefix stays; the subsfile entry adds nothing
+  const Rule* existing = m_rules.find(prefix);
+  if (existing && existing->kind == Rule::Kind::Hostname)
+    return;
+
+  m_rules.insert(prefix, {Rule::Kind::Subscription, prefix, line});
+}
+
+void
+SubsMatcher::setHostname(const std::string& hostname)
+{
+  ndn::Name prefix;
+  if (!hostname.empty())
+    prefix.append(ndn::name::Component::fromEscapedString(hostname)); // as in name.at(0).toUri() == hostname
+
+  m_rules.insert(prefix, {Rule::Kind::Hostname, prefix, 0});
+}
+
+const char*
+SubsMatcher::toString(Rule::Kind kind)
+{
+  switch (kind) {
+    case Rule::Kind::Subscription: return "subsfile";
+    case Rule::Kind::Hostname:     return "hostname";
+  }
+  return "unknown";
+}
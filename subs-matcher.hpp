@@ -0,0 +1,62 @@
+/*
+  Subscription matcher for psync-start.
+
+  Holds the rules that decide whether an update is fetched: every prefix from
+  the subsfile, plus a rule for this node's hostname (updates named
+  /<hostname>/...). Rules are stored in a NameTrie, so match() returns the most
+  specific rule in time proportional to the depth of the update's name.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_SUBS_MATCHER_HPP
+#define V2V_SUBS_MATCHER_HPP
+
+#include "name-trie.hpp"
+
+#include <string>
+
+class SubsMatcher
+{
+public:
+  struct Rule
+  {
+    enum class Kind { Subscription, Hostname };
+
+    Kind kind = Kind::Subscription;
+    ndn::Name prefix;
+    size_t line = 0; // line in the subsfile, 0 for the hostname rule
+  };
+
+  /*
+    Add one rule per non-empty line of path; a line that is not a valid name is
+    skipped. Returns the number of rules read, or -1 if the file could not be opened.
+  */
+  long loadFile(const std::string& path);
+
+  void addSubscription(const ndn::Name& prefix, size_t line = 0);
+
+  /*
+    Allow updates under /<hostname>. An empty hostname (gethostname() failed)
+    allows every update, as psync-start did before rules were indexed.
+  */
+  void setHostname(const std::string& hostname);
+
+  // The most specific rule covering name, or nullptr if the update is not subscribed
+  const Rule* match(const ndn::Name& name) const
+  {
+    return m_rules.longestPrefixMatch(name);
+  }
+
+  size_t size() const
+  {
+    return m_rules.size();
+  }
+
+  static const char* toString(Rule::Kind kind);
+
+private:
+  NameTrie<Rule> m_rules;
+};
+
+#endif // V2V_SUBS_MATCHER_HPP
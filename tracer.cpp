@@ -0,0 +1,152 @@
+/*
+  Per-update trace spans, exported as Chrome trace-event JSON.
+
+  @author Waldo Jordaan
+*/
+
+#include "tracer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void
+writeJsonString(std::ostream& os, const std::string& s)
+{
+  os << '"';
+  for (unsigned char c : s) {
+    switch (c) {
+      case '"': os << "\\\""; break;
+      case '\\': os << "\\\\"; break;
+      case '\n': os << "\\n"; break;
+      case '\t': os << "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          os << buf;
+        }
+        else {
+          os << c;
+        }
+    }
+  }
+  os << '"';
+}
+
+// "attempt=2 ok=1" -> ,"attempt":"2","ok":"1"
+void
+writeDetails(std::ostream& os, const std::string& details)
+{
+  std::istringstream is(details);
+  std::string pair;
+  while (is >> pair) {
+    auto eq = pair.find('=');
+    os << ',';
+    writeJsonString(os, pair.substr(0, eq));
+    os << ':';
+    writeJsonString(os, eq == std::string::npos ? "" : pair.substr(eq + 1));
+  }
+}
+
+} // namespace
+
+Tracer::Tracer(size_t capacity)
+  : m_capacity(std::max<size_t>(1, capacity))
+  , m_ring(m_capacity)
+{
+}
+
+void
+Tracer::record(const char* stage, const std::string& name, Clock::time_point start, Clock::time_point end,
+               const std::string& details)
+{
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  Span span;
+  span.stage = stage;
+  span.name = name;
+  span.details = details;
+  span.startUs = duration_cast<microseconds>(start.time_since_epoch()).count();
+  span.durationUs = duration_cast<microseconds>(end - start).count();
+  span.tid = currentTid();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_ring[m_next++ % m_capacity] = std::move(span);
+}
+
+void
+Tracer::nameThread(const std::string& threadName)
+{
+  uint32_t tid = currentTid();
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_threadNames[tid] = threadName;
+}
+
+bool
+Tracer::writeChromeTrace(const fs::path& path) const
+{
+  std::vector<Span> spans;
+  std::map<uint32_t, std::string> threadNames;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t n = std::min<uint64_t>(m_next, m_capacity);
+    spans.reserve(n);
+    for (uint64_t i = m_next - n; i < m_next; ++i) {
+      spans.push_back(m_ring[i % m_capacity]);
+    }
+    threadNames = m_threadNames;
+  }
+
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  std::ofstream out(path);
+  if (!out)
+    return false;
+
+  int pid = static_cast<int>(getpid());
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  for (const auto& [tid, threadName] : threadNames) {
+    out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+        << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+    writeJsonString(out, threadName);
+    out << "}}";
+    first = false;
+  }
+  for (const auto& span : spans) {
+    out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"cat\":\"psync\",\"name\":";
+    writeJsonString(out, span.stage);
+    out << ",\"pid\":" << pid << ",\"tid\":" << span.tid << ",\"ts\":" << span.startUs
+        << ",\"dur\":" << span.durationUs << ",\"args\":{\"name\":";
+    writeJsonString(out, span.name);
+    writeDetails(out, span.details);
+    out << "}}";
+    first = false;
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+uint64_t
+Tracer::getRecorded() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_next;
+}
+
+uint32_t
+Tracer::currentTid()
+{
+  thread_local uint32_t tid = static_cast<uint32_t>(::syscall(SYS_gettid));
+  return tid;
+}
@@ -0,0 +1,73 @@
+/*
+  Per-update trace spans, exported as Chrome trace-event JSON.
+
+  record() keeps one span (stage, versioned name, start, end, thread) in a
+  fixed-size ring; once the ring is full the oldest span is overwritten.
+  writeChromeTrace() writes a snapshot as complete ("X") events that
+  chrome://tracing and Perfetto (ui.perfetto.dev) load directly. Each span
+  carries the versioned name in its args, plus any details, so the stages of
+  one update can be found together and the critical path of a sync storm
+  read off the timeline.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_TRACER_HPP
+#define V2V_TRACER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Tracer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit Tracer(size_t capacity = 65536);
+
+  // Safe from any thread. stage must be a string literal; details is "key=value" pairs
+  // separated by spaces, like perf-log details.
+  void record(const char* stage, const std::string& name, Clock::time_point start, Clock::time_point end,
+              const std::string& details = {});
+
+  // Label the calling thread in the trace
+  void nameThread(const std::string& threadName);
+
+  // Returns false if the file cannot be written
+  bool writeChromeTrace(const std::filesystem::path& path) const;
+
+  // Spans recorded so far, including overwritten ones
+  uint64_t getRecorded() const;
+
+  size_t getCapacity() const
+  {
+    return m_capacity;
+  }
+
+private:
+  struct Span
+  {
+    const char* stage = nullptr;
+    std::string name;
+    std::string details;
+    int64_t startUs = 0;
+    int64_t durationUs = 0;
+    uint32_t tid = 0;
+  };
+
+  static uint32_t currentTid();
+
+private:
+  size_t m_capacity;
+  mutable std::mutex m_mutex;
+  std::vector<Span> m_ring;
+  uint64_t m_next = 0;
+  std::map<uint32_t, std::string> m_threadNames;
+};
+
+#endif // V2V_TRACER_HPP
@@ -0,0 +1,103 @@
+/*
+  Recursive inotify watch of a directory tree on the Face's io_context.
+
+  @author Waldo Jordaan
+*/
+
+#include "tree-watcher.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <stdexcept>
+
+NDN_LOG_INIT(PSync.TreeWatcher);
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+
+} // namespace
+
+TreeWatcher::TreeWatcher(boost::asio::io_context& io, const fs::path& root, Callback onChanged)
+  : m_inotify(io)
+  , m_onChanged(std::move(onChanged))
+{
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error("inotify_init1 failed");
+  m_inotify.assign(fd);
+
+  addTree(root, false);
+  if (m_dirs.empty())
+    throw std::runtime_error("inotify_add_watch failed for " + root.string());
+
+  read();
+}
+
+void
+TreeWatcher::addTree(const fs::path& dir, bool reportFiles)
+{
+  int wd = inotify_add_watch(m_inotify.native_handle(), dir.c_str(), WATCH_MASK);
+  if (wd < 0) {
+    // e.g. fs.inotify.max_user_watches reached, or the directory is already gone
+    NDN_LOG_WARN("Cannot watch " << dir);
+    return;
+  }
+  m_dirs[wd] = dir;
+
+  std::error_code ec;
+  for (const auto& entry : fs::directory_iterator(dir, ec)) {
+    if (entry.is_directory(ec) && !entry.is_symlink(ec))
+      addTree(entry.path(), reportFiles);
+    else if (reportFiles && entry.is_regular_file(ec))
+      m_onChanged(entry.path());
+  }
+}
+
+void
+TreeWatcher::read()
+{
+  m_inotify.async_read_some(boost::asio::buffer(m_buffer),
+    [this] (const boost::system::error_code& ec, size_t nBytes) {
+      if (ec)
+        return; // closed, or inotify is unusable; stop watching
+      handleEvents(nBytes);
+      read();
+    });
+}
+
+void
+TreeWatcher::handleEvents(size_t nBytes)
+{
+  for (size_t offset = 0; offset < nBytes; ) {
+    const auto* event = reinterpret_cast<const inotify_event*>(m_buffer.data() + offset);
+    offset += sizeof(inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+      NDN_LOG_WARN("inotify queue overflowed, some file changes were missed");
+      continue;
+    }
+    if (event->mask & IN_IGNORED) {
+      m_dirs.erase(event->wd); // directory removed or moved away
+      continue;
+    }
+
+    auto dir = m_dirs.find(event->wd);
+    if (dir == m_dirs.end() || event->len == 0)
+      continue;
+    fs::path path = dir->second / event->name;
+
+    if (event->mask & IN_ISDIR) {
+      if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        addTree(path, true);
+    }
+    else if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO)) {
+      m_onChanged(path);
+    }
+  }
+}
@@ -0,0 +1,56 @@
+/*
+  Recursive inotify watch of a directory tree on the Face's io_context.
+
+  Every directory under the root gets its own watch; directories created or
+  moved in later are added as they appear, and the files already inside them
+  are reported, since they may have been written before the watch existed.
+  onChanged runs on the io_context thread with the path of each regular file
+  that is modified, closed after writing or moved into the tree. Events come
+  in bursts while a file is written, so callers are expected to debounce.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_TREE_WATCHER_HPP
+#define V2V_TREE_WATCHER_HPP
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+
+class TreeWatcher
+{
+public:
+  using Callback = std::function<void(const std::filesystem::path& file)>;
+
+  // Throws std::runtime_error if inotify cannot be set up
+  TreeWatcher(boost::asio::io_context& io, const std::filesystem::path& root, Callback onChanged);
+
+  TreeWatcher(const TreeWatcher&) = delete;
+  TreeWatcher& operator=(const TreeWatcher&) = delete;
+
+  size_t getWatchCount() const
+  {
+    return m_dirs.size();
+  }
+
+private:
+  // Watch dir and everything below it; with reportFiles, report the files found
+  void addTree(const std::filesystem::path& dir, bool reportFiles);
+
+  void read();
+
+  void handleEvents(size_t nBytes);
+
+private:
+  boost::asio::posix::stream_descriptor m_inotify;
+  Callback m_onChanged;
+  std::unordered_map<int, std::filesystem::path> m_dirs; // watch descriptor -> directory
+  alignas(8) std::array<char, 16384> m_buffer;
+};
+
+#endif // V2V_TREE_WATCHER_HPP
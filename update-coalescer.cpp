@@ -0,0 +1,186 @@
+/*
+  Coalesces PSync updates so each object is fetched once, at its newest version.
+
+  @author Waldo Jordaan
+*/
+
+#include "update-coalescer.hpp"
+#include "version-index.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+UpdateCoalescer::Batch
+UpdateCoalescer::coalesce(const std::vector<psync::MissingDataInfo>& updates)
+{
+  Batch batch;
+  std::unordered_map<ndn::Name, size_t> slot; // generic prefix -> index in batch.updates
+
+  for (const auto& update : updates) {
+    auto [genericPrefix, ts] = VersionIndex::splitVersion(update.prefix);
+
+    // Every sequence number of a versioned prefix names the same object
+    if (update.highSeq > update.lowSeq)
+      count(genericPrefix).duplicates += update.highSeq - update.lowSeq;
+
+    auto it = slot.find(genericPrefix);
+    if (it == slot.end()) {
+      slot.emplace(genericPrefix, batch.updates.size());
+      batch.updates.push_back({update.prefix, genericPrefix, ts});
+      continue;
+    }
+
+    Update& kept = batch.updates[it->second];
+    if (ts > kept.timestamp) {
+      batch.dropped.push_back(kept.name);
+      kept.name = update.prefix;
+      kept.timestamp = ts;
+      ++count(genericPrefix).superseded;
+    }
+    else if (ts < kept.timestamp) {
+      batch.dropped.push_back(update.prefix);
+      ++count(genericPrefix).superseded;
+    }
+    else {
+      ++count(genericPrefix).duplicates;
+    }
+  }
+
+  return batch;
+}
+
+UpdateCoalescer::Admission
+UpdateCoalescer::admit(const ndn::Name& genericPrefix, uint64_t timestamp)
+{
+  auto it = m_pending.find(genericPrefix);
+  if (it == m_pending.end())
+    return Admission::Admitted;
+
+  Pending& pending = it->second;
+  uint64_t newest = std::max(pending.timestamp, pending.next);
+  if (newest >= timestamp) {
+    if (newest == timestamp)
+      ++count(genericPrefix).duplicates;
+    else
+      ++count(genericPrefix).superseded;
+    return Admission::Stale;
+  }
+
+  if (pending.started)
+    return Admission::Chained;
+
+  pending.event.cancel();
+  ++count(genericPrefix).cancelled;
+  m_pending.erase(it);
+  return Admission::Admitted;
+}
+
+void
+UpdateCoalescer::chain(const ndn::Name& genericPrefix, uint64_t timestamp, std::function<void()> resume)
+{
+  auto it = m_pending.find(genericPrefix);
+  if (it == m_pending.end() || timestamp <= std::max(it->second.timestamp, it->second.next))
+    return;
+
+  Pending& pending = it->second;
+  if (pending.next != 0)
+    ++count(genericPrefix).superseded;
+  ++count(genericPrefix).chained;
+  pending.next = timestamp;
+  pending.resume = std::move(resume);
+}
+
+void
+UpdateCoalescer::scheduled(const ndn::Name& genericPrefix, uint64_t timestamp,
+                           const ndn::scheduler::EventId& event)
+{
+  Pending& pending = m_pending[genericPrefix];
+  pending.timestamp = timestamp;
+  pending.started = false;
+  pending.event = event;
+}
+
+bool
+UpdateCoalescer::start(const ndn::Name& genericPrefix, uint64_t timestamp)
+{
+  auto it = m_pending.find(genericPrefix);
+  if (it == m_pending.end() || it->second.timestamp != timestamp || it->second.started)
+    return false;
+
+  it->second.started = true;
+  it->second.event.cancel();
+  return true;
+}
+
+bool
+UpdateCoalescer::isPending(const ndn::Name& genericPrefix, uint64_t timestamp) const
+{
+  auto it = m_pending.find(genericPrefix);
+  return it != m_pending.end() && it->second.timestamp == timestamp && it->second.next == 0;
+}
+
+void
+UpdateCoalescer::finished(const ndn::Name& genericPrefix, uint64_t timestamp)
+{
+  auto it = m_pending.find(genericPrefix);
+  if (it == m_pending.end() || it->second.timestamp != timestamp)
+    return;
+
+  auto resume = std::move(it->second.resume);
+  m_pending.erase(it);
+  if (resume)
+    resume();
+}
+
+const UpdateCoalescer::Stats*
+UpdateCoalescer::getStats(const ndn::Name& genericPrefix) const
+{
+  auto it = m_stats.find(genericPrefix);
+  return it == m_stats.end() ? nullptr : &it->second.stats;
+}
+
+std::vector<ndn::Name>
+UpdateCoalescer::takeChanged()
+{
+  // A prefix forgotten and counted again is listed twice, or not at all if it stays forgotten
+  std::vector<ndn::Name> changed;
+  for (auto& prefix : m_changed) {
+    auto it = m_stats.find(prefix);
+    if (it != m_stats.end() && it->second.changed) {
+      it->second.changed = false;
+      changed.push_back(std::move(prefix));
+    }
+  }
+  m_changed.clear();
+  return changed;
+}
+
+UpdateCoalescer::Stats&
+UpdateCoalescer::count(const ndn::Name& genericPrefix)
+{
+  if (m_stats.size() >= MAX_STATS && m_stats.count(genericPrefix) == 0) {
+    // Forget the least recently counted half, so this runs once per MAX_STATS / 2 new prefixes
+    std::vector<uint64_t> ticks;
+    ticks.reserve(m_stats.size());
+    for (const auto& [prefix, counted] : m_stats) {
+      ticks.push_back(counted.lastCounted);
+    }
+    auto median = ticks.begin() + ticks.size() / 2;
+    std::nth_element(ticks.begin(), median, ticks.end());
+    uint64_t cutoff = *median;
+    for (auto it = m_stats.begin(); it != m_stats.end();) {
+      if (it->second.lastCounted < cutoff)
+        it = m_stats.erase(it);
+      else
+        ++it;
+    }
+  }
+
+  Counted& counted = m_stats[genericPrefix];
+  counted.lastCounted = ++m_ticks;
+  if (!counted.changed) {
+    counted.changed = true;
+    m_changed.push_back(genericPrefix);
+  }
+  return counted.stats;
+}
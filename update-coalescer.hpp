@@ -0,0 +1,128 @@
+/*
+  Coalesces PSync updates so each object is fetched once, at its newest version.
+
+  A sync batch can carry many sequence numbers for the same versioned prefix and
+  several versions (/t=<ts>) of the same object. coalesce() reduces the batch to
+  one entry per generic prefix, and admit()/scheduled()/start()/finished()
+  track the one fetch that is allowed to be pending per prefix, cancelling a
+  scheduled fetch that a newer version has superseded. A fetch that has
+  already started is never run alongside a newer one: the newest version that
+  arrives meanwhile waits behind it and is resumed once it has finished, so
+  two versions of one object never write the same file or race their inserts.
+
+  Stats are only kept for prefixes that had something dropped, at most
+  MAX_STATS of them; the least recently counted half is forgotten when the
+  limit is reached.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_UPDATE_COALESCER_HPP
+#define V2V_UPDATE_COALESCER_HPP
+
+#include <PSync/common.hpp>
+#include <ndn-cxx/util/scheduler.hpp>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+class UpdateCoalescer
+{
+public:
+  // Work dropped for one generic prefix
+  struct Stats
+  {
+    uint64_t duplicates = 0; // repeated sequence numbers / names for a version already seen
+    uint64_t superseded = 0; // older versions dropped in favour of a newer one
+    uint64_t cancelled = 0;  // scheduled fetches cancelled by a newer version
+    uint64_t chained = 0;    // versions that waited for an older fetch already under way
+  };
+
+  enum class Admission
+  {
+    Admitted, // fetch it now
+    Stale,    // the same or a newer version is already pending
+    Chained,  // an older fetch is under way; pass the version to chain()
+  };
+
+  struct Update
+  {
+    ndn::Name name;          // versioned name, e.g. /bmw/a.csv/t=1693940000
+    ndn::Name genericPrefix; // /bmw/a.csv
+    uint64_t timestamp = 0;
+  };
+
+  struct Batch
+  {
+    std::vector<Update> updates;  // one per object, in order of first appearance
+    std::vector<ndn::Name> dropped;
+  };
+
+  // Prefixes whose stats are kept
+  static constexpr size_t MAX_STATS = 4096;
+
+  Batch coalesce(const std::vector<psync::MissingDataInfo>& updates);
+
+  /*
+    Whether a fetch of genericPrefix at timestamp should go ahead. An older
+    version that is still waiting for its scheduled start is cancelled; one
+    that has started makes this version wait (Chained).
+  */
+  Admission admit(const ndn::Name& genericPrefix, uint64_t timestamp);
+
+  /*
+    Run resume once the started fetch of genericPrefix has finished, in place of
+    any version chained before this one. resume is expected to admit timestamp again.
+  */
+  void chain(const ndn::Name& genericPrefix, uint64_t timestamp, std::function<void()> resume);
+
+  void scheduled(const ndn::Name& genericPrefix, uint64_t timestamp, const ndn::scheduler::EventId& event);
+
+  /*
+    Start the pending fetch of genericPrefix at timestamp: cancel its scheduled
+    event, after which it can no longer be cancelled. Returns false if that
+    version is no longer pending or has already started.
+  */
+  bool start(const ndn::Name& genericPrefix, uint64_t timestamp);
+
+  // Whether timestamp is still the pending version of genericPrefix and no newer one waits behind it
+  bool isPending(const ndn::Name& genericPrefix, uint64_t timestamp) const;
+
+  // Fetch and insert are over (successfully or not, or given up for a chained version);
+  // resumes the version chained behind it
+  void finished(const ndn::Name& genericPrefix, uint64_t timestamp);
+
+  // Stats of genericPrefix, or nullptr if nothing has been dropped for it (or it was forgotten)
+  const Stats* getStats(const ndn::Name& genericPrefix) const;
+
+  // Prefixes whose stats changed since the last call
+  std::vector<ndn::Name> takeChanged();
+
+private:
+  Stats& count(const ndn::Name& genericPrefix);
+
+private:
+  struct Pending
+  {
+    uint64_t timestamp = 0;
+    bool started = false;
+    ndn::scheduler::ScopedEventId event;
+    uint64_t next = 0;           // newest version chained behind a started fetch, 0 if none
+    std::function<void()> resume;
+  };
+
+  std::map<ndn::Name, Pending> m_pending; // newest pending version per prefix
+  struct Counted
+  {
+    Stats stats;
+    uint64_t lastCounted = 0; // m_ticks when last counted
+    bool changed = false;     // listed in m_changed
+  };
+
+  std::map<ndn::Name, Counted> m_stats;
+  std::vector<ndn::Name> m_changed;
+  uint64_t m_ticks = 0;
+};
+
+#endif // V2V_UPDATE_COALESCER_HPP
@@ -29,6 +29,7 @@ import atexit
 
 from termcolor import colored
 from repo_utils import getLatestVersion
+from codec_utils import load_codec_rules, lookup_codec
 
 # Thread synchronization primitives for shared structures
 LOCK = threading.Lock()
@@ -53,9 +54,11 @@ FALLBACK_PATH = Path("/home/brewski/masters")
 if FALLBACK_PATH.exists():              #code run on laptop
     WATCH_DIR = FALLBACK_PATH / "bmw"
     SOCKET_PATH = FALLBACK_PATH / "tmp/ndn-fetch.sock"
+    PUBLISH_SOCKET_PATH = FALLBACK_PATH / "tmp/psync-update.sock"
 else:
     WATCH_DIR = PRIMARY_PATH / "bmw"    #code run on rpi node
     SOCKET_PATH = PRIMARY_PATH / "tmp/ndn-fetch.sock"
+    PUBLISH_SOCKET_PATH = PRIMARY_PATH / "tmp/psync-update.sock"
 
 # Automatically delete the socket file on exit (clean shutdown)
 atexit.register(lambda: Path(SOCKET_PATH).unlink(missing_ok=True))
@@ -76,6 +79,7 @@ PUTFILE = "./putfile.py"
 DELFILE = "./delfile.py"
 PSYNC_UPDATE = "./psync-update"
 PSYNC_REPO_NAME = "psync"
+CHUNK_TOOL = "./chunk-tool" # adds each published version to the chunk store psync-start --chunks serves
 
 ENABLE_PERF_LOG = True
 # Always place logs in ~/perf_logs
@@ -99,7 +103,27 @@ def perf_log(filename: str, event: str, name: str):
 
 
 
+# One long-running cs-erase helper (cs/erase through the NFD management API) instead of nfdc per update
+CS_ERASE = "./cs-erase"
+CS_ERASE_LOCK = threading.Lock()
+CS_ERASER = None
+
 def erase_cs(name: str):
+    global CS_ERASER
+    with CS_ERASE_LOCK:
+        try:
+            if CS_ERASER is None or CS_ERASER.poll() is not None:
+                CS_ERASER = subprocess.Popen([CS_ERASE, "--stdin"], stdin=subprocess.PIPE,
+                                             stdout=subprocess.PIPE, text=True, bufsize=1)
+            CS_ERASER.stdin.write(name + "\n")
+            CS_ERASER.stdin.flush()
+            reply = CS_ERASER.stdout.readline().strip()
+            if reply.startswith("OK"):
+                return
+        except OSError:
+            CS_ERASER = None
+
+    # Helper missing or erase failed: fall back to nfdc
     subprocess.run([
         "nfdc", 
         "cs", 
@@ -120,18 +144,40 @@ def delete_from_repo(name: str):
     stdout=subprocess.DEVNULL, 
     stderr=subprocess.DEVNULL)
 
+    # Manifest of the same version (see putfile.py --manifest); missing for versions inserted without one
+    subprocess.run([
+        "python3", DELFILE,
+        "-r", REPO_NAME,
+        "-n", "/32=manifest" + name
+    ], check=False,
+    stdout=subprocess.DEVNULL,
+    stderr=subprocess.DEVNULL)
+
 
 def insert_to_repo(filepath: Path, name: str, timestamp: int):
+    # Per-prefix compression from ./codecs, re-read for every insert so edits apply without a restart
+    codec, level = lookup_codec(load_codec_rules(), name)
     subprocess.run([
         "python3", PUTFILE,
         "-r", REPO_NAME,
         "-f", str(filepath),
         "-n", name,
-        "--timestamp", str(timestamp)
+        "--timestamp", str(timestamp),
+        "--manifest",
+        "--codec", f"{codec}:{level}"
     ], check=True, 
     stdout=subprocess.DEVNULL, 
     stderr=subprocess.DEVNULL)
 
+def add_to_chunk_store(filepath: Path, name: str, timestamp: int):
+    if not os.path.exists(CHUNK_TOOL):
+        return
+    subprocess.run([
+        CHUNK_TOOL, "add", str(filepath), name, str(timestamp)
+    ], check=False,
+    stdout=subprocess.DEVNULL,
+    stderr=subprocess.DEVNULL)
+
 def wait_until_repo_ready(name: str, timestamp: int, interval=0.1):
     """
     Waits indefinitely until the repo has inserted the file version (based on timestamp).
@@ -149,7 +195,18 @@ def wait_until_repo_ready(name: str, timestamp: int, interval=0.1):
 
 
 def notify_update(name: str):
-    subprocess.run([PSYNC_UPDATE, PSYNC_REPO_NAME, name], check=True)
+    # Hand the name straight to the psync-update daemon; fall back to the CLI if it is not running
+    try:
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+            sock.connect(str(PUBLISH_SOCKET_PATH))
+            sock.sendall(f"PUBLISH {PSYNC_REPO_NAME} {name}\n".encode())
+            ack = sock.makefile().readline().strip()
+    except OSError:
+        subprocess.run([PSYNC_UPDATE, PSYNC_REPO_NAME, name], check=True)
+        return
+
+    if not ack.startswith("OK"):
+        raise RuntimeError(f"psync-update daemon: {ack}")
 
 
 def start_fetch_listener():
@@ -256,6 +313,7 @@ def process_file_change(file_path: Path):
         with DB_LOCK:
             perf_log(logfile, "INSERT_START", name)
             insert_to_repo(file_path, name, ts)
+        add_to_chunk_store(file_path, name, ts)
         
         wait_until_repo_ready(name, ts)
         perf_log(logfile, "INSERT_DONE", versioned_name)
@@ -0,0 +1,245 @@
+/*
+  In-memory prefix -> latest timestamp index over the ndn-python-repo SQLite DB.
+
+  @author Waldo Jordaan
+*/
+
+#include "version-index.hpp"
+
+#include <ndn-cxx/util/logger.hpp>
+
+#include <sqlite3.h>
+
+#include <vector>
+
+NDN_LOG_INIT(PSync.VersionIndex);
+
+namespace {
+
+// NDN TLV-VAR-NUMBER
+bool
+readVarNumber(const uint8_t*& pos, const uint8_t* end, uint64_t& number)
+{
+  if (pos >= end)
+    return false;
+
+  uint8_t first = *pos++;
+  size_t len = first < 253 ? 0 : first == 253 ? 2 : first == 254 ? 4 : 8;
+  if (len == 0) {
+    number = first;
+    return true;
+  }
+  if (static_cast<size_t>(end - pos) < len)
+    return false;
+
+  number = 0;
+  for (size_t i = 0; i < len; ++i)
+    number = (number << 8) | *pos++;
+  return true;
+}
+
+uint64_t
+readNumber(const uint8_t* value, size_t len)
+{
+  uint64_t n = 0;
+  for (size_t i = 0; i < len && i < 8; ++i)
+    n = (n << 8) | value[i];
+  return n;
+}
+
+} // namespace
+
+VersionIndex::VersionIndex(std::string dbPath)
+  : m_dbPath(std::move(dbPath))
+{
+}
+
+VersionIndex::~VersionIndex()
+{
+  if (m_db != nullptr)
+    sqlite3_close(m_db);
+}
+
+bool
+VersionIndex::open() const
+{
+  if (m_db != nullptr)
+    return true;
+
+  // The repo owns the DB; we only ever read it
+  if (sqlite3_open_v2(m_dbPath.c_str(), &m_db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+    NDN_LOG_WARN("Cannot open repo DB " << m_dbPath << ": " << sqlite3_errmsg(m_db));
+    sqlite3_close(m_db);
+    m_db = nullptr;
+    return false;
+  }
+  sqlite3_busy_timeout(m_db, 100);
+  return true;
+}
+
+size_t
+VersionIndex::load()
+{
+  m_latest.clear();
+  std::lock_guard<std::mutex> lock(m_dbMutex);
+  if (!open())
+    return 0;
+
+  sqlite3_stmt* stmt = nullptr;
+  if (sqlite3_prepare_v2(m_db, "SELECT key FROM data", -1, &stmt, nullptr) != SQLITE_OK) {
+    NDN_LOG_WARN("Cannot scan repo DB: " << sqlite3_errmsg(m_db));
+    return 0;
+  }
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    auto key = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0));
+    size_t len = sqlite3_column_bytes(stmt, 0);
+
+    ndn::Name prefix;
+    uint64_t ts = 0;
+    if (key != nullptr && parseKey(key, len, prefix, ts)) {
+      uint64_t& latest = m_latest[prefix];
+      latest = std::max(latest, ts);
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  return m_latest.size();
+}
+
+uint64_t
+VersionIndex::latest(const ndn::Name& genericPrefix) const
+{
+  auto it = m_latest.find(genericPrefix);
+  return it == m_latest.end() ? 0 : it->second;
+}
+
+uint64_t
+VersionIndex::refresh(const ndn::Name& genericPrefix)
+{
+  return applyLatest(genericPrefix, readLatest(genericPrefix));
+}
+
+std::optional<uint64_t>
+VersionIndex::readLatest(const ndn::Name& genericPrefix) const
+{
+  std::lock_guard<std::mutex> lock(m_dbMutex);
+  if (!open())
+    return std::nullopt;
+
+  // Every key of this prefix starts with the encoding of its generic components,
+  // so [prefix, prefix+1) covers them and is answered from the primary key index
+  std::vector<uint8_t> lower;
+  for (const auto& comp : genericPrefix) {
+    auto wire = comp.wireEncode().wire_bytes();
+    lower.insert(lower.end(), wire.begin(), wire.end());
+  }
+  std::vector<uint8_t> upper = lower;
+  while (!upper.empty() && upper.back() == 0xFF)
+    upper.pop_back();
+  if (!upper.empty())
+    ++upper.back();
+
+  const char* sql = upper.empty() ? "SELECT key FROM data WHERE key >= ?1"
+                                  : "SELECT key FROM data WHERE key >= ?1 AND key < ?2";
+  sqlite3_stmt* stmt = nullptr;
+  if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+    NDN_LOG_WARN("Cannot query repo DB: " << sqlite3_errmsg(m_db));
+    return std::nullopt;
+  }
+  sqlite3_bind_blob(stmt, 1, lower.data(), static_cast<int>(lower.size()), SQLITE_STATIC);
+  if (!upper.empty())
+    sqlite3_bind_blob(stmt, 2, upper.data(), static_cast<int>(upper.size()), SQLITE_STATIC);
+
+  uint64_t newest = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    auto key = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0));
+    size_t len = sqlite3_column_bytes(stmt, 0);
+
+    ndn::Name prefix;
+    uint64_t ts = 0;
+    // Longer names (e.g. /a/b under /a) share the byte prefix; keep exact matches only
+    if (key != nullptr && parseKey(key, len, prefix, ts) && prefix == genericPrefix)
+      newest = std::max(newest, ts);
+  }
+  sqlite3_finalize(stmt);
+  return newest;
+}
+
+uint64_t
+VersionIndex::applyLatest(const ndn::Name& genericPrefix, std::optional<uint64_t> newest)
+{
+  if (!newest)
+    return latest(genericPrefix);
+
+  if (*newest == 0)
+    m_latest.erase(genericPrefix);
+  else
+    m_latest[genericPrefix] = *newest;
+  return *newest;
+}
+
+void
+VersionIndex::update(const ndn::Name& genericPrefix, uint64_t timestamp)
+{
+  uint64_t& latest = m_latest[genericPrefix];
+  latest = std::max(latest, timestamp);
+}
+
+void
+VersionIndex::erase(const ndn::Name& genericPrefix, uint64_t timestamp)
+{
+  auto it = m_latest.find(genericPrefix);
+  if (it != m_latest.end() && it->second == timestamp)
+    m_latest.erase(it);
+}
+
+std::pair<ndn::Name, uint64_t>
+VersionIndex::splitVersion(const ndn::Name& name)
+{
+  ndn::Name genericPrefix;
+  uint64_t ts = 0;
+  for (const auto& comp : name) {
+    if (comp.isGeneric()) {
+      genericPrefix.append(comp);
+    }
+    else {
+      if (comp.isTimestamp())
+        ts = comp.toNumber();
+      break;
+    }
+  }
+  return {genericPrefix, ts};
+}
+
+bool
+VersionIndex::parseKey(const uint8_t* key, size_t len, ndn::Name& genericPrefix, uint64_t& timestamp)
+{
+  const uint8_t* pos = key;
+  const uint8_t* end = key + len;
+  bool inPrefix = true;
+
+  while (pos < end) {
+    uint64_t type = 0;
+    uint64_t length = 0;
+    if (!readVarNumber(pos, end, type) || !readVarNumber(pos, end, length) ||
+        static_cast<uint64_t>(end - pos) < length) {
+      return false;
+    }
+
+    if (type == ndn::tlv::GenericNameComponent && inPrefix) {
+      genericPrefix.append(ndn::name::Component(ndn::tlv::GenericNameComponent,
+                                                ndn::span<const uint8_t>(pos, length)));
+    }
+    else {
+      inPrefix = false;
+      // Keys that do not start with a generic component (e.g. /32=manifest/...) are not file objects
+      if (type == ndn::tlv::TimestampNameComponent && !genericPrefix.empty()) {
+        timestamp = readNumber(pos, length);
+        return true;
+      }
+    }
+    pos += length;
+  }
+  return false;
+}
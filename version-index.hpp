@@ -0,0 +1,91 @@
+/*
+  In-memory prefix -> latest timestamp index over the ndn-python-repo SQLite DB.
+
+  Replaces repo_utils.getLatestVersion (a full "SELECT key FROM data" scan per
+  call) on psync-start's hot path. The table is scanned once at start-up; after
+  that the index is kept current from psync-start's own inserts and deletes, and
+  a single prefix can be re-read with an indexed range query on the key column.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_VERSION_INDEX_HPP
+#define V2V_VERSION_INDEX_HPP
+
+#include <ndn-cxx/name.hpp>
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct sqlite3;
+
+class VersionIndex
+{
+public:
+  explicit VersionIndex(std::string dbPath);
+
+  ~VersionIndex();
+
+  VersionIndex(const VersionIndex&) = delete;
+  VersionIndex& operator=(const VersionIndex&) = delete;
+
+  // Scan every key in the repo once. Returns the number of prefixes indexed.
+  size_t load();
+
+  // Latest timestamp known for a generic (unversioned) prefix, 0 if none
+  uint64_t latest(const ndn::Name& genericPrefix) const;
+
+  /*
+    Re-read the versions of one prefix from the repo, e.g. to pick up objects
+    inserted by update-repo-file.py. Only keys that start with the prefix are
+    visited. Returns the refreshed latest timestamp.
+  */
+  uint64_t refresh(const ndn::Name& genericPrefix);
+
+  /*
+    The two halves of refresh(), for callers that read the DB off the io thread.
+    readLatest() only reads the DB (newest timestamp, 0 if none, nullopt if the DB
+    cannot be read) and is safe from any thread; applyLatest() stores its result
+    in the index like refresh() and returns the latest timestamp now indexed.
+  */
+  std::optional<uint64_t> readLatest(const ndn::Name& genericPrefix) const;
+
+  uint64_t applyLatest(const ndn::Name& genericPrefix, std::optional<uint64_t> newest);
+
+  // A version was inserted into the repo
+  void update(const ndn::Name& genericPrefix, uint64_t timestamp);
+
+  // A version was deleted from the repo; forgets the prefix if it was the latest one
+  void erase(const ndn::Name& genericPrefix, uint64_t timestamp);
+
+  size_t size() const
+  {
+    return m_latest.size();
+  }
+
+  // Latest timestamp of every indexed prefix
+  const std::unordered_map<ndn::Name, uint64_t>& getAll() const
+  {
+    return m_latest;
+  }
+
+  // Leading generic components of name and its timestamp component (0 if absent)
+  static std::pair<ndn::Name, uint64_t> splitVersion(const ndn::Name& name);
+
+private:
+  // Caller holds m_dbMutex
+  bool open() const;
+
+  // Parse a repo key (concatenated name component TLVs, no outer Name TLV)
+  static bool parseKey(const uint8_t* key, size_t len, ndn::Name& genericPrefix, uint64_t& timestamp);
+
+private:
+  std::string m_dbPath;
+  mutable std::mutex m_dbMutex; // m_db is shared by the io thread and readLatest() callers
+  mutable sqlite3* m_db = nullptr;
+  std::unordered_map<ndn::Name, uint64_t> m_latest;
+};
+
+#endif // V2V_VERSION_INDEX_HPP
@@ -0,0 +1,244 @@
+/*
+  Bounded, staged executor for psync-start's per-update work.
+
+  @author Waldo Jordaan
+*/
+
+#include "work-executor.hpp"
+
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
+
+WorkExecutor::WorkExecutor(boost::asio::io_context& io, const std::array<StageConfig, N_STAGES>& config)
+  : m_io(io)
+{
+  for (size_t i = 0; i < N_STAGES; ++i) {
+    m_stages[i].config = config[i];
+    m_stages[i].config.concurrency = std::max<size_t>(1, config[i].concurrency);
+
+    if (m_stages[i].config.blocking) {
+      for (size_t n = 0; n < m_stages[i].config.concurrency; ++n) {
+        m_workers.emplace_back(&WorkExecutor::workerLoop, this, static_cast<Stage>(i));
+      }
+    }
+  }
+}
+
+WorkExecutor::~WorkExecutor()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_cv.notify_all();
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+}
+
+WorkExecutor::Submitted
+WorkExecutor::submit(Stage stage, const ndn::Name& key, uint64_t version, Job job, Priority priority)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  StageState& state = m_stages[static_cast<size_t>(stage)];
+
+  auto it = state.queue.end();
+  if (state.config.supersede) {
+    it = std::find_if(state.queue.begin(), state.queue.end(), [&] (const Entry& e) { return e.key == key; });
+  }
+  if (it != state.queue.end()) {
+    if (it->version > version)
+      return Submitted::Superseded;
+
+    it->version = version;
+    it->job = std::move(job);
+    it->priority = priority;
+    ++state.stats.replaced;
+    return Submitted::Queued;
+  }
+
+  if (state.queue.size() >= state.config.queueLimit) {
+    ++state.stats.rejected;
+    return Submitted::Rejected;
+  }
+
+  state.queue.push_back({key, version, std::move(job), priority, std::chrono::steady_clock::now()});
+  state.stats.queued = state.queue.size();
+  state.stats.maxQueued = std::max(state.stats.maxQueued, state.stats.queued);
+
+  if (state.config.blocking)
+    m_cv.notify_all();
+  else
+    dispatchLocked(stage);
+  return Submitted::Queued;
+}
+
+WorkExecutor::StageStats
+WorkExecutor::getStats(Stage stage) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stages[static_cast<size_t>(stage)].stats;
+}
+
+std::deque<WorkExecutor::Entry>::iterator
+WorkExecutor::pickLocked(StageState& state)
+{
+  auto now = std::chrono::steady_clock::now();
+  auto best = state.queue.end();
+  long bestLevel = 0;
+  for (auto it = state.queue.begin(); it != state.queue.end(); ++it) {
+    size_t p = static_cast<size_t>(it->priority);
+    size_t limit = state.config.priorityLimit[p];
+    if (limit != 0 && state.inFlight[p] >= limit)
+      continue;
+
+    long level = static_cast<long>(p);
+    if (state.config.aging.count() > 0)
+      level -= static_cast<long>((now - it->queued) / state.config.aging);
+    if (best == state.queue.end() || level < bestLevel ||
+        (level == bestLevel && it->queued < best->queued)) {
+      best = it;
+      bestLevel = level;
+    }
+  }
+  return best;
+}
+
+WorkExecutor::Entry
+WorkExecutor::startLocked(StageState& state, std::deque<Entry>::iterator it)
+{
+  for (const auto& other : state.queue) {
+    size_t p = static_cast<size_t>(other.priority);
+    size_t limit = state.config.priorityLimit[p];
+    if (other.priority < it->priority && (limit == 0 || state.inFlight[p] < limit)) {
+      ++state.stats.aged;
+      break;
+    }
+  }
+
+  Entry entry = std::move(*it);
+  state.queue.erase(it);
+  state.stats.queued = state.queue.size();
+  ++state.stats.inFlight;
+  ++state.inFlight[static_cast<size_t>(entry.priority)];
+  return entry;
+}
+
+void
+WorkExecutor::dispatchLocked(Stage stage)
+{
+  StageState& state = m_stages[static_cast<size_t>(stage)];
+
+  while (state.stats.inFlight < state.config.concurrency) {
+    auto it = pickLocked(state);
+    if (it == state.queue.end())
+      break;
+
+    Entry entry = startLocked(state, it);
+    boost::asio::post(m_io, [this, stage, priority = entry.priority, job = std::move(entry.job)] {
+      job([this, stage, priority] { complete(stage, priority); });
+    });
+  }
+}
+
+void
+WorkExecutor::complete(Stage stage, Priority priority)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  StageState& state = m_stages[static_cast<size_t>(stage)];
+  --state.stats.inFlight;
+  --state.inFlight[static_cast<size_t>(priority)];
+  ++state.stats.completed;
+
+  if (!state.config.blocking)
+    dispatchLocked(stage);
+  else if (state.config.priorityLimit[static_cast<size_t>(priority)] != 0)
+    m_cv.notify_all(); // a job held back by the limit may start now
+}
+
+void
+WorkExecutor::workerLoop(Stage stage)
+{
+  StageState& state = m_stages[static_cast<size_t>(stage)];
+
+  while (true) {
+    Entry entry;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto it = state.queue.end();
+      m_cv.wait(lock, [&] { return m_stopping || (it = pickLocked(state)) != state.queue.end(); });
+      if (m_stopping)
+        return;
+
+      entry = startLocked(state, it);
+    }
+
+    // Blocking jobs finish on this thread, so the slot is released once the job returns
+    entry.job([] {});
+    complete(stage, entry.priority);
+  }
+}
+
+const char*
+WorkExecutor::toString(Stage stage)
+{
+  switch (stage) {
+    case Stage::Erase:  return "erase";
+    case Stage::Delete: return "delete";
+    case Stage::Fetch:  return "fetch";
+    case Stage::Insert: return "insert";
+    case Stage::Cmd:    return "cmd";
+  }
+  return "unknown";
+}
+
+bool
+WorkExecutor::parseStage(const std::string& str, Stage& stage)
+{
+  for (size_t i = 0; i < N_STAGES; ++i) {
+    if (str == toString(static_cast<Stage>(i))) {
+      stage = static_cast<Stage>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char*
+WorkExecutor::toString(Priority priority)
+{
+  switch (priority) {
+    case Priority::Cmd:  return "cmd";
+    case Priority::Host: return "host";
+    case Priority::Subs: return "subs";
+    case Priority::Bulk: return "bulk";
+  }
+  return "unknown";
+}
+
+bool
+WorkExecutor::parsePriority(const std::string& str, Priority& priority)
+{
+  for (size_t i = 0; i < N_PRIORITIES; ++i) {
+    if (str == toString(static_cast<Priority>(i))) {
+      priority = static_cast<Priority>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::array<WorkExecutor::StageConfig, WorkExecutor::N_STAGES>
+WorkExecutor::defaultConfig()
+{
+  std::array<StageConfig, N_STAGES> config;
+  config[static_cast<size_t>(Stage::Erase)]  = {32, 256, false, true}; // cs/erase commands, batched by CsEraser
+  config[static_cast<size_t>(Stage::Delete)] = {4, 256, false};
+  config[static_cast<size_t>(Stage::Fetch)]  = {4, 256, false, true};
+  config[static_cast<size_t>(Stage::Insert)] = {2, 256, false};
+  config[static_cast<size_t>(Stage::Cmd)]    = {1, 64, true};   // bash <script>
+  // Keep a fetch slot free of bulk objects for /cmd and small updates
+  config[static_cast<size_t>(Stage::Fetch)].priorityLimit[static_cast<size_t>(Priority::Bulk)] = 3;
+  return config;
+}
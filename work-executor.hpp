@@ -0,0 +1,152 @@
+/*
+  Bounded, staged executor for psync-start's per-update work.
+
+  Each stage (CS erase, repo delete, fetch, repo insert, /cmd execution) has its
+  own queue, queue limit and concurrency. Blocking stages run on a fixed set of
+  worker threads; asynchronous stages start their jobs on the Face's io_context
+  and hold their slot until the job reports completion. Jobs are keyed by
+  generic prefix. In stages that supersede (CS erase, fetch), a newer version
+  replaces an older job for the same prefix that is still queued, so a full
+  queue never holds two versions of one object. Other stages run every job:
+  an older version's delete or /cmd must not be lost to a newer one.
+
+  Queued jobs do not run in arrival order but by priority: /cmd first, then
+  updates targeted at this host, then other subscribed objects, then bulk
+  (large) objects. A job gains one priority level for every StageConfig::aging
+  it waits, so bulk work is delayed but never starved, and each priority can be
+  held to fewer slots than the stage's concurrency so a burst of bulk fetches
+  cannot occupy them all.
+
+  @author Waldo Jordaan
+*/
+
+#ifndef V2V_WORK_EXECUTOR_HPP
+#define V2V_WORK_EXECUTOR_HPP
+
+#include <ndn-cxx/name.hpp>
+
+#include <boost/asio/io_context.hpp>
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class WorkExecutor
+{
+public:
+  enum class Stage { Erase, Delete, Fetch, Insert, Cmd };
+  static constexpr size_t N_STAGES = 5;
+
+  enum class Priority { Cmd, Host, Subs, Bulk };
+  static constexpr size_t N_PRIORITIES = 4;
+
+  // A job receives done() and must call it exactly once when its work is over
+  using Done = std::function<void()>;
+  using Job = std::function<void(Done)>;
+
+  enum class Submitted
+  {
+    Queued,
+    Superseded, // a newer version of the key is already queued
+    Rejected,   // the queue is full
+  };
+
+  struct StageConfig
+  {
+    size_t concurrency = 1;
+    size_t queueLimit = 256;
+    bool blocking = false; // run on executor threads instead of the io_context
+    bool supersede = false; // a newer version of a key replaces its queued job
+    std::array<size_t, N_PRIORITIES> priorityLimit{}; // jobs of a priority in flight; 0 = concurrency
+    std::chrono::milliseconds aging{2000};          // wait that raises a queued job one level; 0 = never
+  };
+
+  struct StageStats
+  {
+    size_t queued = 0;
+    size_t inFlight = 0;
+    size_t maxQueued = 0;   // high-water mark of the queue
+    uint64_t completed = 0;
+    uint64_t replaced = 0;  // queued jobs replaced by a newer version of the same prefix
+    uint64_t rejected = 0;  // dropped because the queue was full
+    uint64_t aged = 0;      // started ahead of a higher-priority job because they had waited longer
+  };
+
+  WorkExecutor(boost::asio::io_context& io, const std::array<StageConfig, N_STAGES>& config);
+
+  ~WorkExecutor();
+
+  WorkExecutor(const WorkExecutor&) = delete;
+  WorkExecutor& operator=(const WorkExecutor&) = delete;
+
+  /*
+    Queue job for key at version. In a superseding stage a newer version that
+    replaces a queued job takes its priority but keeps its wait, and an older
+    version than the one queued is not queued (Superseded).
+  */
+  Submitted submit(Stage stage, const ndn::Name& key, uint64_t version, Job job,
+              Priority priority = Priority::Subs);
+
+  StageStats getStats(Stage stage) const;
+
+  static const char* toString(Stage stage);
+
+  static bool parseStage(const std::string& str, Stage& stage);
+
+  static const char* toString(Priority priority);
+
+  static bool parsePriority(const std::string& str, Priority& priority);
+
+  static std::array<StageConfig, N_STAGES> defaultConfig();
+
+private:
+  struct Entry
+  {
+    ndn::Name key;
+    uint64_t version = 0;
+    Job job;
+    Priority priority = Priority::Subs;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  struct StageState
+  {
+    StageConfig config;
+    std::deque<Entry> queue;
+    StageStats stats;
+    std::array<size_t, N_PRIORITIES> inFlight{}; // per priority
+  };
+
+  /*
+    The queued job to start next: the lowest priority level after aging whose
+    priority is below its limit, the longest waiting on a tie. Returns
+    queue.end() if every queued job's priority is at its limit. Caller holds m_mutex.
+  */
+  static std::deque<Entry>::iterator pickLocked(StageState& state);
+
+  // Dequeue it and take its slots. Caller holds m_mutex.
+  static Entry startLocked(StageState& state, std::deque<Entry>::iterator it);
+
+  // Start as many queued jobs of an io_context stage as its concurrency allows. Caller holds m_mutex.
+  void dispatchLocked(Stage stage);
+
+  void complete(Stage stage, Priority priority);
+
+  void workerLoop(Stage stage);
+
+private:
+  boost::asio::io_context& m_io;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stopping = false;
+  std::array<StageState, N_STAGES> m_stages;
+  std::vector<std::thread> m_workers;
+};
+
+#endif // V2V_WORK_EXECUTOR_HPP